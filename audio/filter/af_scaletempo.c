@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <float.h>
+#include <math.h>
 #include <assert.h>
 
 #include "common/common.h"
@@ -70,6 +72,11 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    // FFT correlation (fft_buf is NULL if only the direct search is used)
+    int fft_bits;
+    double *fft_buf;
+    double *fft_acc;
+    double *fft_tw;
     // command line
     float scale_nominal;
     float ms_stride;
@@ -117,70 +124,245 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
 
 #define UNROLL_PADDING (4 * 4)
 
+// Use the FFT if the direct search needs more than this many times as many
+// multiplications as the transforms (roughly). The direct search vectorizes
+// well, while the FFT does not.
+#define FFT_MIN_GAIN 12
+
+// In-place radix-2 complex FFT of d (interleaved real/imaginary parts). The
+// inverse transform is not normalized.
+static void fft(af_scaletempo_t *s, double *d, bool inverse)
+{
+    int n = 1 << s->fft_bits;
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            MPSWAP(double, d[2 * i + 0], d[2 * j + 0]);
+            MPSWAP(double, d[2 * i + 1], d[2 * j + 1]);
+        }
+    }
+
+    double sign = inverse ? -1 : 1;
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2, step = n / len;
+        for (int k = 0; k < half; k++) {
+            double wr = s->fft_tw[2 * k * step + 0];
+            double wi = s->fft_tw[2 * k * step + 1] * sign;
+            for (int i = k; i < n; i += len) {
+                double *a = d + 2 * i;
+                double *b = a + 2 * half;
+                double tr = b[0] * wr - b[1] * wi;
+                double ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+// The correlation is computed per channel: fft_buf contains one channel of the
+// pre-multiplied overlap as real part, and the same channel of the search
+// window as imaginary part. Add the cross spectrum of both to fft_acc.
+static void fft_add_channel(af_scaletempo_t *s, bool first)
+{
+    double *d = s->fft_buf;
+    int n = 1 << s->fft_bits;
+
+    fft(s, d, false);
+    // Separate the two real input spectra A and B, and compute conj(A) * B.
+    // The result is hermitian, so only half of it is needed.
+    for (int k = 0; k <= n / 2; k++) {
+        int m = (n - k) & (n - 1);
+        double zr = d[2 * k], zi = d[2 * k + 1];
+        double mr = d[2 * m], mi = d[2 * m + 1];
+        double ar = (zr + mr) / 2, ai = (zi - mi) / 2;
+        double br = (zi + mi) / 2, bi = (mr - zr) / 2;
+        double pr = ar * br + ai * bi;
+        double pi = ar * bi - ai * br;
+        if (first) {
+            s->fft_acc[2 * k + 0] = pr;
+            s->fft_acc[2 * k + 1] = pi;
+        } else {
+            s->fft_acc[2 * k + 0] += pr;
+            s->fft_acc[2 * k + 1] += pi;
+        }
+    }
+}
+
+// Transform the accumulated cross spectrum back. Afterwards, the real part of
+// fft_buf[2 * off] is the correlation at frame offset off.
+static void fft_finish(af_scaletempo_t *s)
+{
+    double *d = s->fft_buf;
+    int n = 1 << s->fft_bits;
+
+    for (int k = 0; k <= n / 2; k++) {
+        int m = (n - k) & (n - 1);
+        d[2 * k + 0] = s->fft_acc[2 * k + 0] / n;
+        d[2 * k + 1] = s->fft_acc[2 * k + 1] / n;
+        d[2 * m + 0] = d[2 * k + 0];
+        d[2 * m + 1] = -d[2 * k + 1];
+    }
+    fft(s, d, true);
+}
+
+// Return the lowest correlation value (as computed by the FFT) an offset can
+// have and still be the best offset of the direct search. sq_a and sq_b are
+// the sums of squares of the inputs, rel_err the relative error bound of the
+// direct dot product.
+static double fft_threshold(af_scaletempo_t *s, double sq_a, double sq_b,
+                            double rel_err)
+{
+    double max = -INFINITY;
+    for (int off = 0; off < s->frames_search; off++)
+        max = MPMAX(max, s->fft_buf[2 * off]);
+
+    // Both the FFT and the direct dot products have rounding errors, which are
+    // bounded by |a| * |b| (Cauchy-Schwarz) times a relative error.
+    double fft_err = (s->fft_bits + 4) * sqrt(1 << s->fft_bits) * DBL_EPSILON;
+    return max - 2 * sqrt(sq_a * sq_b) * (rel_err + fft_err * s->num_channels);
+}
+
+static float dot_float(const float *a, const float *b, int len)
+{
+    float c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    int i = 0;
+    for (; i < (len & ~3); i += 4) {
+        c0 += a[i + 0] * b[i + 0];
+        c1 += a[i + 1] * b[i + 1];
+        c2 += a[i + 2] * b[i + 2];
+        c3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < len; i++)
+        c0 += a[i] * b[i];
+    return (c0 + c1) + (c2 + c3);
+}
+
+// Reads up to 3 elements past the end of a and b; a must be zero-padded.
+static int64_t dot_s16(const int32_t *a, const int16_t *b, int len)
+{
+    int64_t corr = 0;
+    for (int i = 0; i < len; i += 4) {
+        corr += a[i + 0] * b[i + 0];
+        corr += a[i + 1] * b[i + 1];
+        corr += a[i + 2] * b[i + 2];
+        corr += a[i + 3] * b[i + 3];
+    }
+    return corr;
+}
+
+// The FFT path only selects the candidate offsets whose correlation could be
+// the maximum; these are then computed with the same dot product as the direct
+// search, so both paths return identical offsets.
+
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
+    int nch = s->num_channels;
+    int len = s->samples_overlap - nch;
     float best_corr = INT_MIN;
     int best_off = 0;
 
     float *pw  = s->table_window;
     float *po  = s->buf_overlap;
-    po += s->num_channels;
+    po += nch;
     float *ppc = s->buf_pre_corr;
-    for (int i = s->num_channels; i < s->samples_overlap; i++)
-        *ppc++ = *pw++ **po++;
+    for (int i = 0; i < len; i++)
+        ppc[i] = pw[i] * po[i];
+
+    float *search_start = (float *)s->buf_queue + nch;
+
+    double threshold = -INFINITY;
+    if (s->fft_buf) {
+        int n = 1 << s->fft_bits;
+        int len_ch = len / nch;
+        int len_search_ch = s->frames_search - 1 + len_ch;
+        double sq_a = 0, sq_b = 0;
+        for (int ch = 0; ch < nch; ch++) {
+            for (int i = 0; i < n; i++) {
+                double a = i < len_ch ? ppc[i * nch + ch] : 0;
+                double b = i < len_search_ch ? search_start[i * nch + ch] : 0;
+                s->fft_buf[2 * i + 0] = a;
+                s->fft_buf[2 * i + 1] = b;
+                sq_a += a * a;
+                sq_b += b * b;
+            }
+            fft_add_channel(s, ch == 0);
+        }
+        if (!(sq_a > 0 && sq_b > 0))
+            return 0; // all correlations are 0
+        fft_finish(s);
+        threshold = fft_threshold(s, sq_a, sq_b, len * FLT_EPSILON);
+    }
 
-    float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        if (s->fft_buf && s->fft_buf[2 * off] < threshold)
+            continue;
+        float corr = dot_float(ppc, search_start + off * nch, len);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
         }
-        search_start += s->num_channels;
     }
 
-    return best_off * 4 * s->num_channels;
+    return best_off * 4 * nch;
 }
 
 static int best_overlap_offset_s16(af_scaletempo_t *s)
 {
+    int nch = s->num_channels;
+    int len = s->samples_overlap - nch;
     int64_t best_corr = INT64_MIN;
     int best_off = 0;
 
     int32_t *pw  = s->table_window;
     int16_t *po  = s->buf_overlap;
-    po += s->num_channels;
+    po += nch;
     int32_t *ppc = s->buf_pre_corr;
-    for (long i = s->num_channels; i < s->samples_overlap; i++)
-        *ppc++ = (*pw++ **po++) >> 15;
+    for (int i = 0; i < len; i++)
+        ppc[i] = (pw[i] * po[i]) >> 15;
+
+    int16_t *search_start = (int16_t *)s->buf_queue + nch;
+
+    double threshold = -INFINITY;
+    if (s->fft_buf) {
+        int n = 1 << s->fft_bits;
+        int len_ch = len / nch;
+        int len_search_ch = s->frames_search - 1 + len_ch;
+        double sq_a = 0, sq_b = 0;
+        for (int ch = 0; ch < nch; ch++) {
+            for (int i = 0; i < n; i++) {
+                double a = i < len_ch ? ppc[i * nch + ch] : 0;
+                double b = i < len_search_ch ? search_start[i * nch + ch] : 0;
+                s->fft_buf[2 * i + 0] = a;
+                s->fft_buf[2 * i + 1] = b;
+                sq_a += a * a;
+                sq_b += b * b;
+            }
+            fft_add_channel(s, ch == 0);
+        }
+        if (!(sq_a > 0 && sq_b > 0))
+            return 0; // all correlations are 0
+        fft_finish(s);
+        threshold = fft_threshold(s, sq_a, sq_b, 0);
+    }
 
-    int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        int64_t corr = 0;
-        int16_t *ps = search_start;
-        ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
-        do {
-            corr += ppc[i + 0] * ps[i + 0];
-            corr += ppc[i + 1] * ps[i + 1];
-            corr += ppc[i + 2] * ps[i + 2];
-            corr += ppc[i + 3] * ps[i + 3];
-            i += 4;
-        } while (i < 0);
+        if (s->fft_buf && s->fft_buf[2 * off] < threshold)
+            continue;
+        int64_t corr = dot_s16(ppc, search_start + off * nch, len);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
         }
-        search_start += s->num_channels;
     }
 
-    return best_off * 2 * s->num_channels;
+    return best_off * 2 * nch;
 }
 
 static void output_overlap_float(af_scaletempo_t *s, void *buf_out,
@@ -369,8 +551,9 @@ static int control(struct af_instance *af, int cmd, void *arg)
                     MP_FATAL(af, "Out of memory\n");
                     return AF_ERROR;
                 }
-                memset((char *)s->buf_pre_corr + s->bytes_overlap * 2, 0,
-                       UNROLL_PADDING);
+                // Only the first (frames_overlap - 1) * nch entries are set
+                // later, the rest is padding for dot_s16().
+                memset(s->buf_pre_corr, 0, s->bytes_overlap * 2 + UNROLL_PADDING);
                 int32_t *pw = s->table_window;
                 for (int i = 1; i < frames_overlap; i++) {
                     int32_t v = (i * (t - i) * n) >> 15;
@@ -396,6 +579,32 @@ static int control(struct af_instance *af, int cmd, void *arg)
             }
         }
 
+        free(s->fft_buf);
+        s->fft_buf = NULL;
+        if (s->best_overlap_offset) {
+            int len = (frames_overlap - 1) * nch;
+            int len_search_ch = s->frames_search - 1 + frames_overlap - 1;
+            s->fft_bits = 1;
+            while ((1 << s->fft_bits) < len_search_ch)
+                s->fft_bits++;
+            int n = 1 << s->fft_bits;
+            if ((int64_t)s->frames_search * len >
+                (int64_t)FFT_MIN_GAIN * (nch + 1) * n * s->fft_bits)
+            {
+                s->fft_buf = malloc(n * 2 * sizeof(double));
+                s->fft_acc = realloc(s->fft_acc, (n + 2) * sizeof(double));
+                s->fft_tw = realloc(s->fft_tw, n * sizeof(double));
+                if (!s->fft_buf || !s->fft_acc || !s->fft_tw) {
+                    MP_FATAL(af, "Out of memory\n");
+                    return AF_ERROR;
+                }
+                for (int i = 0; i < n / 2; i++) {
+                    s->fft_tw[2 * i + 0] = cos(2 * M_PI * i / n);
+                    s->fft_tw[2 * i + 1] = -sin(2 * M_PI * i / n);
+                }
+            }
+        }
+
         s->bytes_per_frame = bps * nch;
         s->num_channels    = nch;
 
@@ -412,14 +621,14 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         MP_DBG(af, ""
                "%.2f stride_in, %i stride_out, %i standing, "
-               "%i overlap, %i search, %i queue, %s mode\n",
+               "%i overlap, %i search, %i queue, %s mode%s\n",
                s->frames_stride_scaled,
                (int)(s->bytes_stride / nch / bps),
                (int)(s->bytes_standing / nch / bps),
                (int)(s->bytes_overlap / nch / bps),
                s->frames_search,
                (int)(s->bytes_queue / nch / bps),
-               (use_int ? "s16" : "float"));
+               (use_int ? "s16" : "float"), s->fft_buf ? ", fft" : "");
 
         return af_test_output(af, (struct mp_audio *)arg);
     }
@@ -453,6 +662,9 @@ static void uninit(struct af_instance *af)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    free(s->fft_buf);
+    free(s->fft_acc);
+    free(s->fft_tw);
 }
 
 // Allocate memory and set function pointers
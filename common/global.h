@@ -8,6 +8,7 @@ struct mpv_global {
     struct mp_log *log;
     struct m_config_shadow *config;
     struct mp_client_api *client_api;
+    struct mp_mem_budget *mem_budget;
 
     // Using this is deprecated and should be avoided (missing synchronization).
     // Use m_config_cache to access mpv_global.config instead.
@@ -0,0 +1,207 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "misc/node.h"
+#include "mpv_talloc.h"
+
+#include "mem_budget.h"
+
+// Never shrink a client below this (unless it wants less), so that a small
+// budget degrades playback instead of breaking it.
+#define MIN_CLIENT_LIMIT (1024 * 1024)
+
+// Subsystems which buffer a lot of data register a client with their own
+// configured maximum ("wanted"), and report how much memory they currently
+// use. If a global limit is set, the budget is distributed among the clients
+// (see rebalance()), and each client is expected to respect its share.
+// Protects all budgets and the client fields. A single lock is used, because
+// a client's budget pointer must be read under it too (the budget can be
+// destroyed before the client).
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct mp_mem_budget {
+    int64_t limit;  // 0 means no limit
+    struct mp_mem_client **clients;
+    int num_clients;
+};
+
+struct mp_mem_client {
+    char *name;
+    // All fields below are protected by budget_lock.
+    struct mp_mem_budget *budget; // NULL if the player has no budget
+    int64_t wanted;
+    int64_t limit;
+    int64_t used;
+};
+
+static void destroy_budget(void *p)
+{
+    struct mp_mem_budget *b = p;
+    // Clients outliving the budget keep their last limit.
+    pthread_mutex_lock(&budget_lock);
+    for (int n = 0; n < b->num_clients; n++)
+        b->clients[n]->budget = NULL;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+struct mp_mem_budget *mp_mem_budget_create(void *ta_parent)
+{
+    struct mp_mem_budget *b = talloc_zero(ta_parent, struct mp_mem_budget);
+    talloc_set_destructor(b, destroy_budget);
+    return b;
+}
+
+// Water-filling: clients wanting less than an equal share of the remaining
+// budget get all they want; the rest is split evenly among the others. This
+// means a large consumer (like a big stream cache) is shrunk first, before
+// smaller ones are touched. Called locked.
+static void rebalance(struct mp_mem_budget *b)
+{
+    int n = b->num_clients;
+    if (!b->limit) {
+        for (int i = 0; i < n; i++)
+            b->clients[i]->limit = b->clients[i]->wanted;
+        return;
+    }
+
+    struct mp_mem_client **sorted = talloc_memdup(NULL, b->clients,
+                                                  n * sizeof(sorted[0]));
+    // Insertion sort by wanted size; there are only a handful of clients.
+    for (int i = 1; i < n; i++) {
+        for (int j = i; j > 0 && sorted[j - 1]->wanted > sorted[j]->wanted; j--)
+            MPSWAP(struct mp_mem_client *, sorted[j - 1], sorted[j]);
+    }
+
+    int64_t left = b->limit;
+    for (int i = 0; i < n; i++) {
+        struct mp_mem_client *c = sorted[i];
+        int64_t share = MPMAX(left, 0) / (n - i);
+        c->limit = MPMIN(c->wanted, MPMAX(share, MIN_CLIENT_LIMIT));
+        left -= c->limit;
+    }
+
+    talloc_free(sorted);
+}
+
+void mp_mem_budget_set_limit(struct mp_mem_budget *b, int64_t limit)
+{
+    pthread_mutex_lock(&budget_lock);
+    b->limit = MPMAX(limit, 0);
+    rebalance(b);
+    pthread_mutex_unlock(&budget_lock);
+}
+
+// Write the current memory breakdown to dst (a MPV_FORMAT_NODE_MAP).
+void mp_mem_budget_get_info(struct mp_mem_budget *b, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+
+    pthread_mutex_lock(&budget_lock);
+    int64_t used = 0;
+    struct mpv_node *list = node_map_add(dst, "clients", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < b->num_clients; n++) {
+        struct mp_mem_client *c = b->clients[n];
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", c->name);
+        node_map_add_int64(e, "used", c->used);
+        node_map_add_int64(e, "limit", c->limit);
+        node_map_add_int64(e, "wanted", c->wanted);
+        used += c->used;
+    }
+    node_map_add_int64(dst, "limit", b->limit);
+    node_map_add_int64(dst, "used", used);
+    pthread_mutex_unlock(&budget_lock);
+}
+
+static void destroy_client(void *p)
+{
+    struct mp_mem_client *c = p;
+
+    pthread_mutex_lock(&budget_lock);
+    struct mp_mem_budget *b = c->budget;
+    if (b) {
+        for (int n = 0; n < b->num_clients; n++) {
+            if (b->clients[n] == c) {
+                MP_TARRAY_REMOVE_AT(b->clients, b->num_clients, n);
+                break;
+            }
+        }
+        rebalance(b);
+    }
+    pthread_mutex_unlock(&budget_lock);
+}
+
+// Register a memory consumer. wanted is the amount of memory it would use
+// without a global budget (usually its own configured maximum). The client
+// is unregistered when it's freed. This never returns NULL; if the global
+// has no budget, the limit is simply always equal to wanted.
+struct mp_mem_client *mp_mem_client_new(void *ta_parent,
+                                        struct mpv_global *global,
+                                        const char *name, int64_t wanted)
+{
+    struct mp_mem_client *c = talloc_zero(ta_parent, struct mp_mem_client);
+    c->name = talloc_strdup(c, name);
+    c->wanted = c->limit = wanted;
+    talloc_set_destructor(c, destroy_client);
+
+    struct mp_mem_budget *b = global ? global->mem_budget : NULL;
+    if (b) {
+        pthread_mutex_lock(&budget_lock);
+        c->budget = b;
+        MP_TARRAY_APPEND(b, b->clients, b->num_clients, c);
+        rebalance(b);
+        pthread_mutex_unlock(&budget_lock);
+    }
+    return c;
+}
+
+void mp_mem_client_set_wanted(struct mp_mem_client *c, int64_t wanted)
+{
+    pthread_mutex_lock(&budget_lock);
+    if (!c->budget) {
+        c->wanted = c->limit = wanted;
+    } else if (c->wanted != wanted) {
+        c->wanted = wanted;
+        rebalance(c->budget);
+    }
+    pthread_mutex_unlock(&budget_lock);
+}
+
+// Report the amount of memory currently in use by this client.
+void mp_mem_client_report(struct mp_mem_client *c, int64_t used)
+{
+    pthread_mutex_lock(&budget_lock);
+    c->used = used;
+    pthread_mutex_unlock(&budget_lock);
+}
+
+// Return the maximum amount of memory the client should use. This can change
+// at any time (when other clients come and go, or the budget is changed), so
+// the caller should query it again each time it decides whether to buffer
+// more data.
+int64_t mp_mem_client_get_limit(struct mp_mem_client *c)
+{
+    pthread_mutex_lock(&budget_lock);
+    int64_t limit = c->limit;
+    pthread_mutex_unlock(&budget_lock);
+    return limit;
+}
@@ -0,0 +1,22 @@
+#ifndef MP_MEM_BUDGET_H
+#define MP_MEM_BUDGET_H
+
+#include <stdint.h>
+
+struct mpv_global;
+struct mpv_node;
+struct mp_mem_budget;
+struct mp_mem_client;
+
+struct mp_mem_budget *mp_mem_budget_create(void *ta_parent);
+void mp_mem_budget_set_limit(struct mp_mem_budget *b, int64_t limit);
+void mp_mem_budget_get_info(struct mp_mem_budget *b, struct mpv_node *dst);
+
+struct mp_mem_client *mp_mem_client_new(void *ta_parent,
+                                        struct mpv_global *global,
+                                        const char *name, int64_t wanted);
+void mp_mem_client_set_wanted(struct mp_mem_client *c, int64_t wanted);
+void mp_mem_client_report(struct mp_mem_client *c, int64_t used);
+int64_t mp_mem_client_get_limit(struct mp_mem_client *c);
+
+#endif
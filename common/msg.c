@@ -36,6 +36,7 @@
 #include "options/path.h"
 #include "osdep/terminal.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "libmpv/client.h"
@@ -43,6 +44,14 @@
 #include "msg.h"
 #include "msg_control.h"
 
+// Size of the on-stack buffer messages are formatted into. Longer messages
+// fall back to a heap allocation.
+#define MSG_FORMAT_SIZE 1024
+
+// Number of lines that can be queued for the log file thread. If the thread
+// can't keep up, further lines are dropped (and counted).
+#define LOG_FILE_QUEUE_SIZE 4096
+
 struct mp_log_root {
     struct mpv_global *global;
     // --- protected by mp_msg_lock
@@ -62,7 +71,25 @@ struct mp_log_root {
     FILE *stats_file;
     char *log_path;
     char *stats_path;
+    // Lines queued for log_file_thread (a NULL ring means the log file is
+    // written synchronously). Set/unset with msg lock held.
+    struct mp_ring *log_file_ring;
+    pthread_t log_file_thread;
+    // --- protected by log_file_lock
+    pthread_mutex_t log_file_lock;
+    pthread_cond_t log_file_wakeup;
+    pthread_cond_t log_file_done;
+    bool log_file_quit;
+    // Error messages which didn't fit into the ring. While there are any,
+    // other messages are dropped, so that the order is kept.
+    char **log_file_overflow;
+    int num_log_file_overflow;
+    uint64_t log_file_queued;    // number of lines ever queued
+    uint64_t log_file_flush_req; // flush once this many lines were written
+    uint64_t log_file_flushed;   // number of lines written and flushed
     // --- must be accessed atomically
+    atomic_ulong log_file_dropped;
+    atomic_bool log_file_async;  // log_file_ring is set (hint only)
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
      * synchronized mp_log tree.) */
@@ -278,18 +305,184 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
-static void write_log_file(struct mp_log *log, int lev, char *text)
+static void *log_file_thread(void *p)
+{
+    struct mp_log_root *root = p;
+
+    mpthread_set_name("log-file");
+
+    pthread_mutex_lock(&root->log_file_lock);
+    uint64_t written = root->log_file_flushed;
+    while (1) {
+        char *line = NULL;
+        int r = mp_ring_read(root->log_file_ring, (unsigned char *)&line,
+                             sizeof(line));
+        if (r != sizeof(line) && root->num_log_file_overflow) {
+            line = root->log_file_overflow[0];
+            MP_TARRAY_REMOVE_AT(root->log_file_overflow,
+                                root->num_log_file_overflow, 0);
+            r = sizeof(line);
+        }
+        if (r == sizeof(line)) {
+            pthread_mutex_unlock(&root->log_file_lock);
+            fputs(line, root->log_file);
+            talloc_free(line);
+            unsigned long dropped = atomic_exchange(&root->log_file_dropped, 0);
+            if (dropped) {
+                fprintf(root->log_file, "[%8.3f][w][log] %lu messages dropped\n",
+                        (mp_time_us() - MP_START_TIME) / 1e6, dropped);
+            }
+            written++;
+            pthread_mutex_lock(&root->log_file_lock);
+            // Flush only once the queue is drained, unless an error message
+            // was written, which should survive a crash.
+            if (written < root->log_file_flush_req ||
+                root->log_file_flushed >= root->log_file_flush_req)
+                continue;
+        }
+        fflush(root->log_file);
+        root->log_file_flushed = written;
+        pthread_cond_broadcast(&root->log_file_done);
+        if (r == sizeof(line))
+            continue;
+        if (root->log_file_quit)
+            break;
+        pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    return NULL;
+}
+
+// Must be called with mp_msg_lock held.
+static void start_log_file_thread(struct mp_log_root *root)
+{
+#if HAVE_ATOMICS
+    if (!root->log_file || root->log_file_ring)
+        return;
+
+    root->log_file_ring = mp_ring_new(root, sizeof(void *) * LOG_FILE_QUEUE_SIZE);
+    root->log_file_quit = false;
+    if (!root->log_file_ring ||
+        pthread_create(&root->log_file_thread, NULL, log_file_thread, root))
+    {
+        talloc_free(root->log_file_ring);
+        root->log_file_ring = NULL; // fall back to synchronous writes
+    }
+    atomic_store(&root->log_file_async, !!root->log_file_ring);
+#endif
+}
+
+// Write out all queued lines and stop the thread.
+// Must be called with mp_msg_lock held.
+static void terminate_log_file_thread(struct mp_log_root *root)
+{
+    if (!root->log_file_ring)
+        return;
+
+    pthread_mutex_lock(&root->log_file_lock);
+    root->log_file_quit = true;
+    pthread_cond_signal(&root->log_file_wakeup);
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    pthread_join(root->log_file_thread, NULL);
+
+    talloc_free(root->log_file_ring);
+    root->log_file_ring = NULL;
+    atomic_store(&root->log_file_async, false);
+    assert(!root->num_log_file_overflow);
+    TA_FREEP(&root->log_file_overflow);
+}
+
+// Wait until the log file thread has written and flushed the first num lines.
+// Must be called without mp_msg_lock held, so that other threads can log
+// while the disk is slow.
+static void wait_log_file_flushed(struct mp_log_root *root, uint64_t num)
+{
+    pthread_mutex_lock(&root->log_file_lock);
+    root->log_file_flush_req = MPMAX(root->log_file_flush_req, num);
+    pthread_cond_signal(&root->log_file_wakeup);
+    while (root->log_file_flushed < num)
+        pthread_cond_wait(&root->log_file_done, &root->log_file_lock);
+    pthread_mutex_unlock(&root->log_file_lock);
+}
+
+// Format the complete lines in text as they're written to the log file.
+// Returns NULL if there are none. Doesn't need any locks.
+static char *format_log_file_lines(struct mp_log *log, int lev,
+                                   const char *text)
+{
+    double time = (mp_time_us() - MP_START_TIME) / 1e6;
+    char *res = NULL;
+    while (1) {
+        const char *end = strchr(text, '\n');
+        if (!end)
+            break;
+        res = talloc_asprintf_append_buffer(res, "[%8.3f][%c][%s] %.*s", time,
+                                            mp_log_levels[lev][0],
+                                            log->verbose_prefix,
+                                            (int)(end + 1 - text), text);
+        text = end + 1;
+    }
+    return res;
+}
+
+// Pass the formatted line(s) to the log file thread, which takes ownership.
+// Errors are written and flushed before the logging call returns, so that
+// they are in the file even if the process crashes right after; for them,
+// return the number of lines the caller has to wait for with
+// wait_log_file_flushed() (after releasing mp_msg_lock), otherwise 0.
+// Must be called with mp_msg_lock held, and root->log_file_ring set.
+static uint64_t queue_log_file_line(struct mp_log_root *root, int lev,
+                                    char *line)
+{
+    bool sync = lev <= MSGL_ERR;
+    uint64_t wait = 0;
+
+    pthread_mutex_lock(&root->log_file_lock);
+    if (!root->num_log_file_overflow &&
+        mp_ring_available(root->log_file_ring) >= sizeof(line))
+    {
+        mp_ring_write(root->log_file_ring, (unsigned char *)&line, sizeof(line));
+    } else if (sync) {
+        // Never drop errors, and never wait for the disk here.
+        MP_TARRAY_APPEND(NULL, root->log_file_overflow,
+                         root->num_log_file_overflow, line);
+    } else {
+        atomic_fetch_add(&root->log_file_dropped, 1);
+        talloc_free(line);
+        line = NULL;
+    }
+    if (line) {
+        root->log_file_queued++;
+        if (sync)
+            wait = root->log_file_queued;
+        pthread_cond_signal(&root->log_file_wakeup);
+    }
+    pthread_mutex_unlock(&root->log_file_lock);
+
+    return wait;
+}
+
+// Returns the number of lines to wait for, see queue_log_file_line().
+static uint64_t write_log_file(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
 
     if (lev > MSGL_V || !root->log_file)
-        return;
+        return 0;
+
+    if (!root->log_file_ring) {
+        fprintf(root->log_file, "[%8.3f][%c][%s] %s",
+                (mp_time_us() - MP_START_TIME) / 1e6,
+                mp_log_levels[lev][0],
+                log->verbose_prefix, text);
+        fflush(root->log_file);
+        return 0;
+    }
 
-    fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-            (mp_time_us() - MP_START_TIME) / 1e6,
-            mp_log_levels[lev][0],
-            log->verbose_prefix, text);
-    fflush(root->log_file);
+    char *line = format_log_file_lines(log, lev, text);
+    return line ? queue_log_file_line(root, lev, line) : 0;
 }
 
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
@@ -339,19 +532,45 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
     if (!mp_msg_test(log, lev))
         return; // do not display
 
-    pthread_mutex_lock(&mp_msg_lock);
+    // Format the message before taking the lock, so that threads which log a
+    // lot don't serialize on formatting.
+    char stack_buf[MSG_FORMAT_SIZE];
+    char *msg = stack_buf;
+    char *msg_alloc = NULL;
+    va_list va2;
+    va_copy(va2, va);
+    int len = vsnprintf(stack_buf, sizeof(stack_buf), format, va2);
+    va_end(va2);
+    if (len < 0) {
+        stack_buf[0] = '\0';
+    } else if (len >= sizeof(stack_buf)) {
+        msg_alloc = talloc_vasprintf(NULL, format, va);
+        if (msg_alloc)
+            msg = msg_alloc;
+    }
 
     struct mp_log_root *root = log->root;
 
-    root->buffer.len = 0;
+    // Likewise for the log file lines, if they are written by the log file
+    // thread. Only complete lines not continuing a partial line are handled
+    // this way; the rest is formatted by write_log_file().
+    char *file_lines = NULL;
+    if (lev <= MSGL_V && atomic_load(&root->log_file_async))
+        file_lines = format_log_file_lines(log, lev, msg);
+    uint64_t file_wait = 0;
 
-    if (log->partial[0])
-        bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
-    log->partial[0] = '\0';
+    pthread_mutex_lock(&mp_msg_lock);
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    bool preformatted = file_lines && root->log_file_ring && root->log_file &&
+                        !log->partial[0];
 
-    char *text = root->buffer.start;
+    char *text = msg;
+    if (log->partial[0]) {
+        root->buffer.len = 0;
+        bstr_xappend_asprintf(root, &root->buffer, "%s%s", log->partial, msg);
+        log->partial[0] = '\0';
+        text = root->buffer.start;
+    }
 
     if (lev == MSGL_STATS) {
         dump_stats(log, lev, text);
@@ -371,7 +590,8 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
             char saved = next[0];
             next[0] = '\0';
             print_terminal_line(log, lev, text, "");
-            write_log_file(log, lev, text);
+            if (!preformatted)
+                file_wait = MPMAX(file_wait, write_log_file(log, lev, text));
             write_msg_to_buffers(log, lev, text);
             next[0] = saved;
             text = next;
@@ -386,9 +606,21 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
                 log->partial = talloc_realloc(NULL, log->partial, char, size);
             memcpy(log->partial, text, size);
         }
+
+        if (preformatted) {
+            file_wait = MPMAX(file_wait, queue_log_file_line(root, lev,
+                                                             file_lines));
+            file_lines = NULL;
+        }
     }
 
     pthread_mutex_unlock(&mp_msg_lock);
+
+    if (file_wait)
+        wait_log_file_flushed(root, file_wait);
+
+    talloc_free(file_lines);
+    talloc_free(msg_alloc);
 }
 
 static void destroy_log(void *ptr)
@@ -451,7 +683,11 @@ void mp_msg_init(struct mpv_global *global)
     *root = (struct mp_log_root){
         .global = global,
         .reload_counter = ATOMIC_VAR_INIT(1),
+        .log_file_dropped = ATOMIC_VAR_INIT(0),
     };
+    pthread_mutex_init(&root->log_file_lock, NULL);
+    pthread_cond_init(&root->log_file_wakeup, NULL);
+    pthread_cond_init(&root->log_file_done, NULL);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -477,8 +713,14 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
 
     pthread_mutex_lock(&mp_msg_lock); // for *current_path/*file
 
+    struct mp_log_root *root = global->log->root;
+    bool is_log_file = file == &root->log_file;
+
     char *old_path = *current_path ? *current_path : "";
     if (strcmp(old_path, new_path) != 0) {
+        // The log file thread must not access the FILE while it's reopened.
+        if (is_log_file)
+            terminate_log_file_thread(root);
         if (*file)
             fclose(*file);
         *file = NULL;
@@ -488,6 +730,8 @@ static void reopen_file(char *opt, char **current_path, FILE **file,
             *file = fopen(new_path, "wb");
             fail = !*file;
         }
+        if (is_log_file)
+            start_log_file_thread(root);
     }
 
     pthread_mutex_unlock(&mp_msg_lock);
@@ -541,6 +785,9 @@ void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
+    pthread_mutex_lock(&mp_msg_lock);
+    terminate_log_file_thread(root);
+    pthread_mutex_unlock(&mp_msg_lock);
     if (root->stats_file)
         fclose(root->stats_file);
     talloc_free(root->stats_path);
@@ -548,6 +795,9 @@ void mp_msg_uninit(struct mpv_global *global)
         fclose(root->log_file);
     talloc_free(root->log_path);
     m_option_type_msglevels.free(&root->msg_levels);
+    pthread_cond_destroy(&root->log_file_wakeup);
+    pthread_cond_destroy(&root->log_file_done);
+    pthread_mutex_destroy(&root->log_file_lock);
     talloc_free(root);
     global->log = NULL;
 }
@@ -34,7 +34,9 @@
 #include "mpv_talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "common/mem_budget.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -151,6 +153,11 @@ struct demux_internal {
     double min_secs;
     int max_packs;
     int max_bytes;
+    struct mp_mem_client *mem;  // readahead share of the memory budget
+
+    // Statistics (for DEMUXER_CTRL_GET_READER_STATE).
+    int64_t fill_time;          // total time spent in desc->fill_buffer (us)
+    size_t peak_packs, peak_bytes;
 
     // Set if we know that we are at the start of the file. This is used to
     // avoid a redundant initial seek after enabling streams. We could just
@@ -175,6 +182,7 @@ struct demux_internal {
     double time_length;
     struct mp_tags *stream_metadata;
     struct stream_cache_info stream_cache_info;
+    struct stream_read_stats stream_read_stats;
     int64_t stream_size;
     // Updated during init only.
     char *stream_base_filename;
@@ -596,7 +604,7 @@ static bool read_packet(struct demux_internal *in)
     // Check if we need to read a new packet. We do this if all queues are below
     // the minimum, or if a stream explicitly needs new packets. Also includes
     // safe-guards against packet queue overflow.
-    bool active = false, read_more = false;
+    bool active = false, read_more = false, prefetch = false;
     size_t packs = 0, bytes = 0;
     for (int n = 0; n < in->num_streams; n++) {
         struct demux_stream *ds = in->streams[n]->ds;
@@ -606,10 +614,13 @@ static bool read_packet(struct demux_internal *in)
         bytes += ds->bytes;
         if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
             ds->last_ts >= ds->base_ts)
-            read_more |= ds->last_ts - ds->base_ts < in->min_secs;
+            prefetch |= ds->last_ts - ds->base_ts < in->min_secs;
     }
     MP_DBG(in, "packets=%zd, bytes=%zd, active=%d, more=%d\n",
            packs, bytes, active, read_more);
+    in->peak_packs = MPMAX(in->peak_packs, packs);
+    in->peak_bytes = MPMAX(in->peak_bytes, bytes);
+    mp_mem_client_report(in->mem, bytes);
     if (packs >= in->max_packs || bytes >= in->max_bytes) {
         if (!in->warned_queue_overflow) {
             in->warned_queue_overflow = true;
@@ -635,6 +646,12 @@ static bool read_packet(struct demux_internal *in)
         return false;
     }
 
+    // The memory budget share only limits readahead. Streams without any
+    // queued packets are still served up to --demuxer-max-bytes, so that
+    // badly interleaved files don't run into a false EOF.
+    if (prefetch && bytes < (size_t)mp_mem_client_get_limit(in->mem))
+        read_more = true;
+
     double seek_pts = get_refresh_seek_pts(in);
     bool refresh_seek = seek_pts != MP_NOPTS_VALUE;
     read_more |= refresh_seek;
@@ -655,11 +672,15 @@ static bool read_packet(struct demux_internal *in)
         demux->desc->seek(demux, seek_pts, SEEK_BACKWARD | SEEK_HR);
     }
 
+    int64_t fill_start = mp_time_us();
     bool eof = !demux->desc->fill_buffer || demux->desc->fill_buffer(demux) <= 0;
+    int64_t fill_time = mp_time_us() - fill_start;
     update_cache(in);
 
     pthread_mutex_lock(&in->lock);
 
+    in->fill_time += fill_time;
+
     if (!in->seeking) {
         if (eof) {
             for (int n = 0; n < in->num_streams; n++)
@@ -1246,6 +1267,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .max_bytes = opts->max_bytes,
         .initial_state = true,
     };
+    in->mem = mp_mem_client_new(in, global, "demux", opts->max_bytes);
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
 
@@ -1382,14 +1404,17 @@ struct demuxer *demux_open_url(const char *url,
                                      cancel, global);
     if (!s)
         return NULL;
+    params->stream_open_time = mp_time_us();
     if (params->allow_capture) {
         char *f;
         mp_read_option_raw(global, "stream-capture", &m_option_type_string, &f);
         stream_set_capture_file(s, f);
         talloc_free(f);
     }
-    if (!params->disable_cache)
+    if (!params->disable_cache) {
         stream_enable_cache_defaults(&s);
+        params->cache_init_time = mp_time_us();
+    }
     struct demuxer *d = demux_open(s, params, global);
     if (d) {
         demux_maybe_replace_stream(d);
@@ -1577,6 +1602,7 @@ static void update_cache(struct demux_internal *in)
     double time_length = -1;
     struct mp_tags *stream_metadata = NULL;
     struct stream_cache_info stream_cache_info = {.size = -1};
+    struct stream_read_stats stream_read_stats = {0};
 
     if (demuxer->desc->control) {
         demuxer->desc->control(demuxer, DEMUXER_CTRL_GET_TIME_LENGTH,
@@ -1586,11 +1612,13 @@ static void update_cache(struct demux_internal *in)
     int64_t stream_size = stream_get_size(stream);
     stream_control(stream, STREAM_CTRL_GET_METADATA, &stream_metadata);
     stream_control(stream, STREAM_CTRL_GET_CACHE_INFO, &stream_cache_info);
+    stream_control(stream, STREAM_CTRL_GET_READ_STATS, &stream_read_stats);
 
     pthread_mutex_lock(&in->lock);
     in->time_length = time_length;
     in->stream_size = stream_size;
     in->stream_cache_info = stream_cache_info;
+    in->stream_read_stats = stream_read_stats;
     if (stream_metadata) {
         talloc_free(in->stream_metadata);
         in->stream_metadata = talloc_steal(in, stream_metadata);
@@ -1614,6 +1642,9 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
             return STREAM_UNSUPPORTED;
         *(struct stream_cache_info *)arg = in->stream_cache_info;
         return STREAM_OK;
+    case STREAM_CTRL_GET_READ_STATS:
+        *(struct stream_read_stats *)arg = in->stream_read_stats;
+        return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (in->stream_size < 0)
             return STREAM_UNSUPPORTED;
@@ -1662,6 +1693,9 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
             .eof = in->last_eof,
             .ts_range = {MP_NOPTS_VALUE, MP_NOPTS_VALUE},
             .ts_duration = -1,
+            .fill_time = in->fill_time,
+            .peak_packs = in->peak_packs,
+            .peak_bytes = in->peak_bytes,
         };
         int num_packets = 0;
         for (int n = 0; n < in->num_streams; n++) {
@@ -50,6 +50,8 @@ struct demux_ctrl_reader_state {
     bool eof, underrun, idle;
     double ts_range[2]; // start, end
     double ts_duration;
+    int64_t fill_time;      // total time spent reading packets (us)
+    size_t peak_packs, peak_bytes; // highest packet queue fill seen
 };
 
 struct demux_ctrl_stream_ctrl {
@@ -168,6 +170,8 @@ struct demuxer_params {
     bool disable_cache;
     // result
     bool demuxer_failed;
+    int64_t stream_open_time;   // mp_time_us() after the stream was opened
+    int64_t cache_init_time;    // same, after the cache was enabled (or 0)
 };
 
 typedef struct demuxer {
@@ -17,8 +17,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <strings.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -30,6 +32,7 @@
 #include "options/m_config.h"
 #include "options/path.h"
 #include "misc/ctype.h"
+#include "misc/thread_pool.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -38,16 +41,38 @@
 
 #define MF_MAX_FILE_SIZE (1024 * 1024 * 256)
 
+// Maximum number of files read ahead.
+#define MF_MAX_PREFETCH 64
+
 typedef struct mf {
     struct mp_log *log;
+    struct mpv_global *global;
     struct sh_stream *sh;
     int curr_frame;
     int nr_of_files;
     char **names;
     // optional
     struct stream **streams;
+
+    // Prefetching (NULL pool if disabled)
+    struct mp_thread_pool *pool;
+    int prefetch;               // number of files to keep in flight
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct mf_job **jobs;       // in frame order
+    int num_jobs;
 } mf_t;
 
+// A file being read on the thread pool.
+struct mf_job {
+    struct mf *mf;
+    int frame;
+    // Protected by mf->lock.
+    bool done;
+    bool discard;               // not needed anymore; freed by the worker
+    struct demux_packet *pkt;   // result (NULL on errors)
+};
+
 
 static void mf_add(mf_t *mf, const char *fname)
 {
@@ -173,6 +198,127 @@ static void demux_seek_mf(demuxer_t *demuxer, double seek_pts, int flags)
     mf->curr_frame = newpos;
 }
 
+// Read the whole file into a new packet. If the file size is known, this
+// reads directly into the packet buffer.
+static struct demux_packet *read_file(struct stream *stream)
+{
+    stream_seek(stream, 0);
+
+    int64_t size = stream_get_size(stream);
+    if (size > 0 && size <= MF_MAX_FILE_SIZE) {
+        struct demux_packet *dp = new_demux_packet(size);
+        if (!dp)
+            return NULL;
+        int len = stream_read(stream, (char *)dp->buffer, size);
+        if (len > 0) {
+            demux_packet_shorten(dp, len);
+            return dp;
+        }
+        free_demux_packet(dp);
+        return NULL;
+    }
+
+    struct demux_packet *dp = NULL;
+    bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
+    if (data.len)
+        dp = new_demux_packet_from(data.start, data.len);
+    talloc_free(data.start);
+    return dp;
+}
+
+static struct demux_packet *read_frame(struct mf *mf, int frame)
+{
+    struct demux_packet *dp = NULL;
+    char *filename = mf->names[frame];
+    struct stream *stream = filename ? stream_open(filename, mf->global) : NULL;
+    if (stream) {
+        dp = read_file(stream);
+        free_stream(stream);
+    }
+    return dp;
+}
+
+static void read_job(void *ctx)
+{
+    struct mf_job *job = ctx;
+    struct mf *mf = job->mf;
+
+    pthread_mutex_lock(&mf->lock);
+    bool discard = job->discard;
+    pthread_mutex_unlock(&mf->lock);
+
+    struct demux_packet *dp = discard ? NULL : read_frame(mf, job->frame);
+
+    pthread_mutex_lock(&mf->lock);
+    if (job->discard) {
+        talloc_free(dp);
+        talloc_free(job);
+    } else {
+        job->pkt = dp;
+        job->done = true;
+        pthread_cond_broadcast(&mf->wakeup);
+    }
+    pthread_mutex_unlock(&mf->lock);
+}
+
+// Remove the first job. Its packet (if any) is returned if it's finished.
+static struct demux_packet *remove_job(struct mf *mf)
+{
+    struct mf_job *job = mf->jobs[0];
+    struct demux_packet *dp = NULL;
+    pthread_mutex_lock(&mf->lock);
+    if (job->done) {
+        dp = job->pkt;
+        talloc_free(job);
+    } else {
+        job->discard = true;
+    }
+    pthread_mutex_unlock(&mf->lock);
+    MP_TARRAY_REMOVE_AT(mf->jobs, mf->num_jobs, 0);
+    return dp;
+}
+
+static void discard_jobs(struct mf *mf)
+{
+    while (mf->num_jobs)
+        talloc_free(remove_job(mf));
+}
+
+// Keep the files following the current one in flight on the thread pool.
+static void queue_jobs(struct mf *mf)
+{
+    int frame = mf->curr_frame;
+    if (mf->num_jobs)
+        frame = mf->jobs[mf->num_jobs - 1]->frame + 1;
+    while (mf->num_jobs < mf->prefetch && frame < mf->nr_of_files) {
+        struct mf_job *job = talloc_ptrtype(NULL, job);
+        *job = (struct mf_job){ .mf = mf, .frame = frame++ };
+        MP_TARRAY_APPEND(mf, mf->jobs, mf->num_jobs, job);
+        mp_thread_pool_queue(mf->pool, read_job, job);
+    }
+}
+
+static struct demux_packet *read_prefetched_frame(struct mf *mf)
+{
+    // After seeking, reuse what was already read for the new position.
+    while (mf->num_jobs && mf->jobs[0]->frame < mf->curr_frame)
+        talloc_free(remove_job(mf));
+    if (mf->num_jobs && mf->jobs[0]->frame != mf->curr_frame)
+        discard_jobs(mf);
+
+    queue_jobs(mf);
+
+    struct mf_job *job = mf->jobs[0];
+    pthread_mutex_lock(&mf->lock);
+    while (!job->done)
+        pthread_cond_wait(&mf->wakeup, &mf->lock);
+    pthread_mutex_unlock(&mf->lock);
+
+    struct demux_packet *dp = remove_job(mf);
+    queue_jobs(mf);
+    return dp;
+}
+
 // return value:
 //     0 = EOF or no stream found
 //     1 = successfully read a packet
@@ -182,38 +328,52 @@ static int demux_mf_fill_buffer(demuxer_t *demuxer)
     if (mf->curr_frame >= mf->nr_of_files)
         return 0;
 
-    struct stream *entry_stream = NULL;
-    if (mf->streams)
-        entry_stream = mf->streams[mf->curr_frame];
-    struct stream *stream = entry_stream;
-    if (!stream) {
-        char *filename = mf->names[mf->curr_frame];
-        if (filename)
-            stream = stream_open(filename, demuxer->global);
+    struct demux_packet *dp = NULL;
+    if (mf->streams) {
+        struct stream *stream = mf->streams[mf->curr_frame];
+        if (stream)
+            dp = read_file(stream);
+    } else if (mf->pool) {
+        dp = read_prefetched_frame(mf);
+    } else {
+        dp = read_frame(mf, mf->curr_frame);
     }
 
-    if (stream) {
-        stream_seek(stream, 0);
-        bstr data = stream_read_complete(stream, NULL, MF_MAX_FILE_SIZE);
-        if (data.len) {
-            demux_packet_t *dp = new_demux_packet(data.len);
-            if (dp) {
-                memcpy(dp->buffer, data.start, data.len);
-                dp->pts = mf->curr_frame / mf->sh->codec->fps;
-                dp->keyframe = true;
-                demux_add_packet(mf->sh, dp);
-            }
-        }
-        talloc_free(data.start);
+    if (dp) {
+        dp->pts = mf->curr_frame / mf->sh->codec->fps;
+        dp->keyframe = true;
+        demux_add_packet(mf->sh, dp);
     }
 
-    if (stream && stream != entry_stream)
-        free_stream(stream);
-
     mf->curr_frame++;
     return 1;
 }
 
+static void init_prefetch(struct mf *mf)
+{
+    int threads;
+    double readahead;
+    mp_read_option_raw(mf->global, "mf-prefetch-threads", &m_option_type_int,
+                       &threads);
+    mp_read_option_raw(mf->global, "demuxer-readahead-secs",
+                       &m_option_type_double, &readahead);
+    if (threads < 1 || mf->streams || mf->nr_of_files < 2)
+        return;
+
+    // Cover the time the demuxer reads ahead, but use all threads.
+    double frames = ceil(readahead * mf->sh->codec->fps);
+    mf->prefetch = MPCLAMP(frames, threads, MF_MAX_PREFETCH);
+    mf->pool = mp_thread_pool_create(mf, MPMIN(threads, mf->prefetch));
+    if (!mf->pool) {
+        MP_WARN(mf, "could not create prefetch threads\n");
+        return;
+    }
+    pthread_mutex_init(&mf->lock, NULL);
+    pthread_cond_init(&mf->wakeup, NULL);
+    MP_VERBOSE(mf, "prefetching %d files with %d threads\n", mf->prefetch,
+               mp_thread_pool_get_num_threads(mf->pool));
+}
+
 // map file extension/type to a codec name
 
 static const struct {
@@ -332,9 +492,12 @@ static int demux_open_mf(demuxer_t *demuxer, enum demux_check check)
     demux_add_sh_stream(demuxer, sh);
 
     mf->sh = sh;
+    mf->global = demuxer->global;
     demuxer->priv = (void *)mf;
     demuxer->seekable = true;
 
+    init_prefetch(mf);
+
     return 0;
 
 error:
@@ -343,6 +506,16 @@ error:
 
 static void demux_close_mf(demuxer_t *demuxer)
 {
+    mf_t *mf = demuxer->priv;
+    if (!mf || !mf->pool)
+        return;
+
+    discard_jobs(mf);
+    // Waits until the workers have freed the discarded jobs.
+    talloc_free(mf->pool);
+    mf->pool = NULL;
+    pthread_cond_destroy(&mf->wakeup);
+    pthread_mutex_destroy(&mf->lock);
 }
 
 static int demux_control_mf(demuxer_t *demuxer, int cmd, void *arg)
@@ -178,6 +178,8 @@ typedef struct mkv_demuxer {
 
     uint64_t cluster_start;
     uint64_t cluster_end;
+    // Cluster contents read ahead from the stream; blocks point into it.
+    struct ebml_window cluster_win;
 
     mkv_index_t *indexes;
     size_t num_indexes;
@@ -248,6 +250,7 @@ const struct m_sub_options demux_mkv_conf = {
 static void probe_last_timestamp(struct demuxer *demuxer, int64_t start_pos);
 static void probe_first_timestamp(struct demuxer *demuxer);
 static void free_block(struct block_info *block);
+static bool mkv_stream_seek(demuxer_t *demuxer, int64_t pos);
 
 #define AAC_SYNC_EXTENSION_TYPE 0x02b7
 static int aac_get_sample_rate_index(uint32_t sample_rate)
@@ -1220,7 +1223,7 @@ static int read_deferred_element(struct demuxer *demuxer,
     elem->parsed = true;
     MP_VERBOSE(demuxer, "Seeking to %"PRIu64" to read header element 0x%x.\n",
                elem->pos, (unsigned)elem->id);
-    if (!stream_seek(s, elem->pos)) {
+    if (!mkv_stream_seek(demuxer, elem->pos)) {
         MP_WARN(demuxer, "Failed to seek when reading header element.\n");
         return 0;
     }
@@ -2397,26 +2400,148 @@ static void index_block(demuxer_t *demuxer, struct block_info *block)
     }
 }
 
-static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
+// Read ahead this much of a cluster at once, if the cluster size is known.
+// Kept small, so that parsing never waits for much more than the next block.
+#define CLUSTER_WINDOW_SIZE (64 * 1024)
+// Enough to contain any element ID + length + integer payload.
+#define MAX_ELEM_HEADER (4 + 8 + 8)
+
+// Position in the file the cluster parser is at. Data before this position
+// was parsed, data after it might be in the cluster window.
+static int64_t cluster_tell(demuxer_t *demuxer)
 {
-    mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
-    stream_t *s = demuxer->stream;
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    return stream_tell(demuxer->stream) - mkv_d->cluster_win.data.len;
+}
+
+// Seek the stream; discards any data read ahead into the cluster window.
+static bool mkv_stream_seek(demuxer_t *demuxer, int64_t pos)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    mkv_d->cluster_win.data = (bstr){0};
+    return stream_seek(demuxer->stream, pos);
+}
+
+// Make at least need bytes of cluster data available in the cluster window.
+// With known cluster size, read ahead in chunks. Otherwise (typically
+// live streams), read only what is needed, so that parsing never waits for
+// data which the element being parsed does not need.
+static bool fill_cluster_window(demuxer_t *demuxer, uint64_t need)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    uint64_t want = need;
+    if (mkv_d->cluster_end != EBML_UINT_INVALID) {
+        uint64_t pos = cluster_tell(demuxer);
+        uint64_t left = mkv_d->cluster_end > pos ? mkv_d->cluster_end - pos : 0;
+        need = MPMIN(need, left);
+        want = MPMIN(MPMAX(need, CLUSTER_WINDOW_SIZE), left);
+    }
+    return ebml_window_fill(&mkv_d->cluster_win, demuxer->stream, need, want);
+}
+
+// Read the length of the cluster child element whose ID was just read, make
+// all of its contents available in the cluster window, and consume them.
+// The returned data is valid until the next fill_cluster_window() call.
+static bool read_cluster_element(demuxer_t *demuxer, uint64_t max_len,
+                                 bstr *payload)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct ebml_window *w = &mkv_d->cluster_win;
+    uint64_t length = ebml_read_vlen_uint(&w->data);
+    if (length == EBML_UINT_INVALID || length > max_len ||
+        cluster_tell(demuxer) + length > mkv_d->cluster_end)
+        return false;
+    if (!fill_cluster_window(demuxer, length))
+        return false;
+    *payload = bstr_splice(w->data, 0, length);
+    w->data = bstr_cut(w->data, length);
+    return true;
+}
+
+// Skip the cluster child element whose ID was just read (see ebml_read_skip()).
+static bool skip_cluster_element(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    bstr *data = &mkv_d->cluster_win.data;
+    int64_t pos = cluster_tell(demuxer);
+    bstr start = *data;
+
+    uint64_t length = ebml_read_vlen_uint(data);
+    if (length == EBML_UINT_INVALID)
+        goto invalid;
+
+    int64_t pos2 = cluster_tell(demuxer);
+    if (length >= INT64_MAX - pos2 || pos2 + length > mkv_d->cluster_end)
+        goto invalid;
+
+    if (length <= data->len) {
+        *data = bstr_cut(*data, length);
+    } else {
+        length -= data->len;
+        *data = (bstr){0};
+        if (!stream_skip(demuxer->stream, length))
+            return false;
+    }
+    return true;
+
+invalid:
+    MP_ERR(demuxer, "Invalid EBML length at position %"PRId64"\n", pos);
+    *data = start;
+    return false;
+}
+
+// Look for the next cluster ID in the data left in the cluster window, so that
+// resyncing after a broken element doesn't need to seek back in the stream
+// (which fails with unseekable streams). If found, the window starts with the
+// ID on return. Otherwise, the window is empty, and the stream is positioned
+// after the scanned data.
+static bool resync_cluster_window(demuxer_t *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    bstr *data = &mkv_d->cluster_win.data;
+    // MATROSKA_ID_CLUSTER as stored in the file.
+    static const unsigned char id[4] = {0x1f, 0x43, 0xb6, 0x75};
+    bstr id_bstr = {(unsigned char *)id, 4};
+
+    MP_ERR(demuxer, "Corrupt file detected. Trying to resync starting from "
+           "position %"PRId64"...\n", cluster_tell(demuxer));
+    mkv_d->cluster_end = EBML_UINT_INVALID;
+    while (data->len) {
+        int found = bstr_find(*data, id_bstr);
+        if (found >= 0) {
+            *data = bstr_cut(*data, found);
+            MP_ERR(demuxer, "Cluster found at %"PRId64".\n",
+                   cluster_tell(demuxer));
+            return true;
+        }
+        // Keep the end of the data if it could be the start of a cluster ID
+        // which was cut off, and read the rest of it.
+        int keep = MPMIN(data->len, 3);
+        while (keep > 0 && !bstr_startswith(id_bstr,
+                                            bstr_cut(*data, data->len - keep)))
+            keep--;
+        *data = bstr_cut(*data, data->len - keep);
+        if (!keep || !fill_cluster_window(demuxer, 4))
+            break;
+    }
+    *data = (bstr){0};
+    return false;
+}
+
+// Parse a Block or SimpleBlock, whose contents are in data (a part of the
+// cluster window). The block data is not copied.
+static int read_block(demuxer_t *demuxer, bstr data, struct block_info *block)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
     uint64_t num;
     int16_t time;
-    uint64_t length;
     int res = -1;
 
     free_block(block);
-    length = ebml_read_length(s);
-    if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
-        goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
-    block->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
-        goto exit;
+    block->data = data;
+    block->filepos = stream_tell(demuxer->stream) -
+                     (mkv_d->cluster_win.data.start +
+                      mkv_d->cluster_win.data.len - data.start);
 
     // Parse header of the Block element
     /* first byte(s): track num */
@@ -2450,6 +2575,23 @@ exit:
     return res;
 }
 
+// Copy the block data out of the cluster window, so that it stays valid while
+// more cluster data is read.
+static bool detach_block(struct block_info *block)
+{
+    if (block->alloc)
+        return true;
+    block->alloc = malloc(block->data.len + AV_LZO_INPUT_PADDING);
+    if (!block->alloc) {
+        free_block(block);
+        return false;
+    }
+    memcpy(block->alloc, block->data.start, block->data.len);
+    memset((char *)block->alloc + block->data.len, 0, AV_LZO_INPUT_PADDING);
+    block->data.start = block->alloc;
+    return true;
+}
+
 static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
@@ -2556,17 +2698,18 @@ static int handle_block(demuxer_t *demuxer, struct block_info *block_info)
     return 0;
 }
 
-static int read_block_group(demuxer_t *demuxer, int64_t end,
+// Parse the BlockGroup contents in data (a part of the cluster window).
+static int read_block_group(demuxer_t *demuxer, bstr data,
                             struct block_info *block)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
-    stream_t *s = demuxer->stream;
     *block = (struct block_info){ .keyframe = true };
 
-    while (stream_tell(s) < end) {
-        switch (ebml_read_id(s)) {
+    while (data.len) {
+        bstr payload;
+        switch (ebml_read_id_buf(&data)) {
         case MATROSKA_ID_BLOCKDURATION:
-            block->duration = ebml_read_uint(s);
+            block->duration = ebml_read_uint_buf(&data);
             if (block->duration == EBML_UINT_INVALID)
                 goto error;
             block->duration *= mkv_d->tc_scale;
@@ -2574,18 +2717,20 @@ static int read_block_group(demuxer_t *demuxer, int64_t end,
             break;
 
         case MATROSKA_ID_DISCARDPADDING:
-            block->discardpadding = ebml_read_uint(s);
+            block->discardpadding = ebml_read_uint_buf(&data);
             if (block->discardpadding == EBML_UINT_INVALID)
                 goto error;
             break;
 
         case MATROSKA_ID_BLOCK:
-            if (read_block(demuxer, end, block) < 0)
+            if (!ebml_read_payload_buf(&data, &payload))
+                goto error;
+            if (read_block(demuxer, payload, block) < 0)
                 goto error;
             break;
 
         case MATROSKA_ID_REFERENCEBLOCK:;
-            int64_t num = ebml_read_int(s);
+            int64_t num = ebml_read_int_buf(&data);
             if (num == EBML_INT_INVALID)
                 goto error;
             if (num)
@@ -2597,8 +2742,10 @@ static int read_block_group(demuxer_t *demuxer, int64_t end,
             goto error;
 
         default:
-            if (ebml_read_skip(demuxer->log, end, s) != 0)
+            if (!ebml_read_payload_buf(&data, &payload)) {
+                MP_ERR(demuxer, "Invalid EBML length in BlockGroup\n");
                 goto error;
+            }
             break;
         }
     }
@@ -2614,6 +2761,7 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
 {
     mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
     stream_t *s = demuxer->stream;
+    bstr *data = &mkv_d->cluster_win.data;
 
     if (mkv_d->tmp_block.alloc) {
         *block = mkv_d->tmp_block;
@@ -2622,11 +2770,12 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
     }
 
     while (1) {
-        while (stream_tell(s) < mkv_d->cluster_end) {
-            int64_t start_filepos = stream_tell(s);
-            switch (ebml_read_id(s)) {
+        while (cluster_tell(demuxer) < mkv_d->cluster_end) {
+            int64_t start_filepos = cluster_tell(demuxer);
+            fill_cluster_window(demuxer, MAX_ELEM_HEADER);
+            switch (ebml_read_id_buf(data)) {
             case MATROSKA_ID_TIMECODE: {
-                uint64_t num = ebml_read_uint(s);
+                uint64_t num = ebml_read_uint_buf(data);
                 if (num == EBML_UINT_INVALID)
                     goto find_next_cluster;
                 mkv_d->cluster_tc = num * mkv_d->tc_scale;
@@ -2634,13 +2783,16 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
             }
 
             case MATROSKA_ID_BLOCKGROUP: {
-                int64_t end = ebml_read_length(s);
-                end += stream_tell(s);
-                if (end > mkv_d->cluster_end)
+                bstr group;
+                if (!read_cluster_element(demuxer, 500000000, &group))
                     goto find_next_cluster;
-                int res = read_block_group(demuxer, end, block);
-                if (res < 0)
+                int res = read_block_group(demuxer, group, block);
+                if (res < 0) {
+                    // Resync from within the broken group.
+                    data->len += data->start - group.start;
+                    data->start = group.start;
                     goto find_next_cluster;
+                }
                 if (res > 0)
                     return 1;
                 break;
@@ -2648,7 +2800,10 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
 
             case MATROSKA_ID_SIMPLEBLOCK: {
                 *block = (struct block_info){ .simple = true };
-                int res = read_block(demuxer, mkv_d->cluster_end, block);
+                bstr payload;
+                if (!read_cluster_element(demuxer, 500000000, &payload))
+                    goto find_next_cluster;
+                int res = read_block(demuxer, payload, block);
                 if (res < 0)
                     goto find_next_cluster;
                 if (res > 0)
@@ -2657,20 +2812,30 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
             }
 
             case MATROSKA_ID_CLUSTER:
+                // Start of the next cluster (if the current one has unknown
+                // size). Its length is outside of the current cluster.
                 mkv_d->cluster_start = start_filepos;
-                goto next_cluster;
+                mkv_d->cluster_end = EBML_UINT_INVALID;
+                fill_cluster_window(demuxer, 8);
+                mkv_d->cluster_end = ebml_read_length_buf(data);
+                if (mkv_d->cluster_end != EBML_UINT_INVALID)
+                    mkv_d->cluster_end += cluster_tell(demuxer);
+                break;
 
             case EBML_ID_INVALID:
                 goto find_next_cluster;
 
-            default: ;
-                if (ebml_read_skip(demuxer->log, mkv_d->cluster_end, s) != 0)
+            default:
+                if (!skip_cluster_element(demuxer))
                     goto find_next_cluster;
                 break;
             }
         }
 
     find_next_cluster:
+        // Resync from the position where parsing stopped.
+        if (data->len && resync_cluster_window(demuxer))
+            continue;
         mkv_d->cluster_end = 0;
         for (;;) {
             stream_peek(s, 4); // guarantee we can undo ebml_read_id() below
@@ -2696,7 +2861,6 @@ static int read_next_block(demuxer_t *demuxer, struct block_info *block)
                 ebml_resync_cluster(demuxer->log, s);
             }
         }
-    next_cluster:
         mkv_d->cluster_end = ebml_read_length(s);
         // mkv files for "streaming" can have this legally
         if (mkv_d->cluster_end != EBML_UINT_INVALID)
@@ -2742,7 +2906,6 @@ static mkv_index_t *get_highest_index_entry(struct demuxer *demuxer)
 static int create_index_until(struct demuxer *demuxer, int64_t timecode)
 {
     struct mkv_demuxer *mkv_d = demuxer->priv;
-    struct stream *s = demuxer->stream;
 
     read_deferred_cues(demuxer);
 
@@ -2752,7 +2915,8 @@ static int create_index_until(struct demuxer *demuxer, int64_t timecode)
     mkv_index_t *index = get_highest_index_entry(demuxer);
 
     if (!index || index->timecode * mkv_d->tc_scale < timecode) {
-        stream_seek(s, index ? index->filepos : mkv_d->cluster_start);
+        int64_t pos = index ? index->filepos : mkv_d->cluster_start;
+        mkv_stream_seek(demuxer, pos);
         MP_VERBOSE(demuxer, "creating index until TC %" PRId64 "\n", timecode);
         for (;;) {
             int res;
@@ -2846,7 +3010,7 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
         }
 
         mkv_d->cluster_end = 0;
-        stream_seek(demuxer->stream, seek_pos);
+        mkv_stream_seek(demuxer, seek_pos);
     }
     return index;
 }
@@ -2854,7 +3018,7 @@ static struct mkv_index *seek_with_cues(struct demuxer *demuxer, int seek_id,
 static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
 {
     mkv_demuxer_t *mkv_d = demuxer->priv;
-    int64_t old_pos = stream_tell(demuxer->stream);
+    int64_t old_pos = cluster_tell(demuxer);
     uint64_t v_tnum = -1;
     uint64_t a_tnum = -1;
     bool st_active[STREAM_TYPE_COUNT] = {0};
@@ -2897,7 +3061,7 @@ static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
         }
 
         if (!index)
-            stream_seek(demuxer->stream, old_pos);
+            mkv_stream_seek(demuxer, old_pos);
 
         if (flags & SEEK_FORWARD) {
             mkv_d->skip_to_timecode = target_timecode;
@@ -2929,10 +3093,10 @@ static void demux_mkv_seek(demuxer_t *demuxer, double seek_pts, int flags)
         mkv_d->cluster_end = 0;
 
         if (index) {
-            stream_seek(s, index->filepos);
+            mkv_stream_seek(demuxer, index->filepos);
             mkv_d->skip_to_timecode = index->timecode * mkv_d->tc_scale;
         } else {
-            stream_seek(s, MPMAX(target_filepos, 0));
+            mkv_stream_seek(demuxer, MPMAX(target_filepos, 0));
             if (ebml_resync_cluster(mp_null_log, s) < 0) {
                 // Assume EOF
                 mkv_d->cluster_end = size;
@@ -2980,14 +3144,14 @@ static void probe_last_timestamp(struct demuxer *demuxer, int64_t start_pos)
             if (!target)
                 return;
 
-            if (!stream_seek(demuxer->stream, target))
+            if (!mkv_stream_seek(demuxer, target))
                 return;
         } else {
             // No index -> just try to find a random cluster towards file end.
             int64_t size = stream_get_size(demuxer->stream);
-            stream_seek(demuxer->stream, MPMAX(size - 10 * 1024 * 1024, 0));
+            mkv_stream_seek(demuxer, MPMAX(size - 10 * 1024 * 1024, 0));
             if (ebml_resync_cluster(mp_null_log, demuxer->stream) < 0)
-                stream_seek(demuxer->stream, start_pos); // full scan otherwise
+                mkv_stream_seek(demuxer, start_pos); // full scan otherwise
         }
     }
 
@@ -3016,7 +3180,7 @@ static void probe_last_timestamp(struct demuxer *demuxer, int64_t start_pos)
     if (last_ts[STREAM_VIDEO])
         mkv_d->duration = last_ts[STREAM_VIDEO] / 1e9 - demuxer->start_time;
 
-    stream_seek(demuxer->stream, start_pos);
+    mkv_stream_seek(demuxer, start_pos);
     mkv_d->cluster_start = mkv_d->cluster_end = 0;
 }
 
@@ -3028,7 +3192,7 @@ static void probe_first_timestamp(struct demuxer *demuxer)
         return;
 
     struct block_info block;
-    if (read_next_block(demuxer, &block) > 0) {
+    if (read_next_block(demuxer, &block) > 0 && detach_block(&block)) {
         index_block(demuxer, &block);
         mkv_d->tmp_block = block;
     }
@@ -3063,6 +3227,7 @@ static void mkv_free(struct demuxer *demuxer)
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
+    talloc_free(mkv_d->cluster_win.buf);
 }
 
 const demuxer_desc_t demuxer_desc_matroska = {
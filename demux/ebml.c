@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include <libavutil/intfloat.h>
@@ -350,6 +351,106 @@ static double ebml_parse_float(uint8_t *data, int length)
         return av_int2double(i);
 }
 
+/*
+ * Read an element ID from memory, and advance buffer past it.
+ */
+uint32_t ebml_read_id_buf(bstr *buffer)
+{
+    int len;
+    uint32_t id = ebml_parse_id(buffer->start, buffer->len, &len);
+    if (len < 0 || len > buffer->len)
+        return EBML_ID_INVALID;
+    *buffer = bstr_cut(*buffer, len);
+    return id;
+}
+
+/*
+ * Read an element length from memory, and advance buffer past it. Like
+ * ebml_read_length(), this skips the length even if it is "unknown" (all
+ * value bits set) and EBML_UINT_INVALID is returned.
+ */
+uint64_t ebml_read_length_buf(bstr *buffer)
+{
+    int len;
+    uint64_t length = ebml_parse_length(buffer->start, buffer->len, &len);
+    if (len < 0) {
+        // Distinguish unknown lengths from truncated or invalid ones.
+        if (!buffer->len || !buffer->start[0])
+            return EBML_UINT_INVALID;
+        len = 8 - av_log2(buffer->start[0]);
+        if (len > buffer->len)
+            return EBML_UINT_INVALID;
+        length = EBML_UINT_INVALID;
+    }
+    *buffer = bstr_cut(*buffer, len);
+    return length;
+}
+
+/*
+ * Read the length of the current element from memory, and set payload to the
+ * element contents. buffer is advanced past the element. Returns false if the
+ * length is invalid or the element does not fit into buffer.
+ */
+bool ebml_read_payload_buf(bstr *buffer, bstr *payload)
+{
+    bstr data = *buffer;
+    uint64_t len = ebml_read_vlen_uint(&data);
+    if (len == EBML_UINT_INVALID || len > data.len)
+        return false;
+    *payload = bstr_splice(data, 0, len);
+    *buffer = bstr_cut(data, len);
+    return true;
+}
+
+/*
+ * Read the next element as an unsigned int from memory.
+ */
+uint64_t ebml_read_uint_buf(bstr *buffer)
+{
+    bstr data;
+    if (!ebml_read_payload_buf(buffer, &data) || data.len > 8)
+        return EBML_UINT_INVALID;
+    return ebml_parse_uint(data.start, data.len);
+}
+
+/*
+ * Read the next element as a signed int from memory.
+ */
+int64_t ebml_read_int_buf(bstr *buffer)
+{
+    bstr data;
+    if (!ebml_read_payload_buf(buffer, &data) || data.len > 8)
+        return EBML_INT_INVALID;
+    return ebml_parse_sint(data.start, data.len);
+}
+
+/*
+ * Make sure at least need bytes are loaded into the window. If data has to be
+ * read, read until want bytes are available (want should be limited to the
+ * end of the data the caller is going to parse). Unconsumed data is moved to
+ * the start of the buffer, so pointers into the old data become invalid.
+ * Returns false if the stream ended before need bytes could be loaded; the
+ * data read so far is still available.
+ */
+bool ebml_window_fill(struct ebml_window *w, stream_t *s, size_t need,
+                      size_t want)
+{
+    if (w->data.len >= need)
+        return true;
+    want = FFMAX(want, need);
+    if (w->data.len)
+        memmove(w->buf, w->data.start, w->data.len);
+    if (want + EBML_WINDOW_PADDING > w->size) {
+        w->size = want + EBML_WINDOW_PADDING;
+        w->buf = talloc_realloc_size(NULL, w->buf, w->size);
+    }
+    unsigned char *buf = w->buf;
+    size_t len = w->data.len;
+    len += stream_read(s, buf + len, want - len);
+    memset(buf + len, 0, EBML_WINDOW_PADDING);
+    w->data = (bstr){buf, len};
+    return len >= need;
+}
 
 // target must be initialized to zero
 static void ebml_parse_element(struct ebml_parse_ctx *ctx, void *target,
@@ -88,6 +88,27 @@ int64_t ebml_read_int (stream_t *s);
 int ebml_read_skip(struct mp_log *log, int64_t end, stream_t *s);
 int ebml_resync_cluster(struct mp_log *log, stream_t *s);
 
+uint32_t ebml_read_id_buf(bstr *buffer);
+uint64_t ebml_read_length_buf(bstr *buffer);
+bool ebml_read_payload_buf(bstr *buffer, bstr *payload);
+uint64_t ebml_read_uint_buf(bstr *buffer);
+int64_t ebml_read_int_buf(bstr *buffer);
+
+// Padding after the data in struct ebml_window (for decoders that overread).
+#define EBML_WINDOW_PADDING 64
+
+// Stream data read ahead into memory, so that many small elements can be
+// parsed with the *_buf functions instead of reading each field from the
+// stream. The stream position is at the end of the loaded data.
+struct ebml_window {
+    void *buf;          // talloc'ed (no parent), must be freed by the user
+    size_t size;        // allocated size of buf
+    bstr data;          // loaded data which was not consumed yet
+};
+
+bool ebml_window_fill(struct ebml_window *w, stream_t *s, size_t need,
+                      size_t want);
+
 int ebml_read_element(struct stream *s, struct ebml_parse_ctx *ctx,
                       void *target, const struct ebml_elem_desc *desc);
 
@@ -88,6 +88,7 @@ struct mp_codec_params {
     bool avi_dts;         // use DTS timing; first frame and DTS is 0
     double fps;           // frames per second (set only if constant fps)
     bool reliable_fps;    // the fps field is definitely not broken
+    bool still_image;     // expected to contain exactly 1 frame
     int par_w, par_h;     // pixel aspect ratio (0 if unknown/square)
     int disp_w, disp_h;   // display size
     int rotate;           // intended display rotation, in degrees, [0, 359]
@@ -63,3 +63,24 @@ void node_map_add_string(struct mpv_node *dst, const char *key, const char *val)
     entry->format = MPV_FORMAT_STRING;
     entry->u.string = talloc_strdup(dst->u.list, val);
 }
+
+// Add an int64 entry to a MPV_FORMAT_NODE_MAP. Keep in mind that this does
+// not check for already existing entries under the same key.
+void node_map_add_int64(struct mpv_node *dst, const char *key, int64_t v)
+{
+    node_map_add(dst, key, MPV_FORMAT_INT64)->u.int64 = v;
+}
+
+// Add a double entry to a MPV_FORMAT_NODE_MAP. Keep in mind that this does
+// not check for already existing entries under the same key.
+void node_map_add_double(struct mpv_node *dst, const char *key, double v)
+{
+    node_map_add(dst, key, MPV_FORMAT_DOUBLE)->u.double_ = v;
+}
+
+// Add a flag entry to a MPV_FORMAT_NODE_MAP. Keep in mind that this does
+// not check for already existing entries under the same key.
+void node_map_add_flag(struct mpv_node *dst, const char *key, bool v)
+{
+    node_map_add(dst, key, MPV_FORMAT_FLAG)->u.flag = v;
+}
@@ -68,6 +68,8 @@ extern const struct m_sub_options tv_params_conf;
 extern const struct m_sub_options stream_cdda_conf;
 extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
+extern const struct m_sub_options stream_file_conf;
+extern const struct m_sub_options stream_libarchive_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options demux_rawaudio_conf;
 extern const struct m_sub_options demux_rawvideo_conf;
@@ -307,6 +309,10 @@ const m_option_t mp_opts[] = {
 // ------------------------- stream options --------------------
 
     OPT_SUBSTRUCT("", stream_cache, stream_cache_conf, 0),
+    OPT_SUBSTRUCT("", stream_file_opts, stream_file_conf, 0),
+#if HAVE_LIBARCHIVE
+    OPT_SUBSTRUCT("", stream_libarchive_opts, stream_libarchive_conf, 0),
+#endif
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_SUBSTRUCT("", dvd_opts, dvd_conf, 0),
@@ -360,6 +366,7 @@ const m_option_t mp_opts[] = {
     OPT_STRINGLIST("slang", stream_lang[STREAM_SUB], 0),
 
     OPT_STRING("lavfi-complex", lavfi_complex, 0),
+    OPT_INTRANGE("lavfi-complex-queue", lavfi_complex_queue, 0, 0, 100),
 
     OPT_CHOICE("audio-display", audio_display, 0,
                ({"no", 0}, {"attachment", 1})),
@@ -381,9 +388,11 @@ const m_option_t mp_opts[] = {
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
+    OPT_INTRANGE("memory-budget", memory_budget, UPDATE_MEMORY, 0, INT_MAX),
 
     OPT_DOUBLE("mf-fps", mf_fps, 0),
     OPT_STRING("mf-type", mf_type, 0),
+    OPT_INTRANGE("mf-prefetch-threads", mf_prefetch_threads, 0, 0, 32),
 #if HAVE_TV
     OPT_SUBSTRUCT("tv", tv_params, tv_params_conf, 0),
 #endif /* HAVE_TV */
@@ -407,6 +416,10 @@ const m_option_t mp_opts[] = {
 
     OPT_FLAG("audio-pitch-correction", pitch_correction, 0),
 
+    OPT_DOUBLE("latency-target", latency_target, M_OPT_MIN, .min = 0),
+    OPT_DOUBLE("latency-catchup-speed", latency_catchup_speed, M_OPT_RANGE,
+               .min = 1.0, .max = 2.0),
+
     // set a-v distance
     OPT_FLOAT("audio-delay", audio_delay, 0),
 
@@ -415,6 +428,7 @@ const m_option_t mp_opts[] = {
     OPT_SETTINGSLIST("af-defaults", af_defs, 0, &af_obj_list, ),
     OPT_SETTINGSLIST("af*", af_settings, 0, &af_obj_list, ),
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list, ),
+    OPT_INTRANGE("vf-pipeline", vf_pipeline, 0, 0, 16),
     OPT_SETTINGSLIST("vf*", vf_settings, 0, &vf_obj_list, ),
 
     OPT_CHOICE("deinterlace", deinterlace, 0,
@@ -535,6 +549,8 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_DOUBLE("audio-thread-buffer", audio_thread_buffer,
+               M_OPT_MIN | M_OPT_MAX, .min = 0, .max = 10),
     OPT_FLOATRANGE("balance", balance, 0, -1, 1),
 
     OPT_STRING("title", wintitle, 0),
@@ -580,8 +596,15 @@ const m_option_t mp_opts[] = {
                 {"decoder+vo", 3})),
 
     OPT_DOUBLE("display-fps", frame_drop_fps, M_OPT_MIN, .min = 0),
+    OPT_INTRANGE("video-render-ahead", video_render_ahead, 0, 0, 32),
+    OPT_INTRANGE("video-frame-cache", video_frame_cache, 0, 0, INT_MAX),
 
     OPT_FLAG("untimed", untimed, 0),
+    OPT_STRING("benchmark-report", benchmark_report, M_OPT_FILE),
+    OPT_CHOICE("benchmark-mode", benchmark_mode, 0,
+               ({"no", 0}, {"demux", 1}, {"decode", 2})),
+    OPT_STRINGLIST("benchmark-seeks", benchmark_seeks, 0),
+    OPT_STRING("startup-trace", startup_trace, M_OPT_FILE),
 
     OPT_STRING("stream-capture", stream_capture, M_OPT_FILE),
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
@@ -696,7 +719,7 @@ const m_option_t mp_opts[] = {
     OPT_REMOVED("ass-bottom-margin", "use --vf=sub=bottom:top"),
     OPT_REPLACED("ass", "sub-ass"),
     OPT_REPLACED("audiofile", "audio-file"),
-    OPT_REMOVED("benchmark", "use --untimed (no stats)"),
+    OPT_REMOVED("benchmark", "use --untimed and --benchmark-report"),
     OPT_REMOVED("capture", "use --stream-capture=<filename>"),
     OPT_REMOVED("channels", "use --audio-channels (changed semantics)"),
     OPT_REPLACED("cursor-autohide-delay", "cursor-autohide"),
@@ -889,6 +912,7 @@ const struct MPOpts mp_default_opts = {
     .sub_speed = 1.0,
     .audio_output_format = 0,  // AF_FORMAT_UNKNOWN
     .playback_speed = 1.,
+    .latency_catchup_speed = 1.05,
     .pitch_correction = 1,
     .movie_aspect = -1.,
     .field_dominance = -1,
@@ -914,7 +938,10 @@ const struct MPOpts mp_default_opts = {
 
     .index_mode = 1,
 
+    .lavfi_complex_queue = 4,
+
     .mf_fps = 1.0,
+    .mf_prefetch_threads = 4,
 
     .display_tags = (char **)(const char*[]){
         "Artist", "Album", "Album_Artist", "Comment", "Composer", "Genre",
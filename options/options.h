@@ -105,6 +105,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    double audio_thread_buffer;
 
     mp_vo_opts *vo;
 
@@ -136,7 +137,13 @@ typedef struct MPOpts {
     int osd_fractions;
     int video_osd;
 
+    int video_render_ahead;
+    int video_frame_cache;
     int untimed;
+    char *benchmark_report;
+    int benchmark_mode;
+    char **benchmark_seeks;
+    char *startup_trace;
     char *stream_capture;
     char *stream_dump;
     int stop_playback_on_init_failure;
@@ -156,6 +163,8 @@ typedef struct MPOpts {
     int use_filedir_conf;
     int hls_bitrate;
     struct mp_cache_opts *stream_cache;
+    struct stream_file_opts *stream_file_opts;
+    struct stream_libarchive_opts *stream_libarchive_opts;
     int chapterrange[2];
     int edition_id;
     int correct_pts;
@@ -201,6 +210,7 @@ typedef struct MPOpts {
     int keep_open;
     double image_display_duration;
     char *lavfi_complex;
+    int lavfi_complex_queue;
     int stream_id[2][STREAM_TYPE_COUNT];
     int stream_id_ff[STREAM_TYPE_COUNT];
     char **stream_lang[STREAM_TYPE_COUNT];
@@ -220,6 +230,7 @@ typedef struct MPOpts {
     char **audio_files;
     char *demuxer_name;
     int demuxer_thread;
+    int memory_budget;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -239,7 +250,10 @@ typedef struct MPOpts {
     int dtshd;
     double playback_speed;
     int pitch_correction;
+    double latency_target;
+    double latency_catchup_speed;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_pipeline;
     struct m_obj_settings *af_settings, *af_defs;
     int deinterlace;
     float movie_aspect;
@@ -300,6 +314,7 @@ typedef struct MPOpts {
 
     double mf_fps;
     char *mf_type;
+    int mf_prefetch_threads;
 
     struct demux_rawaudio_opts *demux_rawaudio;
     struct demux_rawvideo_opts *demux_rawvideo;
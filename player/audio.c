@@ -21,6 +21,7 @@
 #include <limits.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "mpv_talloc.h"
@@ -29,6 +30,7 @@
 #include "common/encode.h"
 #include "options/options.h"
 #include "common/common.h"
+#include "osdep/threads.h"
 #include "osdep/timer.h"
 
 #include "audio/audio.h"
@@ -51,6 +53,89 @@ enum {
     AD_NO_PROGRESS = -5,
 };
 
+// With --audio-thread-buffer, decoding and filtering run on a separate thread,
+// which keeps a small amount of filtered audio ready for the core. During
+// normal playback, the thread also writes this audio to the AO by itself, so
+// the AO buffer doesn't drain while the core is busy with something else.
+// The core still does all A/V sync related skipping, padding and dropping on
+// ao_chain.ao_buffer, and takes back control of the AO whenever it runs.
+struct audio_thread {
+    struct ao_chain *ao_c;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+    int align;              // AO sample alignment
+
+    // The decoder, the filter chain, and the ao_chain fields updated by
+    // decoding belong to the thread while busy is set, and to the core while
+    // the thread is paused. The following fields are protected by lock.
+    bool exit;
+    bool busy;              // thread is working without holding the lock
+    int paused;             // nesting count of audio_thread_pause()
+    double max_secs;        // target amount of audio in ready
+    struct mp_audio_buffer *ready; // filtered audio not yet taken by the core
+    double out_pts;         // ao_chain.pts after the last decoding step
+    double out_delay;       // filter chain delay after the last decoding step
+    bool pts_reset;         // ao_chain.pts_reset after the last decoding step
+    int status;             // AD_OK, or final AD_* result once filters drained
+    int reported;           // last status the core was woken up for
+    bool retry;             // core requested another attempt after EOF/error
+    int core_want;          // wake up the core once ready has this many samples
+    bool direct;            // thread may write to the AO (set by the core)
+    bool flushed;           // AO was reset; no direct until audio_thread_reset
+    int64_t direct_played;  // samples written by the thread, not accounted yet
+
+    // Owned by the thread.
+    int drain;              // if <0, drain the filters, then stop with it
+};
+
+static void audio_thread_stop(struct MPContext *mpctx);
+
+// Make sure the audio thread (if any) doesn't touch the decoder, the filter
+// chain, or the AO, until audio_thread_resume() is called. Can be nested.
+void audio_thread_pause(struct ao_chain *ao_c)
+{
+    struct audio_thread *t = ao_c ? ao_c->thread : NULL;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    t->paused++;
+    while (t->busy)
+        pthread_cond_wait(&t->wakeup, &t->lock);
+    pthread_mutex_unlock(&t->lock);
+}
+
+void audio_thread_resume(struct ao_chain *ao_c)
+{
+    struct audio_thread *t = ao_c ? ao_c->thread : NULL;
+    if (!t)
+        return;
+    pthread_mutex_lock(&t->lock);
+    assert(t->paused > 0);
+    t->paused--;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// Drop all decoded audio. Called paused.
+static void audio_thread_reset(struct audio_thread *t)
+{
+    pthread_mutex_lock(&t->lock);
+    mp_audio_buffer_clear(t->ready);
+    t->out_pts = MP_NOPTS_VALUE;
+    t->out_delay = 0;
+    t->pts_reset = false;
+    t->status = t->reported = AD_OK;
+    t->retry = false;
+    t->core_want = 0;
+    t->direct_played = 0;
+    t->flushed = false;
+    t->drain = 0;
+    pthread_mutex_unlock(&t->lock);
+}
+
 // Use pitch correction only for speed adjustments by the user, not minor sync
 // correction ones.
 static int get_speed_method(struct MPContext *mpctx)
@@ -115,12 +200,12 @@ static void recreate_speed_filters(struct MPContext *mpctx)
 fail:
     mpctx->opts->playback_speed = 1.0;
     mpctx->speed_factor_a = 1.0;
+    mpctx->speed_factor_latency = 1.0;
     mpctx->audio_speed = 1.0;
     mp_notify(mpctx, MP_EVENT_CHANGE_ALL, NULL);
 }
 
-// Called when opts->softvol_volume or opts->softvol_mute were changed.
-void audio_update_volume(struct MPContext *mpctx)
+static void update_volume(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
     struct ao_chain *ao_c = mpctx->ao_chain;
@@ -141,6 +226,14 @@ void audio_update_volume(struct MPContext *mpctx)
     }
 }
 
+// Called when opts->softvol_volume or opts->softvol_mute were changed.
+void audio_update_volume(struct MPContext *mpctx)
+{
+    audio_thread_pause(mpctx->ao_chain);
+    update_volume(mpctx);
+    audio_thread_resume(mpctx->ao_chain);
+}
+
 /* NOTE: Currently the balance code is seriously buggy: it always changes
  * the af_pan mapping between the first two input channels and first two
  * output channels to particular values. These values make sense for an
@@ -149,7 +242,7 @@ void audio_update_volume(struct MPContext *mpctx)
  * there for another reason, then ignoring and overriding the original
  * values is completely wrong.
  */
-void audio_update_balance(struct MPContext *mpctx)
+static void update_balance(struct MPContext *mpctx)
 {
     struct MPOpts *opts = mpctx->opts;
     struct ao_chain *ao_c = mpctx->ao_chain;
@@ -182,6 +275,13 @@ void audio_update_balance(struct MPContext *mpctx)
     af_pan_balance->control(af_pan_balance, AF_CONTROL_SET_PAN_BALANCE, &val);
 }
 
+void audio_update_balance(struct MPContext *mpctx)
+{
+    audio_thread_pause(mpctx->ao_chain);
+    update_balance(mpctx);
+    audio_thread_resume(mpctx->ao_chain);
+}
+
 static int recreate_audio_filters(struct MPContext *mpctx)
 {
     assert(mpctx->ao_chain);
@@ -215,6 +315,8 @@ int reinit_audio_filters(struct MPContext *mpctx)
     if (!ao_c)
         return 0;
 
+    audio_thread_stop(mpctx);
+
     double delay = 0;
     if (ao_c->af->initialized > 0)
         delay = af_calc_delay(ao_c->af);
@@ -234,21 +336,35 @@ int reinit_audio_filters(struct MPContext *mpctx)
     return 1;
 }
 
+// Speed requested by the user, plus latency catch-up. The sync code applies
+// its own factors on top of this.
+double get_base_playback_speed(struct MPContext *mpctx)
+{
+    return mpctx->opts->playback_speed * mpctx->speed_factor_latency;
+}
+
 // Call this if opts->playback_speed or mpctx->speed_factor_* change.
 void update_playback_speed(struct MPContext *mpctx)
 {
-    mpctx->audio_speed = mpctx->opts->playback_speed * mpctx->speed_factor_a;
-    mpctx->video_speed = mpctx->opts->playback_speed * mpctx->speed_factor_v;
+    double speed = get_base_playback_speed(mpctx);
+    mpctx->audio_speed = speed * mpctx->speed_factor_a;
+    mpctx->video_speed = speed * mpctx->speed_factor_v;
 
     if (!mpctx->ao_chain || mpctx->ao_chain->af->initialized < 1)
         return;
 
+    audio_thread_pause(mpctx->ao_chain);
     if (!update_speed_filters(mpctx))
         recreate_audio_filters(mpctx);
+    audio_thread_resume(mpctx->ao_chain);
 }
 
 static void ao_chain_reset_state(struct ao_chain *ao_c)
 {
+    audio_thread_pause(ao_c);
+    if (ao_c->thread)
+        audio_thread_reset(ao_c->thread);
+
     ao_c->pts = MP_NOPTS_VALUE;
     ao_c->pts_reset = false;
     talloc_free(ao_c->input_frame);
@@ -258,6 +374,8 @@ static void ao_chain_reset_state(struct ao_chain *ao_c)
 
     if (ao_c->audio_src)
         audio_reset_decoding(ao_c->audio_src);
+
+    audio_thread_resume(ao_c);
 }
 
 void reset_audio_state(struct MPContext *mpctx)
@@ -273,6 +391,7 @@ void reset_audio_state(struct MPContext *mpctx)
 
 void uninit_audio_out(struct MPContext *mpctx)
 {
+    audio_thread_stop(mpctx);
     if (mpctx->ao) {
         // Note: with gapless_audio, stop_play is not correctly set
         if (mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE)
@@ -309,6 +428,7 @@ static void ao_chain_uninit(struct ao_chain *ao_c)
 void uninit_audio_chain(struct MPContext *mpctx)
 {
     if (mpctx->ao_chain) {
+        audio_thread_stop(mpctx);
         ao_chain_uninit(mpctx->ao_chain);
         mpctx->ao_chain = NULL;
 
@@ -326,6 +446,8 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     struct track *track = ao_c->track;
     struct af_stream *afs = ao_c->af;
 
+    audio_thread_stop(mpctx);
+
     if (ao_c->input_frame)
         mp_audio_copy_config(&ao_c->input_format, ao_c->input_frame);
 
@@ -348,6 +470,8 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
     if (mpctx->ao && mp_audio_config_equals(&in_format, &afs->input))
         return;
 
+    add_startup_phase(mpctx, "audio-decode", mp_time_us());
+
     afs->output = (struct mp_audio){0};
     if (mpctx->ao) {
         ao_get_format(mpctx->ao, &afs->output);
@@ -371,6 +495,8 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
         goto init_error;
     }
 
+    add_startup_phase(mpctx, "audio-filters", mp_time_us());
+
     if (!mpctx->ao) {
         int ao_flags = 0;
         bool spdif_fallback = af_fmt_is_spdif(afs->output.format) &&
@@ -401,6 +527,7 @@ static void reinit_audio_filters_and_output(struct MPContext *mpctx)
                                  mpctx, mpctx->encode_lavc_ctx, afs->output.rate,
                                  afs->output.format, afs->output.channels);
         ao_c->ao = mpctx->ao;
+        add_startup_phase(mpctx, "ao-init", mp_time_us());
 
         struct mp_audio fmt = {0};
         if (mpctx->ao)
@@ -574,12 +701,26 @@ double written_audio_pts(struct MPContext *mpctx)
         return MP_NOPTS_VALUE;
 
     // first calculate the end pts of audio that has been output by decoder
-    double a_pts = ao_c->pts;
-    if (a_pts == MP_NOPTS_VALUE)
-        return MP_NOPTS_VALUE;
+    double a_pts;
 
     // Data buffered in audio filters, measured in seconds of "missing" output
-    double buffered_output = af_calc_delay(ao_c->af);
+    double buffered_output = 0;
+
+    struct audio_thread *t = ao_c->thread;
+    if (t) {
+        // Plus data decoded by the audio thread but not yet taken by us
+        pthread_mutex_lock(&t->lock);
+        a_pts = t->out_pts;
+        buffered_output = t->out_delay + mp_audio_buffer_seconds(t->ready);
+        pthread_mutex_unlock(&t->lock);
+    } else {
+        a_pts = ao_c->pts;
+        if (a_pts != MP_NOPTS_VALUE)
+            buffered_output = af_calc_delay(ao_c->af);
+    }
+
+    if (a_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
 
     // Data that was ready for ao but was buffered because ao didn't fully
     // accept everything to internal buffers yet
@@ -601,25 +742,30 @@ double playing_audio_pts(struct MPContext *mpctx)
     return pts - mpctx->audio_speed * ao_get_delay(mpctx->ao);
 }
 
+// Account for samples that were written to the AO.
+static void add_played_samples(struct MPContext *mpctx, int64_t played)
+{
+    struct mp_audio out_format;
+    ao_get_format(mpctx->ao, &out_format);
+    double real_samplerate = out_format.rate / mpctx->audio_speed;
+    mpctx->shown_aframes += played;
+    mpctx->delay += played / real_samplerate;
+    mpctx->written_audio += played / (double)out_format.rate;
+}
+
 static int write_to_ao(struct MPContext *mpctx, struct mp_audio *data, int flags)
 {
     if (mpctx->paused)
         return 0;
-    struct ao *ao = mpctx->ao;
-    struct mp_audio out_format;
-    ao_get_format(ao, &out_format);
 #if HAVE_ENCODING
     encode_lavc_set_audio_pts(mpctx->encode_lavc_ctx, playing_audio_pts(mpctx));
 #endif
     if (data->samples == 0)
         return 0;
-    double real_samplerate = out_format.rate / mpctx->audio_speed;
     int played = ao_play(mpctx->ao, data->planes, data->samples, flags);
     assert(played <= data->samples);
     if (played > 0) {
-        mpctx->shown_aframes += played;
-        mpctx->delay += played / real_samplerate;
-        mpctx->written_audio += played / (double)out_format.rate;
+        add_played_samples(mpctx, played);
         return played;
     }
     return 0;
@@ -791,6 +937,30 @@ static int decode_new_frame(struct ao_chain *ao_c)
     }
 }
 
+// Update ao_c->pts with the decoded frame, which is about to be filtered.
+static void update_input_pts(struct ao_chain *ao_c, struct mp_audio *mpa)
+{
+    if (mpa->pts == MP_NOPTS_VALUE) {
+        ao_c->pts = MP_NOPTS_VALUE;
+    } else {
+        // Attempt to detect jumps in PTS. Even for the lowest sample rates
+        // and with worst container rounded timestamp, this should be a
+        // margin more than enough.
+        double desync = mpa->pts - ao_c->pts;
+        if (ao_c->pts != MP_NOPTS_VALUE && fabs(desync) > 0.1) {
+            MP_WARN(ao_c, "Invalid audio PTS: %f -> %f\n",
+                    ao_c->pts, mpa->pts);
+            if (desync >= 5)
+                ao_c->pts_reset = true;
+        }
+        ao_c->pts = mpa->pts + mpa->samples / (double)mpa->rate;
+    }
+}
+
+static int filter_audio_threaded(struct MPContext *mpctx,
+                                 struct mp_audio_buffer *outbuf,
+                                 int minsamples);
+
 /* Try to get at least minsamples decoded+filtered samples in outbuf
  * (total length including possible existing data).
  * Return 0 on success, or negative AD_* error code.
@@ -804,6 +974,9 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
     if (afs->initialized < 1)
         return AD_ERR;
 
+    if (ao_c->thread)
+        return filter_audio_threaded(mpctx, outbuf, minsamples);
+
     MP_STATS(ao_c, "start audio");
 
     double endpts = get_play_end_pts(mpctx);
@@ -834,21 +1007,7 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
 
         struct mp_audio *mpa = ao_c->input_frame;
         ao_c->input_frame = NULL;
-        if (mpa->pts == MP_NOPTS_VALUE) {
-            ao_c->pts = MP_NOPTS_VALUE;
-        } else {
-            // Attempt to detect jumps in PTS. Even for the lowest sample rates
-            // and with worst container rounded timestamp, this should be a
-            // margin more than enough.
-            double desync = mpa->pts - ao_c->pts;
-            if (ao_c->pts != MP_NOPTS_VALUE && fabs(desync) > 0.1) {
-                MP_WARN(ao_c, "Invalid audio PTS: %f -> %f\n",
-                        ao_c->pts, mpa->pts);
-                if (desync >= 5)
-                    ao_c->pts_reset = true;
-            }
-            ao_c->pts = mpa->pts + mpa->samples / (double)mpa->rate;
-        }
+        update_input_pts(ao_c, mpa);
         if (af_filter_frame(afs, mpa) < 0)
             return AD_ERR;
     }
@@ -861,11 +1020,319 @@ static int filter_audio(struct MPContext *mpctx, struct mp_audio_buffer *outbuf,
     return res;
 }
 
+// Decode and filter until a frame of output is available. Runs on the audio
+// thread, without holding the lock. Returns AD_OK (*out might be set),
+// AD_WAIT, AD_NO_PROGRESS, or the final result once the filters are drained.
+static int thread_decode(struct audio_thread *t, struct mp_audio **out)
+{
+    struct ao_chain *ao_c = t->ao_c;
+    struct af_stream *afs = ao_c->af;
+
+    while (1) {
+        if (af_output_frame(afs, t->drain < 0) < 0)
+            return AD_ERR;
+        *out = af_read_output_frame(afs);
+        if (*out)
+            return AD_OK;
+        if (t->drain < 0)
+            return t->drain;
+
+        int res = decode_new_frame(ao_c);
+        if (res == AD_WAIT || res == AD_NO_PROGRESS)
+            return res;
+        if (res < 0) {
+            // drain filters first (especially for true EOF case)
+            t->drain = res;
+            continue;
+        }
+
+        // On format change, make sure to drain the filter chain.
+        if (!mp_audio_config_equals(&afs->input, ao_c->input_frame)) {
+            t->drain = AD_NEW_FMT;
+            continue;
+        }
+
+        struct mp_audio *mpa = ao_c->input_frame;
+        ao_c->input_frame = NULL;
+        update_input_pts(ao_c, mpa);
+        if (af_filter_frame(afs, mpa) < 0)
+            return AD_ERR;
+    }
+}
+
+// Write audio from the ready buffer to the AO, if the core allows it. Called
+// locked.
+static void thread_write_ao(struct audio_thread *t)
+{
+    struct ao *ao = t->ao_c->ao;
+    if (!t->direct || t->paused || !ao)
+        return;
+
+    struct mp_audio data;
+    mp_audio_buffer_peek(t->ready, &data);
+    data.samples = MPMIN(data.samples, ao_get_space(ao)) / t->align * t->align;
+    if (data.samples <= 0)
+        return;
+    int played = ao_play(ao, data.planes, data.samples, 0);
+    if (played > 0) {
+        mp_audio_buffer_skip(t->ready, played);
+        t->direct_played += played;
+    }
+}
+
+static void *audio_thread(void *p)
+{
+    struct audio_thread *t = p;
+    struct ao_chain *ao_c = t->ao_c;
+    mpthread_set_name("audio");
+
+    pthread_mutex_lock(&t->lock);
+    while (!t->exit) {
+        thread_write_ao(t);
+
+        bool retry = t->retry && t->status != AD_NEW_FMT;
+        bool work = !t->paused && (t->status == AD_OK || retry) &&
+                    mp_audio_buffer_seconds(t->ready) < t->max_secs;
+        if (!work) {
+            if (t->direct && !t->paused) {
+                // Poll the AO for free space.
+                struct timespec ts = mp_rel_time_to_timespec(0.01);
+                pthread_cond_timedwait(&t->wakeup, &t->lock, &ts);
+            } else {
+                pthread_cond_wait(&t->wakeup, &t->lock);
+            }
+            continue;
+        }
+        if (retry) {
+            t->retry = false;
+            t->drain = 0;
+        }
+
+        t->busy = true;
+        pthread_mutex_unlock(&t->lock);
+
+        struct mp_audio *frame = NULL;
+        int res = thread_decode(t, &frame);
+        double out_pts = ao_c->pts;
+        double out_delay = out_pts != MP_NOPTS_VALUE ? af_calc_delay(ao_c->af) : 0;
+        bool pts_reset = ao_c->pts_reset;
+
+        pthread_mutex_lock(&t->lock);
+        t->busy = false;
+        pthread_cond_broadcast(&t->wakeup);
+
+        t->out_pts = out_pts;
+        t->out_delay = out_delay;
+        if (frame) {
+            mp_audio_buffer_append(t->ready, frame);
+            talloc_free(frame);
+            t->status = AD_OK;
+        } else if (res != AD_OK && res != AD_WAIT && res != AD_NO_PROGRESS) {
+            t->status = res;
+        }
+
+        bool wakeup = t->status != t->reported || pts_reset != t->pts_reset;
+        t->reported = t->status;
+        if (t->core_want &&
+            mp_audio_buffer_samples(t->ready) >= t->core_want)
+        {
+            t->core_want = 0;
+            wakeup = true;
+        }
+        t->pts_reset = pts_reset;
+        if (wakeup) {
+            pthread_mutex_unlock(&t->lock);
+            t->wakeup_cb(t->wakeup_ctx);
+            pthread_mutex_lock(&t->lock);
+        }
+
+        if (res == AD_WAIT && !t->exit && !t->paused) {
+            // The demuxer wakes up the core, not us. The core pokes us on
+            // each iteration, but don't rely on it being responsive.
+            struct timespec ts = mp_rel_time_to_timespec(0.01);
+            pthread_cond_timedwait(&t->wakeup, &t->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+// Take back control over the AO from the audio thread, and account for the
+// audio it wrote on its own.
+static void audio_thread_sync(struct MPContext *mpctx)
+{
+    struct audio_thread *t = mpctx->ao_chain->thread;
+    pthread_mutex_lock(&t->lock);
+    t->direct = false;
+    int64_t played = t->direct_played;
+    t->direct_played = 0;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+
+    if (played > 0 && mpctx->ao)
+        add_played_samples(mpctx, played);
+}
+
+static bool get_pts_reset(struct ao_chain *ao_c)
+{
+    struct audio_thread *t = ao_c->thread;
+    if (!t)
+        return ao_c->pts_reset;
+    pthread_mutex_lock(&t->lock);
+    bool pts_reset = t->pts_reset;
+    pthread_mutex_unlock(&t->lock);
+    return pts_reset;
+}
+
+static void audio_thread_start(struct MPContext *mpctx)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    double secs = mpctx->opts->audio_thread_buffer;
+    // lavfi pads can only be accessed from the core thread.
+    if (secs <= 0 || ao_c->thread || ao_c->filter_src || !mpctx->ao ||
+        ao_c->af->initialized < 1)
+        return;
+
+    struct mp_audio fmt;
+    ao_get_format(mpctx->ao, &fmt);
+
+    struct audio_thread *t = talloc_zero(NULL, struct audio_thread);
+    *t = (struct audio_thread){
+        .ao_c = ao_c,
+        .wakeup_cb = mp_wakeup_core_cb,
+        .wakeup_ctx = mpctx,
+        .align = af_format_sample_alignment(fmt.format),
+        .max_secs = secs,
+        .ready = mp_audio_buffer_create(t),
+        .out_pts = ao_c->pts,
+        .out_delay = ao_c->pts != MP_NOPTS_VALUE ? af_calc_delay(ao_c->af) : 0,
+    };
+    mp_audio_buffer_reinit(t->ready, &fmt);
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wakeup, NULL);
+
+    if (pthread_create(&t->thread, NULL, audio_thread, t)) {
+        MP_ERR(mpctx, "Could not start audio thread.\n");
+        pthread_cond_destroy(&t->wakeup);
+        pthread_mutex_destroy(&t->lock);
+        talloc_free(t);
+        return;
+    }
+    ao_c->thread = t;
+}
+
+// Terminate the audio thread. Audio it decoded ahead is moved to ao_buffer,
+// so nothing is lost, and decoding continues on the core thread.
+static void audio_thread_stop(struct MPContext *mpctx)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    struct audio_thread *t = ao_c ? ao_c->thread : NULL;
+    if (!t)
+        return;
+
+    audio_thread_sync(mpctx);
+
+    pthread_mutex_lock(&t->lock);
+    t->exit = true;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+
+    struct mp_audio data;
+    mp_audio_buffer_peek(t->ready, &data);
+    if (data.samples)
+        mp_audio_buffer_append(ao_c->ao_buffer, &data);
+
+    pthread_cond_destroy(&t->wakeup);
+    pthread_mutex_destroy(&t->lock);
+    talloc_free(t);
+    ao_c->thread = NULL;
+}
+
+// filter_audio() for the threaded case: move audio from the thread's ready
+// buffer to outbuf.
+static int filter_audio_threaded(struct MPContext *mpctx,
+                                 struct mp_audio_buffer *outbuf,
+                                 int minsamples)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    struct audio_thread *t = ao_c->thread;
+    double endpts = get_play_end_pts(mpctx);
+    int res = 0;
+
+    pthread_mutex_lock(&t->lock);
+
+    struct mp_audio data;
+    mp_audio_buffer_peek(t->ready, &data);
+    int want = MPMAX(minsamples - mp_audio_buffer_samples(outbuf), 0);
+    int samples = MPMIN(data.samples, want);
+
+    // Wait until the thread has decoded enough. Leave the data in the ready
+    // buffer meanwhile, so the thread can write it to the AO directly.
+    if (samples < want && t->status == AD_OK &&
+        mp_audio_buffer_seconds(t->ready) < t->max_secs)
+    {
+        t->core_want = MPMIN(want, (int)(t->max_secs * data.rate));
+        pthread_cond_broadcast(&t->wakeup);
+        pthread_mutex_unlock(&t->lock);
+        return AD_WAIT;
+    }
+
+    bool eof = false;
+    if (endpts != MP_NOPTS_VALUE && t->out_pts != MP_NOPTS_VALUE) {
+        double rate = data.rate / mpctx->audio_speed;
+        double curpts = t->out_pts - (t->out_delay + mp_audio_buffer_seconds(
+                                      t->ready)) * mpctx->audio_speed;
+        double max = (endpts - curpts - mpctx->opts->audio_delay) * rate;
+        if (samples > max) {
+            samples = MPMAX(max, 0);
+            eof = true;
+        }
+    }
+
+    if (samples > 0) {
+        data.samples = samples;
+        mp_audio_buffer_append(outbuf, &data);
+        mp_audio_buffer_skip(t->ready, samples);
+    }
+
+    if (eof) {
+        if (mp_audio_buffer_samples(outbuf) < minsamples)
+            res = AD_EOF;
+    } else if (samples < want && t->status < 0 &&
+               !mp_audio_buffer_samples(t->ready))
+    {
+        res = t->status;
+        t->retry = true;
+    }
+
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+    return res;
+}
+
+// Let the audio thread write to the AO until the core runs again, if the core
+// has nothing else to do with it.
+static void audio_thread_set_direct(struct MPContext *mpctx)
+{
+    struct ao_chain *ao_c = mpctx->ao_chain;
+    struct audio_thread *t = ao_c->thread;
+    bool direct = mpctx->audio_status == STATUS_PLAYING && !mpctx->paused &&
+                  !mp_audio_buffer_samples(ao_c->ao_buffer) &&
+                  get_play_end_pts(mpctx) == MP_NOPTS_VALUE &&
+                  !ao_untimed(mpctx->ao) && !mpctx->encode_lavc_ctx;
+    pthread_mutex_lock(&t->lock);
+    t->direct = direct && !t->flushed;
+    pthread_cond_broadcast(&t->wakeup);
+    pthread_mutex_unlock(&t->lock);
+}
+
 void reload_audio_output(struct MPContext *mpctx)
 {
     if (!mpctx->ao)
         return;
 
+    audio_thread_stop(mpctx);
     ao_reset(mpctx->ao);
     uninit_audio_out(mpctx);
     reinit_audio_filters(mpctx); // mostly to issue refresh seek
@@ -905,7 +1372,11 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
     if (!ao_c)
         return;
 
+    if (ao_c->thread)
+        audio_thread_sync(mpctx);
+
     if (ao_c->af->initialized < 1 || !mpctx->ao) {
+        audio_thread_stop(mpctx);
         // Probe the initial audio format. Returns AD_OK (and does nothing) if
         // the format is already known.
         int r = decode_new_frame(mpctx->ao_chain);
@@ -920,13 +1391,15 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
         return; // try again next iteration
     }
 
+    audio_thread_start(mpctx);
+
     if (ao_c->ao_resume_time > mp_time_sec()) {
         double remaining = ao_c->ao_resume_time - mp_time_sec();
         mp_set_timeout(mpctx, remaining);
         return;
     }
 
-    if (mpctx->vo_chain && ao_c->pts_reset) {
+    if (mpctx->vo_chain && get_pts_reset(ao_c)) {
         MP_VERBOSE(mpctx, "Reset playback due to audio timestamp reset.\n");
         reset_playback_state(mpctx);
         mp_wakeup_core(mpctx);
@@ -977,8 +1450,11 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
     bool working = false;
     if (playsize > mp_audio_buffer_samples(ao_c->ao_buffer)) {
         status = filter_audio(mpctx, ao_c->ao_buffer, playsize);
-        if (status == AD_WAIT)
+        if (status == AD_WAIT) {
+            if (ao_c->thread)
+                audio_thread_set_direct(mpctx);
             return;
+        }
         if (status == AD_NO_PROGRESS) {
             mp_wakeup_core(mpctx);
             return;
@@ -1109,11 +1585,36 @@ void fill_audio_out_buffers(struct MPContext *mpctx)
                 mp_wakeup_core(mpctx);
         }
     }
+
+    if (ao_c->thread)
+        audio_thread_set_direct(mpctx);
+}
+
+// Take back control over the AO from the audio thread (if any), e.g. before
+// pausing the AO.
+void audio_stop_direct_output(struct MPContext *mpctx)
+{
+    if (mpctx->ao_chain && mpctx->ao_chain->thread)
+        audio_thread_sync(mpctx);
 }
 
 // Drop data queued for output, or which the AO is currently outputting.
 void clear_audio_output_buffers(struct MPContext *mpctx)
 {
-    if (mpctx->ao)
+    if (mpctx->ao) {
+        struct ao_chain *ao_c = mpctx->ao_chain;
+        struct audio_thread *t = ao_c ? ao_c->thread : NULL;
+        if (t) {
+            // Audio the thread has ready would be written after the AO reset,
+            // and it may write again only once the chain was reset as well.
+            audio_thread_sync(mpctx);
+            pthread_mutex_lock(&t->lock);
+            mp_audio_buffer_clear(t->ready);
+            t->flushed = true;
+            pthread_mutex_unlock(&t->lock);
+        }
+        audio_thread_pause(ao_c);
         ao_reset(mpctx->ao);
+        audio_thread_resume(ao_c);
+    }
 }
@@ -0,0 +1,595 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/resource.h>
+#endif
+
+#include "mpv_talloc.h"
+
+#include "audio/decode/dec_audio.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "options/m_option.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "osdep/io.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "video/decode/dec_video.h"
+#include "video/out/vo.h"
+
+#include "core.h"
+#include "command.h"
+
+// Start collecting statistics for a new file.
+void reset_perf_stats(struct MPContext *mpctx)
+{
+    mpctx->perf = (struct mp_perf_stats){
+        .start_time = mp_time_us(),
+    };
+}
+
+// Highest resident set size of the process in bytes, or -1 if unknown.
+static int64_t get_peak_memory(void)
+{
+#if HAVE_POSIX
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+        return ru.ru_maxrss;
+#else
+        return ru.ru_maxrss * (int64_t)1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+static void add_stage(struct mpv_node *dst, const char *name, int64_t time_us,
+                      int64_t frames)
+{
+    struct mpv_node *e = node_map_add(dst, name, MPV_FORMAT_NODE_MAP);
+    node_map_add_double(e, "time", time_us / 1e6);
+    node_map_add_double(e, "time-per-frame",
+                        frames > 0 ? time_us / 1e6 / frames : 0);
+}
+
+// Write the statistics for the current file as a MPV_FORMAT_NODE_MAP to dst.
+// dst is initialized with node_init(); free it with talloc_free(dst->u.list).
+void get_perf_stats(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct mp_perf_stats *perf = &mpctx->perf;
+    double elapsed = (mp_time_us() - perf->start_time) / 1e6;
+
+    struct demux_ctrl_reader_state demux = {0};
+    if (mpctx->demuxer)
+        demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &demux);
+
+    int64_t vo_frames = 0, vo_time = 0, vo_drops = 0;
+    if (mpctx->video_out) {
+        vo_get_render_stats(mpctx->video_out, &vo_frames, &vo_time);
+        vo_drops = vo_get_drop_count(mpctx->video_out);
+    }
+
+    int64_t decoder_drops = 0;
+    if (mpctx->vo_chain && mpctx->vo_chain->video_src)
+        decoder_drops = mpctx->vo_chain->video_src->dropped_frames;
+
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    if (mpctx->filename)
+        node_map_add_string(dst, "file", mpctx->filename);
+    node_map_add_double(dst, "wall-time", elapsed);
+    node_map_add_int64(dst, "decoded-frames", perf->decoded_vframes);
+    node_map_add_int64(dst, "output-frames", mpctx->shown_vframes);
+    node_map_add_int64(dst, "rendered-frames", vo_frames);
+    node_map_add_int64(dst, "decoder-dropped-frames", decoder_drops);
+    node_map_add_int64(dst, "vo-dropped-frames", vo_drops);
+    node_map_add_double(dst, "fps",
+                        elapsed > 0 ? mpctx->shown_vframes / elapsed : 0);
+    node_map_add_double(dst, "decode-fps",
+                        elapsed > 0 ? perf->decoded_vframes / elapsed : 0);
+
+    add_stage(dst, "demux", demux.fill_time, perf->decoded_vframes);
+    add_stage(dst, "decode", perf->decode_time, perf->decoded_vframes);
+    add_stage(dst, "filter", perf->filter_time, perf->decoded_vframes);
+    add_stage(dst, "vo", vo_time, vo_frames);
+
+    node_map_add_int64(dst, "peak-demux-packets", demux.peak_packs);
+    node_map_add_int64(dst, "peak-demux-bytes", demux.peak_bytes);
+    node_map_add_int64(dst, "peak-vo-queue", perf->peak_vo_queue);
+    node_map_add_int64(dst, "peak-memory", get_peak_memory());
+}
+
+// If append is set, add the report as a new line to the file, instead of
+// overwriting it.
+static void write_report(struct MPContext *mpctx, struct mpv_node *report,
+                         const char *file, const char *what, bool append)
+{
+    char *text = talloc_strdup(NULL, "");
+    json_write(&text, report);
+
+    char *path = mp_get_user_path(text, mpctx->global, file);
+    FILE *f = fopen(path, append ? "ab" : "wb");
+    if (!f || fprintf(f, "%s\n", text) < 0) {
+        MP_ERR(mpctx, "Could not write %s to '%s'.\n", what, path);
+    } else {
+        MP_INFO(mpctx, "%s written to '%s'.\n", what, path);
+    }
+    if (f)
+        fclose(f);
+    talloc_free(text);
+}
+
+// Each file gets a line in the --benchmark-report file. The file is truncated
+// when the first report of this process is written.
+static void write_benchmark_report(struct MPContext *mpctx,
+                                   struct mpv_node *report)
+{
+    write_report(mpctx, report, mpctx->opts->benchmark_report,
+                 "Benchmark report", mpctx->perf_report_written);
+    mpctx->perf_report_written = true;
+}
+
+// Write the statistics to the file set with --benchmark-report (if any). Must
+// be called before the decoders and the demuxer are destroyed.
+void write_perf_report(struct MPContext *mpctx)
+{
+    if (!mpctx->opts->benchmark_report || !mpctx->opts->benchmark_report[0])
+        return;
+
+    struct mpv_node report;
+    get_perf_stats(mpctx, &report);
+    write_benchmark_report(mpctx, &report);
+    talloc_free(report.u.list);
+}
+
+// Start recording startup phases for a new file. For the first file, the
+// phases of mp_initialize() are kept, and the times stay relative to it.
+void reset_startup_timings(struct MPContext *mpctx)
+{
+    struct mp_startup_timings *st = &mpctx->startup;
+    if (st->file_started || !st->start) {
+        st->start = mp_time_us();
+        st->num_phases = 0;
+    }
+    st->file_started = true;
+    st->done = false;
+}
+
+// Record that the named phase ended at the given time (mp_time_us()). Ignored
+// once playback has started.
+void add_startup_phase(struct MPContext *mpctx, const char *name, int64_t end)
+{
+    struct mp_startup_timings *st = &mpctx->startup;
+    if (st->done || !st->start)
+        return;
+    struct mp_startup_phase phase = {name, MPMAX(end, st->start)};
+    MP_TARRAY_APPEND(mpctx, st->phases, st->num_phases, phase);
+}
+
+static int64_t phase_start(struct mp_startup_timings *st, int n)
+{
+    return n > 0 ? st->phases[n - 1].end : st->start;
+}
+
+static void write_startup_trace(struct MPContext *mpctx)
+{
+    struct mp_startup_timings *st = &mpctx->startup;
+
+    // Chrome trace event format (chrome://tracing, Perfetto).
+    struct mpv_node trace;
+    node_init(&trace, MPV_FORMAT_NODE_MAP, NULL);
+    struct mpv_node *events = node_map_add(&trace, "traceEvents",
+                                           MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < st->num_phases; n++) {
+        int64_t start = phase_start(st, n);
+        struct mpv_node *e = node_array_add(events, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", st->phases[n].name);
+        node_map_add_string(e, "cat", "startup");
+        node_map_add_string(e, "ph", "X");
+        node_map_add_int64(e, "ts", start - st->start);
+        node_map_add_int64(e, "dur", st->phases[n].end - start);
+        node_map_add_int64(e, "pid", 1);
+        node_map_add_int64(e, "tid", 1);
+    }
+    node_map_add_string(&trace, "displayTimeUnit", "ms");
+
+    write_report(mpctx, &trace, mpctx->opts->startup_trace, "Startup trace",
+                 false);
+    talloc_free(trace.u.list);
+}
+
+// Called when playback of the current file has started (first frame shown).
+void finish_startup_timings(struct MPContext *mpctx)
+{
+    struct mp_startup_timings *st = &mpctx->startup;
+    if (st->done || !st->start)
+        return;
+    add_startup_phase(mpctx, "playback-start", mp_time_us());
+    st->done = true;
+
+    for (int n = 0; n < st->num_phases; n++) {
+        MP_VERBOSE(mpctx, "Startup: %-16s %8.3f ms (at %.3f ms)\n",
+                   st->phases[n].name,
+                   (st->phases[n].end - phase_start(st, n)) / 1e3,
+                   (st->phases[n].end - st->start) / 1e3);
+    }
+
+    if (mpctx->opts->startup_trace && mpctx->opts->startup_trace[0])
+        write_startup_trace(mpctx);
+
+    mp_notify_property(mpctx, "startup-timings");
+}
+
+// Write the phases recorded so far as MPV_FORMAT_NODE_MAP to dst. Returns
+// false if nothing was recorded yet. Free dst with talloc_free(dst->u.list).
+bool get_startup_timings(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    struct mp_startup_timings *st = &mpctx->startup;
+    if (!st->num_phases)
+        return false;
+
+    node_init(dst, MPV_FORMAT_NODE_MAP, NULL);
+    if (mpctx->filename)
+        node_map_add_string(dst, "file", mpctx->filename);
+    node_map_add_flag(dst, "complete", st->done);
+    node_map_add_double(dst, "total",
+                        (st->phases[st->num_phases - 1].end - st->start) / 1e6);
+    struct mpv_node *list = node_map_add(dst, "phases", MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < st->num_phases; n++) {
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", st->phases[n].name);
+        node_map_add_double(e, "start", (phase_start(st, n) - st->start) / 1e6);
+        node_map_add_double(e, "end", (st->phases[n].end - st->start) / 1e6);
+        node_map_add_double(e, "duration",
+                            (st->phases[n].end - phase_start(st, n)) / 1e6);
+    }
+    return true;
+}
+
+/* --benchmark-mode: run demuxer and decoders without the playback core. */
+
+struct bench_stream {
+    struct sh_stream *sh;
+    struct dec_video *d_video;
+    struct dec_audio *d_audio;
+    int64_t packets, bytes;     // demux mode only
+    int64_t frames;             // decode mode only
+    int64_t decode_time;
+    bool got_data;              // packet or frame received since last seek
+    bool eof;
+};
+
+struct pipeline_bench {
+    struct MPContext *mpctx;
+    struct demuxer *demuxer;
+    bool decode;
+    struct bench_stream *streams;
+    int num_streams;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool woken;
+};
+
+static void bench_wakeup(void *ctx)
+{
+    struct pipeline_bench *b = ctx;
+    pthread_mutex_lock(&b->lock);
+    b->woken = true;
+    pthread_cond_signal(&b->wakeup);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void bench_wait(struct pipeline_bench *b)
+{
+    struct timespec ts = mp_time_us_to_timespec(mp_add_timeout(mp_time_us(), 0.1));
+    pthread_mutex_lock(&b->lock);
+    while (!b->woken) {
+        if (pthread_cond_timedwait(&b->wakeup, &b->lock, &ts))
+            break;
+    }
+    b->woken = false;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Pick the stream --vid/--aid/--sid would select (first stream for "auto",
+// except for subtitles).
+static struct sh_stream *select_stream(struct MPContext *mpctx,
+                                       struct demuxer *demuxer,
+                                       enum stream_type type)
+{
+    int id = mpctx->opts->stream_id[0][type];
+    if (id == -2 || (id == -1 && type == STREAM_SUB))
+        return NULL;
+    int index = 0;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(demuxer, n);
+        if (sh->type != type)
+            continue;
+        index++;
+        if (id == -1 || id == index)
+            return sh;
+    }
+    return NULL;
+}
+
+static bool init_decoder(struct pipeline_bench *b, struct bench_stream *s)
+{
+    struct MPContext *mpctx = b->mpctx;
+    switch (s->sh->type) {
+    case STREAM_VIDEO: {
+        struct dec_video *d = talloc_zero(NULL, struct dec_video);
+        d->global = mpctx->global;
+        d->log = mp_log_new(d, mpctx->log, "!vd");
+        d->opts = mpctx->opts;
+        d->header = s->sh;
+        d->codec = s->sh->codec;
+        d->fps = s->sh->codec->fps;
+        s->d_video = d;
+        return video_init_best_codec(d);
+    }
+    case STREAM_AUDIO: {
+        struct dec_audio *d = talloc_zero(NULL, struct dec_audio);
+        d->global = mpctx->global;
+        d->log = mp_log_new(d, mpctx->log, "!ad");
+        d->opts = mpctx->opts;
+        d->header = s->sh;
+        d->codec = s->sh->codec;
+        s->d_audio = d;
+        return audio_init_best_codec(d);
+    }
+    default:
+        return false;
+    }
+}
+
+// Read a packet or decode a frame. Returns false if no data was available.
+static bool bench_step(struct pipeline_bench *b, struct bench_stream *s)
+{
+    if (s->eof)
+        return false;
+
+    if (!b->decode) {
+        struct demux_packet *pkt;
+        int r = demux_read_packet_async(s->sh, &pkt);
+        if (pkt) {
+            s->packets++;
+            s->bytes += pkt->len;
+            s->got_data = true;
+            talloc_free(pkt);
+        }
+        s->eof = r < 0;
+        return r != 0;
+    }
+
+    int64_t start = mp_time_us();
+    int r;
+    if (s->d_video) {
+        struct mp_image *img;
+        video_work(s->d_video);
+        r = video_get_frame(s->d_video, &img);
+        talloc_free(img);
+    } else {
+        struct mp_audio *frame;
+        audio_work(s->d_audio);
+        r = audio_get_frame(s->d_audio, &frame);
+        talloc_free(frame);
+    }
+    s->decode_time += mp_time_us() - start;
+    if (r == DATA_OK) {
+        s->frames++;
+        s->got_data = true;
+    }
+    s->eof = r == DATA_EOF;
+    return r != DATA_WAIT;
+}
+
+// Process all streams until all are at EOF, or (if first_only is set) until
+// each stream has returned its first packet or frame.
+static void bench_run(struct pipeline_bench *b, bool first_only)
+{
+    while (1) {
+        bool done = true, progress = false;
+        for (int n = 0; n < b->num_streams; n++) {
+            struct bench_stream *s = &b->streams[n];
+            if (first_only && s->got_data)
+                continue;
+            progress |= bench_step(b, s);
+            done &= s->eof || (first_only && s->got_data);
+        }
+        if (done || mp_cancel_test(b->mpctx->playback_abort))
+            break;
+        if (!progress)
+            bench_wait(b);
+    }
+}
+
+static void add_stream_stats(struct pipeline_bench *b, struct mpv_node *list,
+                             struct bench_stream *s, double elapsed)
+{
+    struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(e, "type", stream_type_name(s->sh->type));
+    if (s->sh->codec->codec)
+        node_map_add_string(e, "codec", s->sh->codec->codec);
+    if (b->decode) {
+        node_map_add_int64(e, "frames", s->frames);
+        node_map_add_double(e, "decode-time", s->decode_time / 1e6);
+        node_map_add_double(e, "frames-per-second",
+                            elapsed > 0 ? s->frames / elapsed : 0);
+        MP_INFO(b->mpctx, "%s: %"PRId64" frames, %.3f s decoding, %.1f fps\n",
+                stream_type_name(s->sh->type), s->frames,
+                s->decode_time / 1e6, elapsed > 0 ? s->frames / elapsed : 0);
+    } else {
+        node_map_add_int64(e, "packets", s->packets);
+        node_map_add_int64(e, "bytes", s->bytes);
+        node_map_add_double(e, "packets-per-second",
+                            elapsed > 0 ? s->packets / elapsed : 0);
+        node_map_add_double(e, "bytes-per-second",
+                            elapsed > 0 ? s->bytes / elapsed : 0);
+        MP_INFO(b->mpctx, "%s: %"PRId64" packets, %"PRId64" bytes, "
+                "%.1f packets/s, %.3f MB/s\n", stream_type_name(s->sh->type),
+                s->packets, s->bytes, elapsed > 0 ? s->packets / elapsed : 0,
+                elapsed > 0 ? s->bytes / elapsed / 1e6 : 0);
+    }
+}
+
+static void add_seek_stats(struct pipeline_bench *b, struct mpv_node *list)
+{
+    struct MPContext *mpctx = b->mpctx;
+    const struct m_option time_opt = {.type = &m_option_type_time};
+    char **targets = mpctx->opts->benchmark_seeks;
+
+    for (int n = 0; targets && targets[n]; n++) {
+        double target = 0;
+        if (m_option_parse(mpctx->log, &time_opt, bstr0("benchmark-seeks"),
+                           bstr0(targets[n]), &target) < 0)
+            continue;
+
+        for (int i = 0; i < b->num_streams; i++) {
+            struct bench_stream *s = &b->streams[i];
+            if (s->d_video)
+                video_reset(s->d_video);
+            if (s->d_audio)
+                audio_reset_decoding(s->d_audio);
+            s->got_data = s->eof = false;
+        }
+
+        int64_t start = mp_time_us();
+        demux_seek(b->demuxer, target, SEEK_BACKWARD);
+        bench_run(b, true);
+        double latency = (mp_time_us() - start) / 1e6;
+
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_double(e, "target", target);
+        node_map_add_double(e, "latency", latency);
+        MP_INFO(mpctx, "Seek to %s: %.3f ms\n", targets[n], latency * 1e3);
+    }
+}
+
+static int bench_file(struct MPContext *mpctx, const char *filename)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct pipeline_bench *b = talloc_zero(NULL, struct pipeline_bench);
+    b->mpctx = mpctx;
+    b->decode = opts->benchmark_mode == 2;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->wakeup, NULL);
+    int ret = -1;
+
+    MP_INFO(mpctx, "Benchmarking %s\n", filename);
+
+    struct demuxer_params params = {
+        .force_format = opts->demuxer_name,
+        .allow_capture = true,
+    };
+    int64_t open_start = mp_time_us();
+    b->demuxer = demux_open_url(filename, &params, mpctx->playback_abort,
+                                mpctx->global);
+    if (!b->demuxer) {
+        MP_ERR(mpctx, "Could not open '%s'.\n", filename);
+        goto done;
+    }
+    double open_time = (mp_time_us() - open_start) / 1e6;
+
+    for (int t = 0; t < STREAM_TYPE_COUNT; t++) {
+        struct sh_stream *sh = select_stream(mpctx, b->demuxer, t);
+        if (!sh || (b->decode && t == STREAM_SUB))
+            continue;
+        MP_TARRAY_APPEND(b, b->streams, b->num_streams,
+                         (struct bench_stream){ .sh = sh });
+    }
+    for (int n = 0; n < demux_get_num_stream(b->demuxer); n++) {
+        struct sh_stream *sh = demux_get_stream(b->demuxer, n);
+        bool selected = false;
+        for (int i = 0; i < b->num_streams; i++)
+            selected |= b->streams[i].sh == sh;
+        demuxer_select_track(b->demuxer, sh, MP_NOPTS_VALUE, selected);
+    }
+    for (int n = 0; n < b->num_streams; n++) {
+        if (b->decode && !init_decoder(b, &b->streams[n])) {
+            MP_ERR(mpctx, "Could not initialize %s decoder.\n",
+                   stream_type_name(b->streams[n].sh->type));
+            goto done;
+        }
+    }
+    if (!b->num_streams) {
+        MP_ERR(mpctx, "No streams selected.\n");
+        goto done;
+    }
+
+    demux_set_wakeup_cb(b->demuxer, bench_wakeup, b);
+    demux_start_thread(b->demuxer);
+
+    int64_t start = mp_time_us();
+    bench_run(b, false);
+    double elapsed = (mp_time_us() - start) / 1e6;
+
+    struct mpv_node report;
+    node_init(&report, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_string(&report, "file", filename);
+    node_map_add_string(&report, "mode", b->decode ? "decode" : "demux");
+    node_map_add_double(&report, "open-time", open_time);
+    node_map_add_double(&report, "wall-time", elapsed);
+    MP_INFO(mpctx, "Opened in %.3f s, processed in %.3f s.\n",
+            open_time, elapsed);
+    struct mpv_node *streams = node_map_add(&report, "streams",
+                                            MPV_FORMAT_NODE_ARRAY);
+    for (int n = 0; n < b->num_streams; n++)
+        add_stream_stats(b, streams, &b->streams[n], elapsed);
+    add_seek_stats(b, node_map_add(&report, "seeks", MPV_FORMAT_NODE_ARRAY));
+    node_map_add_int64(&report, "peak-memory", get_peak_memory());
+
+    if (opts->benchmark_report && opts->benchmark_report[0])
+        write_benchmark_report(mpctx, &report);
+    talloc_free(report.u.list);
+    ret = 0;
+
+done:
+    for (int n = 0; n < b->num_streams; n++) {
+        video_uninit(b->streams[n].d_video);
+        audio_uninit(b->streams[n].d_audio);
+    }
+    free_demuxer_and_stream(b->demuxer);
+    pthread_cond_destroy(&b->wakeup);
+    pthread_mutex_destroy(&b->lock);
+    talloc_free(b);
+    return ret;
+}
+
+// Benchmark all files on the playlist with --benchmark-mode. Returns -1 if
+// any of them failed.
+int run_pipeline_benchmark(struct MPContext *mpctx)
+{
+    int ret = 0;
+    for (struct playlist_entry *e = mpctx->playlist->first; e; e = e->next) {
+        if (bench_file(mpctx, e->filename) < 0)
+            ret = -1;
+        if (mp_cancel_test(mpctx->playback_abort))
+            break;
+    }
+    return ret;
+}
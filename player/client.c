@@ -1146,6 +1146,7 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property *prop_list; // if set, name was resolved already
     mpv_format format;
     void *data;
     int status;
@@ -1160,6 +1161,69 @@ static void free_prop_data(void *ptr)
     m_option_free(type, prop->data);
 }
 
+static int getproperty_do(struct getproperty_request *req, int action,
+                          void *arg)
+{
+    if (req->prop_list)
+        return mp_property_do_list(req->prop_list, req->name, action, arg,
+                                   req->mpctx);
+    return mp_property_do(req->name, action, arg, req->mpctx);
+}
+
+// Read a scalar property directly into data, if it has a matching type. This
+// avoids creating and converting a mpv_node. Returns false if not possible.
+static bool getproperty_scalar(struct getproperty_request *req, void *data,
+                               int *err)
+{
+    struct m_option opt = {0};
+    if (getproperty_do(req, M_PROPERTY_GET_TYPE, &opt) <= 0)
+        return false;
+
+    const struct m_option_type *t = opt.type;
+    bool is_int = t == &m_option_type_int || t == &m_option_type_int64;
+    switch (req->format) {
+    case MPV_FORMAT_FLAG:
+        if (t != &m_option_type_flag)
+            return false;
+        break;
+    case MPV_FORMAT_INT64:
+        if (!is_int)
+            return false;
+        break;
+    case MPV_FORMAT_DOUBLE:
+        if (!is_int && t != &m_option_type_double && t != &m_option_type_float)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    union m_option_value val = {0};
+    *err = getproperty_do(req, M_PROPERTY_GET, &val);
+    if (*err != M_PROPERTY_OK)
+        return true;
+
+    int64_t i = t == &m_option_type_int64 ? val.int64 : val.int_;
+    switch (req->format) {
+    case MPV_FORMAT_FLAG:
+        *(int *)data = !!val.flag;
+        break;
+    case MPV_FORMAT_INT64:
+        *(int64_t *)data = i;
+        break;
+    case MPV_FORMAT_DOUBLE:
+        if (t == &m_option_type_double) {
+            *(double *)data = val.double_;
+        } else if (t == &m_option_type_float) {
+            *(double *)data = val.float_;
+        } else {
+            *(double *)data = i;
+        }
+        break;
+    }
+    return true;
+}
+
 static void getproperty_fn(void *arg)
 {
     struct getproperty_request *req = arg;
@@ -1171,27 +1235,29 @@ static void getproperty_fn(void *arg)
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_PRINT, data);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_GET_STRING, &s);
         if (err == M_PROPERTY_OK)
             *(char **)data = s;
         break;
     }
-    case MPV_FORMAT_NODE:
     case MPV_FORMAT_FLAG:
     case MPV_FORMAT_INT64:
-    case MPV_FORMAT_DOUBLE: {
+    case MPV_FORMAT_DOUBLE:
+        if (getproperty_scalar(req, data, &err))
+            break;
+        // fall through
+    case MPV_FORMAT_NODE: {
         struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
+        err = getproperty_do(req, M_PROPERTY_GET_NODE, &node);
         if (err == M_PROPERTY_NOT_IMPLEMENTED) {
             // Go through explicit string conversion. Same reasoning as on the
             // GET code path.
             char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
+            err = getproperty_do(req, M_PROPERTY_GET_STRING, &s);
             if (err != M_PROPERTY_OK)
                 break;
             node.format = MPV_FORMAT_STRING;
@@ -1253,6 +1319,69 @@ int mpv_get_property(mpv_handle *ctx, const char *name, mpv_format format,
     return req.status;
 }
 
+struct mp_client_property {
+    char *name;
+    struct m_property *prop_list;
+};
+
+struct mp_client_property *mp_client_resolve_property(void *ta_parent,
+                                                      mpv_handle *ctx,
+                                                      const char *name)
+{
+    if (!ctx->mpctx->initialized)
+        return NULL;
+
+    struct mp_client_property *prop =
+        talloc_zero(ta_parent, struct mp_client_property);
+    prop->name = talloc_strdup(prop, name);
+    lock_core(ctx);
+    prop->prop_list = mp_property_resolve(prop, ctx->mpctx, name);
+    unlock_core(ctx);
+    if (!prop->prop_list) {
+        talloc_free(prop);
+        return NULL;
+    }
+    return prop;
+}
+
+void mp_client_get_properties(mpv_handle *ctx,
+                              struct mp_client_property_get *reqs, int num)
+{
+    if (!num)
+        return;
+
+    for (int n = 0; n < num; n++) {
+        struct mp_client_property_get *r = &reqs[n];
+        r->status = 0;
+        if (!ctx->mpctx->initialized) {
+            r->status = MPV_ERROR_UNINITIALIZED;
+        } else if (!r->data || (!r->prop && !r->name)) {
+            r->status = MPV_ERROR_INVALID_PARAMETER;
+        } else if (!get_mp_type_get(r->format)) {
+            r->status = MPV_ERROR_PROPERTY_FORMAT;
+        }
+    }
+
+    // Take the core lock only once for all requests; this is the expensive
+    // part of reading a property from outside of the playback thread.
+    lock_core(ctx);
+    for (int n = 0; n < num; n++) {
+        struct mp_client_property_get *r = &reqs[n];
+        if (r->status < 0)
+            continue;
+        struct getproperty_request req = {
+            .mpctx = ctx->mpctx,
+            .name = r->prop ? r->prop->name : r->name,
+            .prop_list = r->prop ? r->prop->prop_list : NULL,
+            .format = r->format,
+            .data = r->data,
+        };
+        getproperty_fn(&req);
+        r->status = req.status;
+    }
+    unlock_core(ctx);
+}
+
 char *mpv_get_property_string(mpv_handle *ctx, const char *name)
 {
     char *str = NULL;
@@ -35,6 +35,23 @@ struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
 struct MPContext *mp_client_get_core(struct mpv_handle *ctx);
 struct MPContext *mp_client_api_get_core(struct mp_client_api *api);
 
+// Faster property reads for scripting backends. A resolved property skips the
+// name lookup, and mp_client_get_properties() locks the core only once for
+// all requests.
+struct mp_client_property;
+struct mp_client_property *mp_client_resolve_property(void *ta_parent,
+                                                      struct mpv_handle *ctx,
+                                                      const char *name);
+struct mp_client_property_get {
+    struct mp_client_property *prop;    // if NULL, use name
+    const char *name;
+    mpv_format format;
+    void *data;                         // as in mpv_get_property()
+    int status;                         // set to the mpv_error result
+};
+void mp_client_get_properties(struct mpv_handle *ctx,
+                              struct mp_client_property_get *reqs, int num);
+
 // m_option.c
 void *node_get_alloc(struct mpv_node *node);
 
@@ -36,6 +36,8 @@
 #include "common/codecs.h"
 #include "common/msg.h"
 #include "common/msg_control.h"
+#include "common/mem_budget.h"
+#include "common/global.h"
 #include "command.h"
 #include "osdep/timer.h"
 #include "common/common.h"
@@ -712,6 +714,28 @@ static int mp_property_vo_delayed_frame_count(void *ctx, struct m_property *prop
     return m_property_int_ro(action, arg, vo_get_delayed_count(mpctx->video_out));
 }
 
+static int mp_property_video_queue(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->vo_chain)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct mp_perf_stats *perf = &mpctx->perf;
+    double avg = perf->queued_vframes
+               ? perf->total_queue_wait / 1e6 / perf->queued_vframes : 0;
+    struct m_sub_property props[] = {
+        {"depth",        SUB_PROP_INT(mpctx->num_next_frames)},
+        {"render-ahead", SUB_PROP_INT(mpctx->opts->video_render_ahead)},
+        {"wait",         SUB_PROP_DOUBLE(perf->queue_wait / 1e6)},
+        {"avg-wait",     SUB_PROP_DOUBLE(avg)},
+        {"max-wait",     SUB_PROP_DOUBLE(perf->max_queue_wait / 1e6)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
 /// Current position in percent (RW)
 static int mp_property_percent_pos(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -1416,7 +1440,9 @@ static int mp_property_filter_metadata(void *ctx, struct m_property *prop,
             if (!(mpctx->ao_chain && mpctx->ao_chain->af))
                 return M_PROPERTY_UNAVAILABLE;
             struct af_stream *af = mpctx->ao_chain->af;
+            audio_thread_pause(mpctx->ao_chain);
             res = af_control_by_label(af, AF_CONTROL_GET_METADATA, &metadata, key);
+            audio_thread_resume(mpctx->ao_chain);
         }
         switch (res) {
         case CONTROL_UNKNOWN:
@@ -1625,6 +1651,82 @@ static int mp_property_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, info.idle);
 }
 
+static int mp_property_stream_read_stats(void *ctx, struct m_property *prop,
+                                         int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct stream_read_stats stats = {0};
+    if (demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_READ_STATS,
+                             &stats) != STREAM_OK)
+        return M_PROPERTY_UNAVAILABLE;
+
+    int64_t per_call = stats.calls ? stats.bytes / stats.calls : 0;
+    struct m_sub_property props[] = {
+        {"read-calls",      SUB_PROP_INT64(stats.calls)},
+        {"read-bytes",      SUB_PROP_INT64(stats.bytes)},
+        {"bytes-per-read",  SUB_PROP_INT64(per_call)},
+        {"buffer-size",     SUB_PROP_INT(stats.buffer_size)},
+        {0}
+    };
+
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_benchmark_report(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->playback_initialized)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET:
+        get_perf_stats(mpctx, arg);
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_startup_timings(void *ctx, struct m_property *prop,
+                                       int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->startup.num_phases)
+        return M_PROPERTY_UNAVAILABLE;
+
+    switch (action) {
+    case M_PROPERTY_GET:
+        if (!get_startup_timings(mpctx, arg))
+            return M_PROPERTY_UNAVAILABLE;
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+static int mp_property_memory_budget(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    switch (action) {
+    case M_PROPERTY_GET:
+        mp_mem_budget_get_info(mpctx->global->mem_budget, arg);
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_demuxer_cache_duration(void *ctx, struct m_property *prop,
                                               int action, void *arg)
 {
@@ -1693,6 +1795,15 @@ static int mp_property_cache_buffering(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, state);
 }
 
+static int mp_property_live_latency(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->playback_initialized || mpctx->live_latency == MP_NOPTS_VALUE)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, mpctx->live_latency);
+}
+
 static int mp_property_clock(void *ctx, struct m_property *prop,
                              int action, void *arg)
 {
@@ -3802,6 +3913,7 @@ static const struct m_property mp_properties_base[] = {
     {"vsync-ratio", mp_property_vsync_ratio},
     {"vo-drop-frame-count", mp_property_vo_drop_frame_count},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
+    {"video-queue", mp_property_video_queue},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
     {"time-pos", mp_property_time_pos},
@@ -3832,10 +3944,15 @@ static const struct m_property mp_properties_base[] = {
     {"cache-size", mp_property_cache_size},
     {"cache-idle", mp_property_cache_idle},
     {"cache-speed", mp_property_cache_speed},
+    {"stream-read-stats", mp_property_stream_read_stats},
+    {"benchmark-report", mp_property_benchmark_report},
+    {"startup-timings", mp_property_startup_timings},
+    {"memory-budget", mp_property_memory_budget},
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"cache-buffering-state", mp_property_cache_buffering},
+    {"live-latency", mp_property_live_latency},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"clock", mp_property_clock},
     {"seekable", mp_property_seekable},
@@ -4014,6 +4131,7 @@ static const char *const *const mp_event_property_change[] = {
       "estimated-vf-fps", "drop-frame-count", "vo-drop-frame-count",
       "total-avsync-change", "audio-speed-correction", "video-speed-correction",
       "vo-delayed-frame-count", "mistimed-frame-count", "vsync-ratio",
+      "video-queue",
       "estimated-display-fps", "vsync-jitter", "sub-text", "audio-bitrate",
       "video-bitrate", "sub-bitrate"),
     E(MPV_EVENT_VIDEO_RECONFIG, "video-out-params", "video-params",
@@ -4143,6 +4261,37 @@ int mp_property_do(const char *name, int action, void *val,
     return r;
 }
 
+// Look up the property name refers to (for sub-properties like "a/b", this is
+// the top-level property "a"), and return a property list containing only this
+// entry. Passing it to mp_property_do_list() avoids searching the full property
+// list on every access. Returns NULL if there is no such property.
+struct m_property *mp_property_resolve(void *ta_parent, struct MPContext *ctx,
+                                       const char *name)
+{
+    struct command_ctx *cmd = ctx->command_ctx;
+    bstr base;
+    char *rem;
+    m_property_split_path(name, &base, &rem);
+    for (int n = 0; cmd->properties[n].name; n++) {
+        if (bstr_equals0(base, cmd->properties[n].name)) {
+            struct m_property *list =
+                talloc_zero_array(ta_parent, struct m_property, 2);
+            list[0] = cmd->properties[n];
+            return list;
+        }
+    }
+    return NULL;
+}
+
+// Like mp_property_do(), but with a list returned by mp_property_resolve().
+// Only for reading properties.
+int mp_property_do_list(const struct m_property *list, const char *name,
+                        int action, void *val, struct MPContext *ctx)
+{
+    assert(!is_property_set(action, val));
+    return m_property_do(ctx->log, list, name, action, val, ctx);
+}
+
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
@@ -5353,11 +5502,15 @@ int run_command(struct MPContext *mpctx, struct mp_cmd *cmd, struct mpv_node *re
         return vf_send_command(mpctx->vo_chain->vf, cmd->args[0].v.s,
                                cmd->args[1].v.s, cmd->args[2].v.s);
 
-    case MP_CMD_AF_COMMAND:
+    case MP_CMD_AF_COMMAND: {
         if (!mpctx->ao_chain)
             return -1;
-        return af_send_command(mpctx->ao_chain->af, cmd->args[0].v.s,
-                               cmd->args[1].v.s, cmd->args[2].v.s);
+        audio_thread_pause(mpctx->ao_chain);
+        int r = af_send_command(mpctx->ao_chain->af, cmd->args[0].v.s,
+                                cmd->args[1].v.s, cmd->args[2].v.s);
+        audio_thread_resume(mpctx->ao_chain);
+        return r;
+    }
 
     case MP_CMD_SCRIPT_BINDING: {
         mpv_event_client_message event = {0};
@@ -5692,6 +5845,11 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags)
 
     if (flags & UPDATE_SCREENSAVER)
         update_screensaver_state(mpctx);
+
+    if (flags & UPDATE_MEMORY) {
+        mp_mem_budget_set_limit(mpctx->global->mem_budget,
+                                mpctx->opts->memory_budget * 1024LL * 1024);
+    }
 }
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
@@ -25,6 +25,7 @@ struct mp_cmd;
 struct mp_log;
 struct mpv_node;
 struct m_config_option;
+struct m_property;
 
 void command_init(struct MPContext *mpctx);
 void command_uninit(struct MPContext *mpctx);
@@ -35,6 +36,10 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx);
 int mp_property_do(const char* name, int action, void* val,
                    struct MPContext *mpctx);
+struct m_property *mp_property_resolve(void *ta_parent, struct MPContext *ctx,
+                                       const char *name);
+int mp_property_do_list(const struct m_property *list, const char *name,
+                        int action, void *val, struct MPContext *ctx);
 
 int mp_on_set_option(void *ctx, struct m_config_option *co, void *data, int flags);
 void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags);
@@ -85,6 +85,7 @@ enum seek_precision {
 enum seek_flags {
     MPSEEK_FLAG_DELAY = 1 << 0, // give player chance to coalesce multiple seeks
     MPSEEK_FLAG_NOFLUSH = 1 << 1, // keeping remaining data for seamless loops
+    MPSEEK_FLAG_NOCACHE = 1 << 2, // always seek, even if the frame is cached
 };
 
 enum video_sync {
@@ -203,6 +204,9 @@ struct ao_chain {
     struct track *track;
     struct lavfi_pad *filter_src;
     struct dec_audio *audio_src;
+
+    // If set, decoding and filtering run on this thread (--audio-thread-buffer).
+    struct audio_thread *thread;
 };
 
 /* Note that playback can be paused, stopped, etc. at any time. While paused,
@@ -223,6 +227,36 @@ enum playback_status {
 
 #define NUM_PTRACKS 2
 
+// Maximum value of --video-render-ahead.
+#define MAX_RENDER_AHEAD 32
+
+// Per-file processing statistics (see benchmark.c).
+struct mp_perf_stats {
+    int64_t start_time;         // mp_time_us() when the file was loaded
+    int64_t decoded_vframes;
+    int64_t decode_time;        // time spent in the video decoder (us)
+    int64_t filter_time;        // time spent in the video filter chain (us)
+    int peak_vo_queue;          // highest number of frames queued for the VO
+    int64_t queue_wait;         // time the last shown frame was queued (us)
+    int64_t max_queue_wait;
+    int64_t total_queue_wait;
+    int64_t queued_vframes;     // number of frames queue_wait was summed for
+};
+
+// A startup phase; it starts where the previous phase ended (see benchmark.c).
+struct mp_startup_phase {
+    const char *name;           // static string
+    int64_t end;                // mp_time_us() when the phase ended
+};
+
+struct mp_startup_timings {
+    int64_t start;              // mp_time_us() at mp_initialize() or file start
+    struct mp_startup_phase *phases;
+    int num_phases;
+    bool file_started;          // play_current_file() was entered before
+    bool done;                  // playback started; no more phases recorded
+};
+
 typedef struct MPContext {
     bool initialized;
     bool autodetach;
@@ -277,6 +311,9 @@ typedef struct MPContext {
 
     // Current file statistics
     int64_t shown_vframes, shown_aframes;
+    struct mp_perf_stats perf;
+    bool perf_report_written;   // --benchmark-report was created already
+    struct mp_startup_timings startup;
 
     struct demux_chapter *chapters;
     int num_chapters;
@@ -304,8 +341,10 @@ typedef struct MPContext {
 
     struct vo *video_out;
     // next_frame[0] is the next frame, next_frame[1] the one after that.
-    // The +1 is for adding 1 additional frame in backstep mode.
-    struct mp_image *next_frames[VO_MAX_REQ_FRAMES + 1];
+    // The +1 is for adding 1 additional frame in backstep mode. Frames after
+    // the ones requested by the VO are decoded ahead (--video-render-ahead).
+    struct mp_image *next_frames[VO_MAX_REQ_FRAMES + MAX_RENDER_AHEAD + 1];
+    int64_t next_frames_time[VO_MAX_REQ_FRAMES + MAX_RENDER_AHEAD + 1];
     int num_next_frames;
     struct mp_image *saved_frame;   // for hrseek_lastframe and hrseek_backstep
 
@@ -314,6 +353,9 @@ typedef struct MPContext {
     // Factors to multiply with opts->playback_speed to get the total audio or
     // video speed (usually 1.0, but can be set to by the sync code).
     double speed_factor_v, speed_factor_a;
+    // Extra factor applied to both audio and video speed while catching up
+    // with a live source (--latency-target). 1.0 if inactive.
+    double speed_factor_latency;
     // Redundant values set from opts->playback_speed and speed_factor_*.
     // update_playback_speed() updates them from the other fields.
     double audio_speed, video_speed;
@@ -355,6 +397,15 @@ typedef struct MPContext {
     double last_vo_pts;
     // Video PTS, or audio PTS if video has ended.
     double playback_pts;
+    // Recently displayed frames (--video-frame-cache), and its share of the
+    // global memory budget.
+    struct mp_frame_cache *frame_cache;
+    struct mp_mem_client *frame_cache_mem;
+    // If not MP_NOPTS_VALUE, the VO shows the cached frame with this PTS,
+    // which is before video_pts. Decoders and audio are still at video_pts.
+    double frame_cache_pts;
+    // Value of d_video->dropped_frames when the last frame was cached.
+    int frame_cache_drops;
     // audio stats only
     int64_t audio_stat_start;
     double written_audio;
@@ -413,6 +464,10 @@ typedef struct MPContext {
     double cache_stop_time, cache_wait_time;
     int cache_buffer;
 
+    // Time between the newest demuxed packet and the current playback
+    // position (MP_NOPTS_VALUE if unknown).
+    double live_latency;
+
     // Set after showing warning about decoding being too slow for realtime
     // playback rate. Used to avoid showing it multiple times.
     bool drop_message_shown;
@@ -436,8 +491,12 @@ int reinit_audio_filters(struct MPContext *mpctx);
 double playing_audio_pts(struct MPContext *mpctx);
 void fill_audio_out_buffers(struct MPContext *mpctx);
 double written_audio_pts(struct MPContext *mpctx);
+void audio_thread_pause(struct ao_chain *ao_c);
+void audio_thread_resume(struct ao_chain *ao_c);
+void audio_stop_direct_output(struct MPContext *mpctx);
 void clear_audio_output_buffers(struct MPContext *mpctx);
 void update_playback_speed(struct MPContext *mpctx);
+double get_base_playback_speed(struct MPContext *mpctx);
 void uninit_audio_out(struct MPContext *mpctx);
 void uninit_audio_chain(struct MPContext *mpctx);
 int init_audio_decoder(struct MPContext *mpctx, struct track *track);
@@ -446,6 +505,16 @@ void audio_update_volume(struct MPContext *mpctx);
 void audio_update_balance(struct MPContext *mpctx);
 void reload_audio_output(struct MPContext *mpctx);
 
+// benchmark.c
+void reset_perf_stats(struct MPContext *mpctx);
+void get_perf_stats(struct MPContext *mpctx, struct mpv_node *dst);
+void write_perf_report(struct MPContext *mpctx);
+int run_pipeline_benchmark(struct MPContext *mpctx);
+void reset_startup_timings(struct MPContext *mpctx);
+void add_startup_phase(struct MPContext *mpctx, const char *name, int64_t end);
+void finish_startup_timings(struct MPContext *mpctx);
+bool get_startup_timings(struct MPContext *mpctx, struct mpv_node *dst);
+
 // configfiles.c
 void mp_parse_cfgfiles(struct MPContext *mpctx);
 void mp_load_auto_profiles(struct MPContext *mpctx);
@@ -573,6 +642,8 @@ int reinit_video_chain_src(struct MPContext *mpctx, struct lavfi_pad *src);
 int reinit_video_filters(struct MPContext *mpctx);
 void write_video(struct MPContext *mpctx);
 void mp_force_video_refresh(struct MPContext *mpctx);
+bool video_step_cached(struct MPContext *mpctx, int dir);
+bool video_seek_cached(struct MPContext *mpctx, double pts);
 void uninit_video_out(struct MPContext *mpctx);
 void uninit_video_chain(struct MPContext *mpctx);
 double calc_average_frame_duration(struct MPContext *mpctx);
@@ -22,6 +22,7 @@
 #include <inttypes.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/avstring.h>
 #include <libavutil/mem.h>
@@ -35,6 +36,7 @@
 #include "common/common.h"
 #include "common/av_common.h"
 #include "common/msg.h"
+#include "osdep/threads.h"
 
 #include "audio/audio.h"
 #include "video/mp_image.h"
@@ -64,8 +66,29 @@ struct lavfi {
     // Filter can't be put into a working state.
     bool failed;
 
+    // Incremented each time the graph makes progress (frames passed in or
+    // out, EOF signaled, graph (re)created).
+    uint64_t progress;
+
     struct lavfi_pad **pads;
     int num_pads;
+
+    // -- threaded mode (see lavfi_start_thread())
+    //    The graph and all fields above are owned by the filter thread. The
+    //    fields below and the pad queues are protected by the lock.
+
+    int queue_frames;   // max. frames per pad queue; 0 if not threaded
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_ctx;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool thread_exit;   // filter thread should terminate
+    bool thread_work;   // caller changed state, filter thread should run
+    bool thread_busy;   // filter thread is processing the graph unlocked
+    bool queue_failed;  // copy of failed
+    bool queue_more;    // caller can send more input right away
 };
 
 struct lavfi_pad {
@@ -103,6 +126,17 @@ struct lavfi_pad {
 
     bool output_needed; // caller has signaled it needs new output
     bool output_eof;    // last filter output was EOF
+
+    // -- threaded mode, protected by lavfi.lock
+
+    // Frames passed between caller and filter thread (mp_image or mp_audio,
+    // depending on type).
+    void **queue;
+    int num_queue;
+    bool queue_connected;   // connected as set by the caller
+    int queue_status;   // dir==LAVFI_IN: status sent by caller (0 if none)
+    bool queue_request; // dir==LAVFI_IN: graph is blocked on this pad
+    bool queue_eof;     // dir==LAVFI_OUT: output_eof as seen by the caller
 };
 
 static void add_pad(struct lavfi *c, enum lavfi_direction dir, AVFilterInOut *item)
@@ -217,15 +251,37 @@ static void drop_pad_data(struct lavfi_pad *pad)
 
 static void clear_data(struct lavfi *c)
 {
-    for (int n = 0; n < c->num_pads; n++)
-        drop_pad_data(c->pads[n]);
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        drop_pad_data(pad);
+        for (int i = 0; i < pad->num_queue; i++)
+            talloc_free(pad->queue[i]);
+        pad->num_queue = 0;
+        pad->queue_status = 0;
+        pad->queue_request = false;
+        pad->queue_eof = false;
+    }
+    c->queue_more = false;
 }
 
 void lavfi_seek_reset(struct lavfi *c)
 {
+    if (c->queue_frames) {
+        pthread_mutex_lock(&c->lock);
+        while (c->thread_busy)
+            pthread_cond_wait(&c->wakeup, &c->lock);
+    }
+
     free_graph(c);
     clear_data(c);
     precreate_graph(c);
+
+    if (c->queue_frames) {
+        c->queue_failed = c->failed;
+        c->thread_work = true;
+        pthread_cond_broadcast(&c->wakeup);
+        pthread_mutex_unlock(&c->lock);
+    }
 }
 
 struct lavfi *lavfi_create(struct mp_log *log, char *graph_string)
@@ -239,6 +295,15 @@ struct lavfi *lavfi_create(struct mp_log *log, char *graph_string)
 
 void lavfi_destroy(struct lavfi *c)
 {
+    if (c->queue_frames) {
+        pthread_mutex_lock(&c->lock);
+        c->thread_exit = true;
+        pthread_cond_broadcast(&c->wakeup);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->thread, NULL);
+        pthread_cond_destroy(&c->wakeup);
+        pthread_mutex_destroy(&c->lock);
+    }
     free_graph(c);
     clear_data(c);
     talloc_free(c);
@@ -265,12 +330,28 @@ enum stream_type lavfi_pad_type(struct lavfi_pad *pad)
 
 void lavfi_set_connected(struct lavfi_pad *pad, bool connected)
 {
-    pad->connected = connected;
+    struct lavfi *c = pad->main;
+    if (!c->queue_frames) {
+        pad->connected = connected;
+        return;
+    }
+    // The filter thread picks it up in queue_to_graph().
+    pthread_mutex_lock(&c->lock);
+    pad->queue_connected = connected;
+    c->thread_work = true;
+    pthread_cond_broadcast(&c->wakeup);
+    pthread_mutex_unlock(&c->lock);
 }
 
 bool lavfi_get_connected(struct lavfi_pad *pad)
 {
-    return pad->connected;
+    struct lavfi *c = pad->main;
+    if (!c->queue_frames)
+        return pad->connected;
+    pthread_mutex_lock(&c->lock);
+    bool connected = pad->queue_connected;
+    pthread_mutex_unlock(&c->lock);
+    return connected;
 }
 
 // Ensure to send EOF to each input pad, so the graph can be drained properly.
@@ -285,6 +366,7 @@ static void send_global_eof(struct lavfi *c)
             MP_FATAL(c, "could not send EOF to filter\n");
 
         pad->buffer_is_eof = true;
+        c->progress++;
     }
 }
 
@@ -468,6 +550,7 @@ static void init_graph(struct lavfi *c)
         }
 
         c->initialized = true;
+        c->progress++;
 
         dump_graph(c);
     }
@@ -528,6 +611,7 @@ static void feed_input_pads(struct lavfi *c)
         if (av_buffersrc_add_frame(pad->buffer, frame) < 0)
             MP_FATAL(c, "could not pass frame to filter\n");
         av_frame_free(&frame);
+        c->progress++;
 
         pad->input_again = false;
         pad->input_eof = eof;
@@ -559,6 +643,7 @@ static void read_output_pads(struct lavfi *c)
         if (!pad->buffer_is_eof)
             r = av_buffersink_get_frame(pad->buffer, pad->tmp_frame);
         if (r >= 0) {
+            c->progress++;
             pad->output_needed = false;
             double pts = mp_pts_from_av(pad->tmp_frame->pts, &pad->timebase);
             if (pad->type == STREAM_AUDIO) {
@@ -583,6 +668,8 @@ static void read_output_pads(struct lavfi *c)
             // input pads (via av_buffersrc_get_nb_failed_requests()).
             pad->output_eof = false;
         } else if (r == AVERROR_EOF) {
+            if (!pad->buffer_is_eof)
+                c->progress++;
             pad->buffer_is_eof = true;
             if (!c->draining_recover_eof && !c->draining_new_format)
                 pad->output_eof = true;
@@ -593,10 +680,7 @@ static void read_output_pads(struct lavfi *c)
     }
 }
 
-// Process filter input and outputs. Return if progress was made (then the
-// caller should repeat). If it returns false, the caller should go to sleep
-// (as all inputs are asleep as well and no further output can be produced).
-bool lavfi_process(struct lavfi *c)
+static bool process_graph(struct lavfi *c)
 {
     check_format_changes(c);
 
@@ -631,6 +715,7 @@ bool lavfi_process(struct lavfi *c)
     if (all_lavfi_eof && !all_input_eof) {
         free_graph(c);
         precreate_graph(c);
+        c->progress++;
         all_waiting = false;
         any_needs_input = true;
     }
@@ -639,9 +724,179 @@ bool lavfi_process(struct lavfi *c)
     return (any_needs_input || any_needs_output) && !all_waiting;
 }
 
+static void set_pending(struct lavfi_pad *pad, void *frame)
+{
+    if (pad->type == STREAM_AUDIO) {
+        assert(!pad->pending_a);
+        pad->pending_a = frame;
+    } else {
+        assert(!pad->pending_v);
+        pad->pending_v = frame;
+    }
+    pad->input_waiting = pad->input_again = pad->input_eof = false;
+    pad->input_needed = false;
+}
+
+static void set_status(struct lavfi_pad *pad, int status)
+{
+    pad->input_waiting = status == DATA_WAIT || status == DATA_EOF;
+    pad->input_again = status == DATA_AGAIN;
+    pad->input_eof = status == DATA_EOF;
+}
+
+// Move data queued by the caller into the graph's pending slots, and request
+// as much output as the output queues can hold. Called with lock held.
+// Returns whether space in an input queue became free.
+static bool queue_to_graph(struct lavfi *c)
+{
+    bool consumed = false;
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        pad->connected = pad->queue_connected;
+        bool pending = pad->pending_a || pad->pending_v;
+        if (pad->dir == LAVFI_IN) {
+            if (pending)
+                continue;
+            if (pad->num_queue) {
+                set_pending(pad, pad->queue[0]);
+                MP_TARRAY_REMOVE_AT(pad->queue, pad->num_queue, 0);
+                consumed = true;
+            } else if (pad->queue_status && pad->input_needed) {
+                set_status(pad, pad->queue_status);
+                pad->queue_status = 0;
+            }
+        } else if (pad->dir == LAVFI_OUT) {
+            pad->output_needed = !pending && pad->num_queue < c->queue_frames;
+        }
+    }
+    return consumed;
+}
+
+// Move filtered frames to the output queues, and publish the graph state.
+// Called with lock held. Returns whether the caller should be woken up.
+static bool graph_to_queue(struct lavfi *c)
+{
+    bool notify = c->queue_failed != c->failed;
+    c->queue_failed = c->failed;
+    for (int n = 0; n < c->num_pads; n++) {
+        struct lavfi_pad *pad = c->pads[n];
+        if (pad->dir == LAVFI_IN) {
+            bool request = pad->input_needed && !pad->pending_a &&
+                           !pad->pending_v && !pad->num_queue;
+            notify |= request && !pad->queue_request;
+            pad->queue_request = request;
+        } else if (pad->dir == LAVFI_OUT) {
+            void *frame = pad->type == STREAM_AUDIO ? (void *)pad->pending_a
+                                                    : (void *)pad->pending_v;
+            if (frame) {
+                MP_TARRAY_APPEND(pad, pad->queue, pad->num_queue, frame);
+                pad->pending_a = NULL;
+                pad->pending_v = NULL;
+                notify = true;
+            }
+            notify |= pad->queue_eof != pad->output_eof;
+            pad->queue_eof = pad->output_eof;
+        }
+    }
+    return notify;
+}
+
+static void *lavfi_thread(void *ptr)
+{
+    struct lavfi *c = ptr;
+
+    mpthread_set_name("lavfi");
+
+    pthread_mutex_lock(&c->lock);
+    while (!c->thread_exit) {
+        if (!c->thread_work) {
+            pthread_cond_wait(&c->wakeup, &c->lock);
+            continue;
+        }
+        c->thread_work = false;
+
+        bool notify = queue_to_graph(c);
+
+        uint64_t progress = c->progress;
+        c->thread_busy = true;
+        pthread_mutex_unlock(&c->lock);
+
+        process_graph(c);
+
+        pthread_mutex_lock(&c->lock);
+        c->thread_busy = false;
+        pthread_cond_broadcast(&c->wakeup);
+
+        notify |= graph_to_queue(c);
+        // Keep going as long as the graph moves; otherwise sleep until the
+        // caller sends input or consumes output.
+        if (c->progress != progress)
+            c->thread_work = true;
+
+        if (notify) {
+            pthread_mutex_unlock(&c->lock);
+            c->wakeup_cb(c->wakeup_ctx);
+            pthread_mutex_lock(&c->lock);
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+// Run the filter graph on a separate thread. Each pad gets a queue that can
+// buffer up to queue_frames frames. wakeup_cb is called from the filter
+// thread whenever new output is available, or the graph wants new input.
+// Must be called after all pads have been connected.
+void lavfi_start_thread(struct lavfi *c, int queue_frames,
+                        void (*wakeup_cb)(void *ctx), void *ctx)
+{
+    assert(!c->queue_frames);
+    if (queue_frames < 1)
+        return;
+
+    c->queue_frames = queue_frames;
+    c->wakeup_cb = wakeup_cb;
+    c->wakeup_ctx = ctx;
+    c->queue_failed = c->failed;
+    c->thread_work = true;
+    for (int n = 0; n < c->num_pads; n++)
+        c->pads[n]->queue_connected = c->pads[n]->connected;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wakeup, NULL);
+    if (pthread_create(&c->thread, NULL, lavfi_thread, c)) {
+        MP_ERR(c, "could not create filter thread\n");
+        pthread_cond_destroy(&c->wakeup);
+        pthread_mutex_destroy(&c->lock);
+        c->queue_frames = 0;
+    }
+}
+
+// Process filter input and outputs. Return if progress was made (then the
+// caller should repeat). If it returns false, the caller should go to sleep
+// (as all inputs are asleep as well and no further output can be produced).
+bool lavfi_process(struct lavfi *c)
+{
+    if (!c->queue_frames)
+        return process_graph(c);
+
+    // The filter thread does the actual work, and wakes up the caller. Only
+    // tell it to come back if more input can be queued immediately.
+    pthread_mutex_lock(&c->lock);
+    bool more = c->queue_more;
+    c->queue_more = false;
+    pthread_mutex_unlock(&c->lock);
+    return more;
+}
+
 bool lavfi_has_failed(struct lavfi *c)
 {
-    return c->failed;
+    if (!c->queue_frames)
+        return c->failed;
+
+    pthread_mutex_lock(&c->lock);
+    bool failed = c->queue_failed;
+    pthread_mutex_unlock(&c->lock);
+    return failed;
 }
 
 // Request an output frame on this output pad.
@@ -655,7 +910,7 @@ static int lavfi_request_frame(struct lavfi_pad *pad)
 
     if (!(pad->pending_a || pad->pending_v)) {
         pad->output_needed = true;
-        lavfi_process(pad->main);
+        process_graph(pad->main);
     }
 
     if (pad->pending_a || pad->pending_v) {
@@ -673,8 +928,38 @@ static int lavfi_request_frame(struct lavfi_pad *pad)
 //      DATA_AGAIN: needs more input data
 //      DATA_WAIT: needs more input data, and all inputs in LAVFI_WAIT state
 //      DATA_EOF: no more data
+// Threaded variant of lavfi_request_frame(). Returns the frame in *out.
+static int lavfi_request_queued_frame(struct lavfi_pad *pad, void **out)
+{
+    struct lavfi *c = pad->main;
+    assert(pad->dir == LAVFI_OUT);
+
+    int r = DATA_WAIT; // filter thread will wake us up
+    pthread_mutex_lock(&c->lock);
+    if (c->queue_failed) {
+        r = DATA_EOF;
+    } else if (pad->num_queue) {
+        *out = pad->queue[0];
+        MP_TARRAY_REMOVE_AT(pad->queue, pad->num_queue, 0);
+        c->thread_work = true;
+        pthread_cond_broadcast(&c->wakeup);
+        r = DATA_OK;
+    } else if (pad->queue_eof) {
+        r = DATA_EOF;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return r;
+}
+
 int lavfi_request_frame_a(struct lavfi_pad *pad, struct mp_audio **out_aframe)
 {
+    if (pad->main->queue_frames) {
+        void *frame = NULL;
+        int r = lavfi_request_queued_frame(pad, &frame);
+        *out_aframe = frame;
+        return r;
+    }
+
     int r = lavfi_request_frame(pad);
     *out_aframe = pad->pending_a;
     pad->pending_a = NULL;
@@ -684,6 +969,13 @@ int lavfi_request_frame_a(struct lavfi_pad *pad, struct mp_audio **out_aframe)
 // See lavfi_request_frame_a() for remarks.
 int lavfi_request_frame_v(struct lavfi_pad *pad, struct mp_image **out_vframe)
 {
+    if (pad->main->queue_frames) {
+        void *frame = NULL;
+        int r = lavfi_request_queued_frame(pad, &frame);
+        *out_vframe = frame;
+        return r;
+    }
+
     int r = lavfi_request_frame(pad);
     *out_vframe = pad->pending_v;
     pad->pending_v = NULL;
@@ -692,8 +984,19 @@ int lavfi_request_frame_v(struct lavfi_pad *pad, struct mp_image **out_vframe)
 
 bool lavfi_needs_input(struct lavfi_pad *pad)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
-    lavfi_process(pad->main);
+
+    if (c->queue_frames) {
+        // Read ahead until the queue is full, or the caller reported EOF.
+        pthread_mutex_lock(&c->lock);
+        bool r = pad->queue_request || (pad->num_queue < c->queue_frames &&
+                                        pad->queue_status != DATA_EOF);
+        pthread_mutex_unlock(&c->lock);
+        return r;
+    }
+
+    process_graph(c);
     return pad->input_needed;
 }
 
@@ -707,40 +1010,60 @@ bool lavfi_needs_input(struct lavfi_pad *pad)
 // allowed.
 void lavfi_send_status(struct lavfi_pad *pad, int status)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
-    assert(pad->input_needed);
     assert(status != DATA_OK);
-    assert(!pad->pending_v && !pad->pending_a);
 
-    pad->input_waiting = status == DATA_WAIT || status == DATA_EOF;
-    pad->input_again = status == DATA_AGAIN;
-    pad->input_eof = status == DATA_EOF;
+    if (c->queue_frames) {
+        // Applied by the filter thread once the queued frames are consumed.
+        pthread_mutex_lock(&c->lock);
+        if (pad->queue_status != status || pad->queue_request) {
+            pad->queue_status = status;
+            pad->queue_request = false;
+            c->thread_work = true;
+            pthread_cond_broadcast(&c->wakeup);
+        }
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+
+    assert(pad->input_needed);
+    assert(!pad->pending_v && !pad->pending_a);
+    set_status(pad, status);
 }
 
-static void lavfi_sent_frame(struct lavfi_pad *pad)
+static void lavfi_send_frame(struct lavfi_pad *pad, void *frame)
 {
+    struct lavfi *c = pad->main;
     assert(pad->dir == LAVFI_IN);
+
+    if (c->queue_frames) {
+        pthread_mutex_lock(&c->lock);
+        MP_TARRAY_APPEND(pad, pad->queue, pad->num_queue, frame);
+        pad->queue_status = 0;
+        pad->queue_request = false;
+        c->queue_more |= pad->num_queue < c->queue_frames;
+        c->thread_work = true;
+        pthread_cond_broadcast(&c->wakeup);
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+
     assert(pad->input_needed);
-    assert(pad->pending_a || pad->pending_v);
-    pad->input_waiting = pad->input_again = pad->input_eof = false;
-    pad->input_needed = false;
+    set_pending(pad, frame);
 }
 
 // See lavfi_send_status() for remarks.
 void lavfi_send_frame_a(struct lavfi_pad *pad, struct mp_audio *aframe)
 {
     assert(pad->type == STREAM_AUDIO);
-    assert(!pad->pending_a);
-    pad->pending_a = aframe;
-    lavfi_sent_frame(pad);
+    lavfi_send_frame(pad, aframe);
 }
 
 // See lavfi_send_status() for remarks.
 void lavfi_send_frame_v(struct lavfi_pad *pad, struct mp_image *vframe)
 {
     assert(pad->type == STREAM_VIDEO);
-    assert(!pad->pending_v);
-    pad->pending_v = vframe;
-    lavfi_sent_frame(pad);
+    lavfi_send_frame(pad, vframe);
 }
 
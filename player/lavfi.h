@@ -14,6 +14,8 @@ enum lavfi_direction {
 
 struct lavfi *lavfi_create(struct mp_log *log, char *graph_string);
 void lavfi_destroy(struct lavfi *c);
+void lavfi_start_thread(struct lavfi *c, int queue_frames,
+                        void (*wakeup_cb)(void *ctx), void *ctx);
 struct lavfi_pad *lavfi_find_pad(struct lavfi *c, char *name);
 enum lavfi_direction lavfi_pad_direction(struct lavfi_pad *pad);
 enum stream_type lavfi_pad_type(struct lavfi_pad *pad);
@@ -783,6 +783,7 @@ struct demux_open_args {
     // results
     struct demuxer *demux;
     int err;
+    int64_t stream_open_time, cache_init_time;
 };
 
 static void open_demux_thread(void *pctx)
@@ -795,6 +796,8 @@ static void open_demux_thread(void *pctx)
         .stream_flags = args->stream_flags,
     };
     args->demux = demux_open_url(args->url, &p, args->cancel, global);
+    args->stream_open_time = p.stream_open_time;
+    args->cache_init_time = p.cache_init_time;
     if (!args->demux) {
         if (p.demuxer_failed) {
             args->err = MPV_ERROR_UNKNOWN_FORMAT;
@@ -818,6 +821,11 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     if (mpctx->opts->load_unsafe_playlists)
         args.stream_flags = 0;
     mpctx_run_reentrant(mpctx, open_demux_thread, &args);
+    if (args.stream_open_time)
+        add_startup_phase(mpctx, "open-stream", args.stream_open_time);
+    if (args.cache_init_time)
+        add_startup_phase(mpctx, "stream-cache", args.cache_init_time);
+    add_startup_phase(mpctx, "open-demuxer", mp_time_us());
     if (args.demux) {
         mpctx->demuxer = args.demux;
         enable_demux_thread(mpctx, mpctx->demuxer);
@@ -886,6 +894,9 @@ static bool init_complex_filters(struct MPContext *mpctx)
         reinit_audio_chain_src(mpctx, pad);
     }
 
+    lavfi_start_thread(mpctx->lavfi, mpctx->opts->lavfi_complex_queue,
+                       mp_wakeup_core_cb, mpctx);
+
     return true;
 }
 
@@ -963,11 +974,14 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->max_frames = -1;
     mpctx->video_speed = mpctx->audio_speed = opts->playback_speed;
     mpctx->speed_factor_a = mpctx->speed_factor_v = 1.0;
+    mpctx->speed_factor_latency = 1.0;
+    mpctx->live_latency = MP_NOPTS_VALUE;
     mpctx->display_sync_error = 0.0;
     mpctx->display_sync_active = false;
     mpctx->seek = (struct seek_params){ 0 };
 
     reset_playback_state(mpctx);
+    reset_startup_timings(mpctx);
 
     mpctx->playing = mpctx->playlist->current;
     if (!mpctx->playing || !mpctx->playing->filename)
@@ -992,6 +1006,8 @@ static void play_current_file(struct MPContext *mpctx)
         }
     }
 
+    add_startup_phase(mpctx, "start-file", mp_time_us());
+
     mp_load_auto_profiles(mpctx);
 
     mp_load_playback_resume(mpctx, mpctx->filename);
@@ -1001,6 +1017,8 @@ static void play_current_file(struct MPContext *mpctx)
 
     mpctx->max_frames = opts->play_frames;
 
+    add_startup_phase(mpctx, "file-options", mp_time_us());
+
     handle_force_window(mpctx, false);
 
     MP_INFO(mpctx, "Playing: %s\n", mpctx->filename);
@@ -1012,6 +1030,8 @@ reopen_file:
     if (process_open_hooks(mpctx) < 0)
         goto terminate_playback;
 
+    add_startup_phase(mpctx, "open-hooks", mp_time_us());
+
     if (opts->stream_dump && opts->stream_dump[0]) {
         if (stream_dump(mpctx, mpctx->stream_open_filename) >= 0)
             mpctx->error_playing = 1;
@@ -1046,6 +1066,8 @@ reopen_file:
     open_external_files(mpctx, opts->external_files, STREAM_TYPE_COUNT);
     autoload_external_files(mpctx);
 
+    add_startup_phase(mpctx, "external-files", mp_time_us());
+
     check_previous_track_selection(mpctx);
 
     if (process_preloaded_hooks(mpctx))
@@ -1085,6 +1107,8 @@ reopen_file:
 
     update_demuxer_properties(mpctx);
 
+    add_startup_phase(mpctx, "track-selection", mp_time_us());
+
 #if HAVE_ENCODING
     if (mpctx->encode_lavc_ctx && mpctx->current_track[0][STREAM_VIDEO])
         encode_lavc_expect_stream(mpctx->encode_lavc_ctx, AVMEDIA_TYPE_VIDEO);
@@ -1102,8 +1126,11 @@ reopen_file:
         goto terminate_playback;
 
     reinit_video_chain(mpctx);
+    add_startup_phase(mpctx, "video-decoder-init", mp_time_us());
     reinit_audio_chain(mpctx);
+    add_startup_phase(mpctx, "audio-decoder-init", mp_time_us());
     reinit_sub_all(mpctx);
+    add_startup_phase(mpctx, "subtitle-init", mp_time_us());
 
     if (!mpctx->vo_chain && !mpctx->ao_chain) {
         MP_FATAL(mpctx, "No video or audio streams selected.\n");
@@ -1122,6 +1149,7 @@ reopen_file:
     MP_VERBOSE(mpctx, "Starting playback...\n");
 
     mpctx->playback_initialized = true;
+    reset_perf_stats(mpctx);
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
     update_screensaver_state(mpctx);
 
@@ -1160,6 +1188,9 @@ terminate_playback:
 
     process_unload_hooks(mpctx);
 
+    if (mpctx->playback_initialized)
+        write_perf_report(mpctx);
+
     if (mpctx->stop_play == KEEP_PLAYING)
         mpctx->stop_play = AT_END_OF_FILE;
 
@@ -921,6 +921,166 @@ static mpv_format check_property_format(lua_State *L, int arg)
     abort();
 }
 
+union prop_value {
+    int flag;
+    double d;
+    char *s;
+    mpv_node node;
+};
+
+// Make tmp own the memory of a value returned by mp_client_get_properties(),
+// so that it's freed even if pushing it to Lua fails.
+static void steal_prop_value(void *tmp, mpv_format format, union prop_value *v)
+{
+    if (format == MPV_FORMAT_STRING)
+        talloc_steal(tmp, v->s);
+    if (format == MPV_FORMAT_NODE)
+        auto_free_node(tmp, &v->node);
+}
+
+static void push_prop_value(lua_State *L, mpv_format format,
+                            union prop_value *v)
+{
+    switch (format) {
+    case MPV_FORMAT_FLAG:
+        lua_pushboolean(L, !!v->flag);
+        break;
+    case MPV_FORMAT_DOUBLE:
+        lua_pushnumber(L, v->d);
+        break;
+    case MPV_FORMAT_STRING:
+        lua_pushstring(L, v->s);
+        break;
+    case MPV_FORMAT_NODE:
+        pushnode(L, &v->node);
+        break;
+    default:
+        abort();
+    }
+}
+
+struct prop_handle {
+    struct mp_client_property *prop;
+    mpv_format format;
+};
+
+static int prop_handle_gc(lua_State *L)
+{
+    struct prop_handle *h = luaL_checkudata(L, 1, "PROPERTY_HANDLE");
+    talloc_free(h->prop);
+    h->prop = NULL;
+    return 0;
+}
+
+static int prop_handle_get(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    struct prop_handle *h = luaL_checkudata(L, 1, "PROPERTY_HANDLE");
+    mp_lua_optarg(L, 2);
+    void *tmp = mp_lua_PITA(L);
+
+    union prop_value v = {0};
+    struct mp_client_property_get req = {
+        .prop = h->prop,
+        .format = h->format,
+        .data = &v,
+    };
+    mp_client_get_properties(ctx->client, &req, 1);
+    if (req.status >= 0) {
+        steal_prop_value(tmp, h->format, &v);
+        push_prop_value(L, h->format, &v);
+        talloc_free_children(tmp);
+        return 1;
+    }
+    lua_pushvalue(L, 2);
+    lua_pushstring(L, mpv_error_string(req.status));
+    return 2;
+}
+
+// Look up a property once, so that reading it repeatedly is cheaper. The
+// format is fixed at this point, so the value needs no further conversion.
+static int script_resolve_property(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    const char *name = luaL_checkstring(L, 1);
+    mp_lua_optarg(L, 2);
+    mpv_format format = check_property_format(L, 2);
+    if (format == MPV_FORMAT_NONE)
+        format = MPV_FORMAT_NODE;
+
+    struct prop_handle *h = lua_newuserdata(L, sizeof(*h)); // u
+    *h = (struct prop_handle){.format = format};
+    if (luaL_newmetatable(L, "PROPERTY_HANDLE")) { // u metatable
+        lua_pushcfunction(L, prop_handle_gc); // u metatable gc
+        lua_setfield(L, -2, "__gc"); // u metatable
+        lua_newtable(L); // u metatable index
+        lua_pushcfunction(L, prop_handle_get); // u metatable index get
+        lua_setfield(L, -2, "get"); // u metatable index
+        lua_setfield(L, -2, "__index"); // u metatable
+    }
+    lua_setmetatable(L, -2); // u
+
+    h->prop = mp_client_resolve_property(NULL, ctx->client, name);
+    if (!h->prop) {
+        lua_pushnil(L);
+        lua_pushstring(L, mpv_error_string(MPV_ERROR_PROPERTY_NOT_FOUND));
+        return 2;
+    }
+    return 1;
+}
+
+// Read all properties in the array passed as first argument (property names
+// or handles returned by resolve_property) with a single core lock, and
+// return their values as multiple return values (nil for failed reads).
+static int script_get_properties(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    mp_lua_optarg(L, 2);
+    mpv_format def_format = check_property_format(L, 2);
+    if (def_format == MPV_FORMAT_NONE)
+        def_format = MPV_FORMAT_NODE;
+    void *tmp = mp_lua_PITA(L);
+
+    int num = mp_lua_len(L, 1);
+    luaL_checkstack(L, num + 2, "too many properties");
+    struct mp_client_property_get *reqs =
+        talloc_zero_array(tmp, struct mp_client_property_get, num);
+    union prop_value *vals = talloc_zero_array(tmp, union prop_value, num);
+    for (int n = 0; n < num; n++) {
+        lua_rawgeti(L, 1, n + 1); // name|handle
+        struct mp_client_property_get *r = &reqs[n];
+        r->data = &vals[n];
+        if (lua_type(L, -1) == LUA_TUSERDATA) {
+            struct prop_handle *h = luaL_checkudata(L, -1, "PROPERTY_HANDLE");
+            r->prop = h->prop;
+            r->format = h->format;
+        } else {
+            const char *name = lua_tostring(L, -1);
+            if (!name)
+                luaL_error(L, "property name or handle expected");
+            r->name = talloc_strdup(tmp, name);
+            r->format = def_format;
+        }
+        lua_pop(L, 1); // -
+    }
+
+    mp_client_get_properties(ctx->client, reqs, num);
+
+    for (int n = 0; n < num; n++) {
+        if (reqs[n].status >= 0)
+            steal_prop_value(tmp, reqs[n].format, &vals[n]);
+    }
+    for (int n = 0; n < num; n++) {
+        if (reqs[n].status >= 0) {
+            push_prop_value(L, reqs[n].format, &vals[n]);
+        } else {
+            lua_pushnil(L);
+        }
+    }
+    return num;
+}
+
 // It has a raw_ prefix, because there is a more high level API in defaults.lua.
 static int script_raw_observe_property(lua_State *L)
 {
@@ -1269,6 +1429,8 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_property_bool),
     FN_ENTRY(get_property_number),
     FN_ENTRY(get_property_native),
+    FN_ENTRY(resolve_property),
+    FN_ENTRY(get_properties),
     FN_ENTRY(set_property),
     FN_ENTRY(set_property_bool),
     FN_ENTRY(set_property_number),
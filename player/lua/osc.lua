@@ -1706,8 +1706,9 @@ function osc_init()
             return {}
         end
     end
+    local percent_pos = mp.resolve_property("percent-pos", "number")
     ne.slider.posF =
-        function () return mp.get_property_number("percent-pos", nil) end
+        function () return percent_pos:get() end
     ne.slider.tooltipF = function (pos)
         local duration = mp.get_property_number("duration", nil)
         if not ((duration == nil) or (pos == nil)) then
@@ -1779,13 +1780,13 @@ function osc_init()
     ne = new_element("cache", "button")
 
     ne.content = function ()
-        local dmx_cache = mp.get_property_number("demuxer-cache-duration")
+        local dmx_cache, cache_used = mp.get_properties(
+            {"demuxer-cache-duration", "cache-used"}, "number")
         if not (dmx_cache == nil) then
             dmx_cache = math.floor(dmx_cache + 0.5) .. "s + "
         else
             dmx_cache = ""
         end
-        local cache_used = mp.get_property_number("cache-used")
         if not (cache_used == nil) then
             if (cache_used < 1024) then
                 cache_used = cache_used .. " KB"
@@ -42,6 +42,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "common/global.h"
+#include "common/mem_budget.h"
 #include "options/parse_configfile.h"
 #include "options/parse_commandline.h"
 #include "common/playlist.h"
@@ -327,9 +328,13 @@ struct MPContext *mp_create(void)
         .playlist = talloc_struct(mpctx, struct playlist, {0}),
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
+        .speed_factor_latency = 1.0,
+        .live_latency = MP_NOPTS_VALUE,
+        .frame_cache_pts = MP_NOPTS_VALUE,
     };
 
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
+    mpctx->global->mem_budget = mp_mem_budget_create(mpctx->global);
 
     // Nothing must call mp_msg*() and related before this
     mp_msg_init(mpctx->global);
@@ -381,6 +386,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     assert(!mpctx->initialized);
 
+    mpctx->startup.start = mp_time_us();
+
     // Preparse the command line, so we can init the terminal early.
     if (options)
         m_config_preparse_command_line(mpctx->mconfig, mpctx->global, options);
@@ -405,6 +412,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
             return r == M_OPT_EXIT ? -2 : -1;
     }
 
+    add_startup_phase(mpctx, "parse-config", mp_time_us());
+
     if (opts->operation_mode == 1) {
         m_config_set_profile(mpctx->mconfig, "builtin-pseudo-gui",
                              M_SETOPT_NO_OVERWRITE);
@@ -464,8 +473,12 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     MP_WARN(mpctx, "There will be no OSD and no text subtitles.\n");
 #endif
 
+    add_startup_phase(mpctx, "init", mp_time_us());
+
     mp_load_scripts(mpctx);
 
+    add_startup_phase(mpctx, "load-scripts", mp_time_us());
+
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
 
@@ -490,6 +503,11 @@ int mpv_main(int argc, char *argv[])
     if (r < 0) // another error
         return prepare_exit_cplayer(mpctx, EXIT_ERROR);
 
+    if (mpctx->opts->benchmark_mode) {
+        r = run_pipeline_benchmark(mpctx);
+        return prepare_exit_cplayer(mpctx, r < 0 ? EXIT_ERROR : EXIT_NORMAL);
+    }
+
     mp_play_files(mpctx);
     return prepare_exit_cplayer(mpctx, EXIT_NORMAL);
 }
@@ -51,6 +51,8 @@
 #include "client.h"
 #include "command.h"
 
+static void frame_cache_resync(struct MPContext *mpctx);
+
 // Wait until mp_wakeup_core() is called, since the last time
 // mp_wait_events() was called.
 void mp_wait_events(struct MPContext *mpctx)
@@ -133,8 +135,10 @@ void pause_player(struct MPContext *mpctx)
     mpctx->osd_force_update = true;
     mpctx->paused_for_cache = false;
 
-    if (mpctx->ao && mpctx->ao_chain)
+    if (mpctx->ao && mpctx->ao_chain) {
+        audio_stop_direct_output(mpctx);
         ao_pause(mpctx->ao);
+    }
     if (mpctx->video_out)
         vo_set_paused(mpctx->video_out, true);
 
@@ -159,6 +163,8 @@ void unpause_player(struct MPContext *mpctx)
     mpctx->osd_function = 0;
     mpctx->osd_force_update = true;
 
+    frame_cache_resync(mpctx);
+
     if (mpctx->ao && mpctx->ao_chain)
         ao_resume(mpctx->ao);
     if (mpctx->video_out)
@@ -188,12 +194,26 @@ void add_step_frame(struct MPContext *mpctx, int dir)
     if (!mpctx->vo_chain)
         return;
     if (dir > 0) {
+        if (video_step_cached(mpctx, 1))
+            return;
+        // Decode from the cached frame that is shown, instead of from the
+        // frame after video_pts. The seek shows that frame again, so it
+        // takes an additional step.
+        if (mpctx->frame_cache_pts != MP_NOPTS_VALUE) {
+            frame_cache_resync(mpctx);
+            mpctx->step_frames += 1;
+        }
         mpctx->step_frames += 1;
         unpause_player(mpctx);
     } else if (dir < 0) {
         if (!mpctx->hrseek_active) {
-            queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
             pause_player(mpctx);
+            if (video_step_cached(mpctx, -1)) {
+                mp_notify(mpctx, MPV_EVENT_SEEK, NULL);
+                mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+                return;
+            }
+            queue_seek(mpctx, MPSEEK_BACKSTEP, 0, MPSEEK_VERY_EXACT, 0);
         }
     }
 }
@@ -285,6 +305,16 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
         (seek.type == MPSEEK_ABSOLUTE && seek.amount < mpctx->last_chapter_pts))
         mpctx->last_chapter_seek = -2;
 
+    // While paused, short exact seeks backwards can be served from the cache.
+    if (hr_seek && seek.type != MPSEEK_BACKSTEP &&
+        !(seek.flags & MPSEEK_FLAG_NOCACHE) &&
+        video_seek_cached(mpctx, seek_pts))
+    {
+        mp_notify(mpctx, MPV_EVENT_SEEK, NULL);
+        mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        return;
+    }
+
     // Under certain circumstances, prefer SEEK_FACTOR.
     if (seek.type == MPSEEK_FACTOR && !hr_seek &&
         (mpctx->demuxer->ts_resets_possible || seek_pts == MP_NOPTS_VALUE))
@@ -361,6 +391,20 @@ static void mp_seek(MPContext *mpctx, struct seek_params seek)
     mpctx->ab_loop_clip = mpctx->last_seek_pts < opts->ab_loop[1];
 }
 
+// If a frame from the frame cache is shown, seek to it, so that decoding and
+// audio continue from there.
+static void frame_cache_resync(struct MPContext *mpctx)
+{
+    if (mpctx->frame_cache_pts == MP_NOPTS_VALUE)
+        return;
+    mp_seek(mpctx, (struct seek_params){
+        .type = MPSEEK_ABSOLUTE,
+        .amount = mpctx->frame_cache_pts,
+        .exact = MPSEEK_VERY_EXACT,
+        .flags = MPSEEK_FLAG_NOCACHE,
+    });
+}
+
 // This combines consecutive seek requests.
 void queue_seek(struct MPContext *mpctx, enum seek_type type, double amount,
                 enum seek_precision exact, int flags)
@@ -586,6 +630,44 @@ static void handle_osd_redraw(struct MPContext *mpctx)
     mp_wakeup_core(mpctx);
 }
 
+// Fraction of --latency-target by which latency has to fall below the target
+// before catching up stops. Avoids toggling the speed on every packet.
+#define LATENCY_HYSTERESIS 0.25
+
+// Estimate how far playback lags behind the newest received packet, and speed
+// up playback slightly if that exceeds --latency-target. This is the only
+// latency the player can observe; capture and network delay are not included.
+static void update_live_latency(struct MPContext *mpctx,
+                                struct demux_ctrl_reader_state *s)
+{
+    struct MPOpts *opts = mpctx->opts;
+
+    mpctx->live_latency = MP_NOPTS_VALUE;
+    if (s->ts_range[1] != MP_NOPTS_VALUE &&
+        mpctx->playback_pts != MP_NOPTS_VALUE)
+        mpctx->live_latency = MPMAX(0, s->ts_range[1] - mpctx->playback_pts);
+
+    double factor = mpctx->speed_factor_latency;
+    double target = opts->latency_target;
+    double latency = mpctx->live_latency;
+    if (target <= 0 || latency == MP_NOPTS_VALUE || mpctx->paused ||
+        !mpctx->restart_complete)
+    {
+        factor = 1.0;
+    } else if (latency > target) {
+        factor = opts->latency_catchup_speed;
+    } else if (latency <= target * (1 - LATENCY_HYSTERESIS)) {
+        factor = 1.0;
+    }
+
+    if (factor != mpctx->speed_factor_latency) {
+        MP_VERBOSE(mpctx, "Latency %f (target %f), playback speed factor %f.\n",
+                   latency, target, factor);
+        mpctx->speed_factor_latency = factor;
+        update_playback_speed(mpctx);
+    }
+}
+
 static void handle_pause_on_low_cache(struct MPContext *mpctx)
 {
     bool force_update = false;
@@ -601,6 +683,8 @@ static void handle_pause_on_low_cache(struct MPContext *mpctx)
     struct demux_ctrl_reader_state s = {.idle = true, .ts_duration = -1};
     demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s);
 
+    update_live_latency(mpctx, &s);
+
     int cache_buffer = 100;
 
     if (mpctx->restart_complete && c.size > 0) {
@@ -934,7 +1018,9 @@ static void handle_dummy_ticks(struct MPContext *mpctx)
 // Update current playback time.
 static void handle_playback_time(struct MPContext *mpctx)
 {
-    if (mpctx->vo_chain && !mpctx->vo_chain->is_coverart &&
+    if (mpctx->frame_cache_pts != MP_NOPTS_VALUE) {
+        mpctx->playback_pts = mpctx->frame_cache_pts;
+    } else if (mpctx->vo_chain && !mpctx->vo_chain->is_coverart &&
         mpctx->video_status >= STATUS_PLAYING &&
         mpctx->video_status < STATUS_EOF)
     {
@@ -980,6 +1066,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->audio_allow_second_chance_seek = false;
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        finish_startup_timings(mpctx);
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
                 char *msg =
@@ -30,6 +30,7 @@
 #include "options/m_option.h"
 #include "common/common.h"
 #include "common/encode.h"
+#include "common/mem_budget.h"
 #include "options/m_property.h"
 #include "osdep/timer.h"
 
@@ -38,6 +39,7 @@
 #include "stream/stream.h"
 #include "sub/osd.h"
 #include "video/hwdec.h"
+#include "video/frame_cache.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
 #include "video/decode/vd.h"
@@ -351,6 +353,10 @@ void reset_video_state(struct MPContext *mpctx)
     mpctx->drop_message_shown = 0;
     mpctx->display_sync_drift_dir = 0;
     mpctx->display_sync_broken = false;
+    mpctx->frame_cache_pts = MP_NOPTS_VALUE;
+    mpctx->frame_cache_drops = 0; // video_reset() resets dropped_frames
+    if (mpctx->frame_cache)
+        mp_frame_cache_seek_reset(mpctx->frame_cache);
 
     mpctx->video_status = mpctx->vo_chain ? STATUS_SYNCING : STATUS_EOF;
 }
@@ -392,6 +398,9 @@ void uninit_video_chain(struct MPContext *mpctx)
         vo_chain_uninit(mpctx->vo_chain);
         mpctx->vo_chain = NULL;
 
+        if (mpctx->frame_cache)
+            mp_frame_cache_clear(mpctx->frame_cache);
+
         mpctx->video_status = STATUS_EOF;
 
         mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
@@ -543,6 +552,10 @@ void mp_force_video_refresh(struct MPContext *mpctx)
     if (!vo_c || !vo_c->input_format.imgfmt)
         return;
 
+    // Cached frames went through the old filters.
+    if (mpctx->frame_cache)
+        mp_frame_cache_clear(mpctx->frame_cache);
+
     // If not paused, the next frame should come soon enough.
     if ((opts->pause || mpctx->time_frame >= 0.5) &&
         (mpctx->video_status >= STATUS_PLAYING ||
@@ -554,6 +567,126 @@ void mp_force_video_refresh(struct MPContext *mpctx)
     }
 }
 
+// Keep a reference to the frame that is shown next, so that stepping backwards
+// can show it again without decoding (--video-frame-cache).
+static void add_to_frame_cache(struct MPContext *mpctx, struct mp_image *img)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+    int64_t wanted = mpctx->opts->video_frame_cache * 1024LL * 1024;
+
+    if (!mpctx->frame_cache) {
+        if (!wanted)
+            return;
+        mpctx->frame_cache = mp_frame_cache_create(mpctx);
+        mpctx->frame_cache_mem = mp_mem_client_new(mpctx->frame_cache,
+                                                   mpctx->global,
+                                                   "frame-cache", wanted);
+    }
+    struct mp_frame_cache *cache = mpctx->frame_cache;
+
+    mp_mem_client_set_wanted(mpctx->frame_cache_mem, wanted);
+    mp_frame_cache_set_max_bytes(cache,
+                                 mp_mem_client_get_limit(mpctx->frame_cache_mem));
+
+    // Frames dropped by the decoder would leave gaps.
+    int drops = vo_c->video_src ? vo_c->video_src->dropped_frames : 0;
+    if (drops != mpctx->frame_cache_drops)
+        mp_frame_cache_clear(cache);
+    mpctx->frame_cache_drops = drops;
+
+    // Holding on to hardware surfaces could starve the decoder's surface pool.
+    if (vo_c->is_coverart || IMGFMT_IS_HWACCEL(img->imgfmt)) {
+        mp_frame_cache_clear(cache);
+    } else {
+        mp_frame_cache_add(cache, img);
+    }
+
+    mp_mem_client_report(mpctx->frame_cache_mem,
+                         mp_frame_cache_get_bytes(cache));
+}
+
+// Show a frame from the frame cache instead of the frame at video_pts. This
+// doesn't touch the decoder or audio; they are resynced with an exact seek if
+// playback is resumed while a frame before video_pts is shown.
+static bool show_cached_frame(struct MPContext *mpctx, struct mp_image *img)
+{
+    struct vo *vo = mpctx->video_out;
+
+    if (!vo->params || !mp_image_params_equal(&img->params, vo->params))
+        return false;
+
+    vo_wait_frame(vo);
+    if (!vo_is_ready_for_frame(vo, -1))
+        return false;
+
+    struct vo_frame dummy = {
+        .pts = mp_time_us(),
+        .duration = -1,
+        .still = true,
+        .num_frames = 1,
+        .num_vsyncs = 1,
+        .frames = {img},
+    };
+    vo_queue_frame(vo, vo_frame_ref(&dummy));
+
+    double pts = img->pts;
+    // Back at the newest frame means in sync with the decoder again.
+    mpctx->frame_cache_pts = pts < mpctx->video_pts ? pts : MP_NOPTS_VALUE;
+    mpctx->last_vo_pts = pts;
+    mpctx->playback_pts = pts;
+
+    osd_set_force_video_pts(mpctx->osd, MP_NOPTS_VALUE);
+    update_subtitles(mpctx, pts);
+    mpctx->osd_force_update = true;
+    update_osd_msg(mpctx);
+
+    MP_VERBOSE(mpctx, "showing cached frame at %f\n", pts);
+    mp_notify(mpctx, MPV_EVENT_TICK, NULL);
+    return true;
+}
+
+// Return the PTS of the frame currently shown, if it can be replaced with a
+// cached frame.
+static double frame_cache_current_pts(struct MPContext *mpctx)
+{
+    struct vo_chain *vo_c = mpctx->vo_chain;
+
+    if (!mpctx->frame_cache || !vo_c || vo_c->is_coverart || !mpctx->paused ||
+        !mpctx->restart_complete || mpctx->video_status < STATUS_READY ||
+        !mpctx->opts->correct_pts)
+        return MP_NOPTS_VALUE;
+
+    if (mpctx->frame_cache_pts != MP_NOPTS_VALUE)
+        return mpctx->frame_cache_pts;
+    return mpctx->video_pts;
+}
+
+// Show the cached frame before (dir<0) or after (dir>0) the frame currently
+// shown. Stepping forward only works after stepping backwards.
+bool video_step_cached(struct MPContext *mpctx, int dir)
+{
+    double pts = frame_cache_current_pts(mpctx);
+    if (pts == MP_NOPTS_VALUE ||
+        (dir > 0 && mpctx->frame_cache_pts == MP_NOPTS_VALUE))
+        return false;
+
+    struct mp_image *img = mp_frame_cache_get(mpctx->frame_cache, pts, dir);
+    return img && show_cached_frame(mpctx, img);
+}
+
+// Show the frame an exact seek to pts would show, if it's in the cache, and not
+// after the last decoded frame.
+bool video_seek_cached(struct MPContext *mpctx, double pts)
+{
+    if (frame_cache_current_pts(mpctx) == MP_NOPTS_VALUE)
+        return false;
+
+    // Same tolerance as hr-seek.
+    struct mp_image *img =
+        mp_frame_cache_get(mpctx->frame_cache, pts - .005, 1);
+    return img && show_cached_frame(mpctx, img);
+}
+
 static bool check_framedrop(struct MPContext *mpctx, struct vo_chain *vo_c)
 {
     struct MPOpts *opts = mpctx->opts;
@@ -593,8 +726,12 @@ static int decode_image(struct MPContext *mpctx)
 
         video_set_framedrop(d_video, check_framedrop(mpctx, vo_c));
 
+        int64_t start = mp_time_us();
         video_work(d_video);
         res = video_get_frame(d_video, &vo_c->input_mpi);
+        mpctx->perf.decode_time += mp_time_us() - start;
+        if (vo_c->input_mpi)
+            mpctx->perf.decoded_vframes += 1;
     }
 
     switch (res) {
@@ -608,7 +745,7 @@ static int decode_image(struct MPContext *mpctx)
 
 // Feed newly decoded frames to the filter, take care of format changes.
 // If eof=true, drain the filter chain, and return VD_EOF if empty.
-static int video_filter(struct MPContext *mpctx, bool eof)
+static int do_video_filter(struct MPContext *mpctx, bool eof)
 {
     struct vo_chain *vo_c = mpctx->vo_chain;
     struct vf_chain *vf = vo_c->vf;
@@ -618,9 +755,14 @@ static int video_filter(struct MPContext *mpctx, bool eof)
 
     // There is already a filtered frame available.
     // If vf_needs_input() returns > 0, the filter wants input anyway.
-    if (vf_output_frame(vf, eof) > 0 && vf_needs_input(vf) < 1)
+    int out = vf_output_frame(vf, eof);
+    if (out > 0 && vf_needs_input(vf) < 1)
         return VD_PROGRESS;
 
+    // Filter threads are still working, and will wake us up.
+    if (out == 0 && vf_pipeline_busy(vf, eof))
+        return VD_WAIT;
+
     // Decoder output is different from filter input?
     bool need_vf_reconfig = !vf->input_params.imgfmt || vf->initialized < 1 ||
         !mp_image_params_equal(&vo_c->input_format, &vf->input_params);
@@ -630,10 +772,14 @@ static int video_filter(struct MPContext *mpctx, bool eof)
         // Drain the filter chain.
         if (vf_output_frame(vf, true) > 0)
             return VD_PROGRESS;
+        if (vf_pipeline_busy(vf, true))
+            return VD_WAIT;
 
         // The filter chain is drained; execute the filter format change.
+        add_startup_phase(mpctx, "video-decode", mp_time_us());
         vf->initialized = 0;
         filter_reconfig(mpctx, mpctx->vo_chain);
+        add_startup_phase(mpctx, "video-filters", mp_time_us());
 
         mp_notify(mpctx, MPV_EVENT_VIDEO_RECONFIG, NULL);
 
@@ -668,6 +814,14 @@ static int video_filter(struct MPContext *mpctx, bool eof)
     return eof ? VD_EOF : VD_PROGRESS;
 }
 
+static int video_filter(struct MPContext *mpctx, bool eof)
+{
+    int64_t start = mp_time_us();
+    int r = do_video_filter(mpctx, eof);
+    mpctx->perf.filter_time += mp_time_us() - start;
+    return r;
+}
+
 // Make sure at least 1 filtered image is available, decode new video if needed.
 // returns VD_* code
 // A return value of VD_PROGRESS doesn't necessarily output a frame, but makes
@@ -779,8 +933,10 @@ static void shift_frames(struct MPContext *mpctx)
     if (mpctx->num_next_frames < 1)
         return;
     talloc_free(mpctx->next_frames[0]);
-    for (int n = 0; n < mpctx->num_next_frames - 1; n++)
+    for (int n = 0; n < mpctx->num_next_frames - 1; n++) {
         mpctx->next_frames[n] = mpctx->next_frames[n + 1];
+        mpctx->next_frames_time[n] = mpctx->next_frames_time[n + 1];
+    }
     mpctx->num_next_frames -= 1;
 }
 
@@ -796,13 +952,14 @@ static int get_req_frames(struct MPContext *mpctx, bool eof)
         return mpctx->opts->video_sync == VS_DEFAULT ? 1 : 2;
 
     int req = vo_get_num_req_frames(mpctx->video_out);
-    return MPCLAMP(req, 2, MP_ARRAY_SIZE(mpctx->next_frames) - 1);
+    return MPCLAMP(req, 2, VO_MAX_REQ_FRAMES);
 }
 
-// Whether it's fine to call add_new_frame() now.
-static bool needs_new_frame(struct MPContext *mpctx)
+// Whether it's fine to call add_new_frame() now. ahead is the number of frames
+// to decode in addition to the frames the VO needs.
+static bool needs_new_frame(struct MPContext *mpctx, int ahead)
 {
-    return mpctx->num_next_frames < get_req_frames(mpctx, false);
+    return mpctx->num_next_frames < get_req_frames(mpctx, false) + ahead;
 }
 
 // Queue a frame to mpctx->next_frames[]. Call only if needs_new_frame() signals ok.
@@ -810,7 +967,10 @@ static void add_new_frame(struct MPContext *mpctx, struct mp_image *frame)
 {
     assert(mpctx->num_next_frames < MP_ARRAY_SIZE(mpctx->next_frames));
     assert(frame);
+    mpctx->next_frames_time[mpctx->num_next_frames] = mp_time_us();
     mpctx->next_frames[mpctx->num_next_frames++] = frame;
+    mpctx->perf.peak_vo_queue =
+        MPMAX(mpctx->perf.peak_vo_queue, mpctx->num_next_frames);
     if (mpctx->num_next_frames == 1)
         handle_new_frame(mpctx);
 }
@@ -822,9 +982,10 @@ static bool have_new_frame(struct MPContext *mpctx, bool eof)
     return mpctx->num_next_frames >= get_req_frames(mpctx, eof);
 }
 
-// Fill mpctx->next_frames[] with a newly filtered or decoded image.
+// Fill mpctx->next_frames[] with a newly filtered or decoded image. If ahead
+// is not 0, decode up to this many frames beyond what the VO needs.
 // returns VD_* code
-static int video_output_image(struct MPContext *mpctx)
+static int video_output_image(struct MPContext *mpctx, int ahead)
 {
     struct vo_chain *vo_c = mpctx->vo_chain;
     bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
@@ -835,12 +996,12 @@ static int video_output_image(struct MPContext *mpctx)
         hrseek = false;
     }
 
-    if (have_new_frame(mpctx, false))
+    if (!ahead && have_new_frame(mpctx, false))
         return VD_NEW_FRAME;
 
     // Get a new frame if we need one.
     int r = VD_PROGRESS;
-    if (needs_new_frame(mpctx)) {
+    if (needs_new_frame(mpctx, ahead)) {
         // Filter a new frame.
         r = video_decode_and_filter(mpctx);
         if (r < 0)
@@ -892,6 +1053,40 @@ static int video_output_image(struct MPContext *mpctx)
     return have_new_frame(mpctx, r <= 0) ? VD_NEW_FRAME : r;
 }
 
+// While waiting for the VO, decode and filter frames beyond the ones the VO
+// needs (--video-render-ahead), so that single frames which take unusually
+// long to decode don't delay the output. time_left is the time until the next
+// frame is due (in seconds).
+// returns VD_* code
+static int video_render_ahead(struct MPContext *mpctx, double time_left)
+{
+    int ahead = mpctx->opts->video_render_ahead;
+    if (!ahead || mpctx->video_status != STATUS_PLAYING || mpctx->paused ||
+        mpctx->hrseek_active || mpctx->vo_chain->is_coverart ||
+        mpctx->num_next_frames < 1 || !needs_new_frame(mpctx, ahead))
+        return VD_WAIT;
+
+    // Hardware decoders have a fixed number of surfaces, and holding more of
+    // them could stall decoding.
+    if (IMGFMT_IS_HWACCEL(mpctx->next_frames[0]->imgfmt))
+        return VD_WAIT;
+
+    // Don't start decoding a frame if it's likely to be done only after the
+    // next frame should have been sent to the VO.
+    struct mp_perf_stats *perf = &mpctx->perf;
+    if (!mpctx->display_sync_active && perf->decoded_vframes > 0) {
+        double frame_time = (perf->decode_time + perf->filter_time) /
+                            (double)perf->decoded_vframes / 1e6;
+        if (time_left < frame_time)
+            return VD_WAIT;
+    }
+
+    int r = video_output_image(mpctx, ahead);
+    if (r == VD_PROGRESS || r == VD_NEW_FRAME)
+        mp_wakeup_core(mpctx); // continue filling the queue
+    return r;
+}
+
 /* Update avsync before a new video frame is displayed. Actually, this can be
  * called arbitrarily often before the actual display.
  * This adjusts the time of the next video frame */
@@ -1025,7 +1220,7 @@ static double find_best_speed(struct MPContext *mpctx, double vsync)
         double dur = mpctx->past_frames[n].approx_duration;
         if (dur <= 0)
             continue;
-        total += calc_best_speed(vsync, dur / mpctx->opts->playback_speed);
+        total += calc_best_speed(vsync, dur / get_base_playback_speed(mpctx));
         num++;
     }
     return num > 0 ? total / num : 1;
@@ -1113,7 +1308,7 @@ static void adjust_audio_resample_speed(struct MPContext *mpctx, double vsync)
             double drift = compute_audio_drift(mpctx, vsync);
             if (isnormal(drift)) {
                 // other = will be multiplied with audio_factor for final speed
-                double other = mpctx->opts->playback_speed * mpctx->speed_factor_v;
+                double other = get_base_playback_speed(mpctx) * mpctx->speed_factor_v;
                 audio_factor = (mpctx->audio_speed - drift) / other;
                 MP_VERBOSE(mpctx, "Compensation factor: %f\n", audio_factor);
             }
@@ -1155,7 +1350,7 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
         return;
 
     double adjusted_duration = MPMAX(0, mpctx->past_frames[0].approx_duration);
-    adjusted_duration /= opts->playback_speed;
+    adjusted_duration /= get_base_playback_speed(mpctx);
     if (adjusted_duration > 0.5)
         return;
 
@@ -1231,7 +1426,7 @@ static void handle_display_sync_frame(struct MPContext *mpctx,
     }
 
     mpctx->total_avsync_change = 0;
-    update_av_diff(mpctx, time_left * opts->playback_speed);
+    update_av_diff(mpctx, time_left * get_base_playback_speed(mpctx));
 
     mpctx->past_frames[0].num_vsyncs = num_vsyncs;
     mpctx->past_frames[0].av_diff = mpctx->last_av_difference;
@@ -1348,7 +1543,7 @@ void write_video(struct MPContext *mpctx)
     if (mpctx->paused && mpctx->video_status >= STATUS_READY)
         return;
 
-    int r = video_output_image(mpctx);
+    int r = video_output_image(mpctx, 0);
     MP_TRACE(mpctx, "video_output_image: %d\n", r);
 
     if (r < 0)
@@ -1419,6 +1614,7 @@ void write_video(struct MPContext *mpctx)
             goto error;
         }
         init_vo(mpctx);
+        add_startup_phase(mpctx, "vo-init", mp_time_us());
     }
 
     mpctx->time_frame -= get_relative_time(mpctx);
@@ -1441,6 +1637,8 @@ void write_video(struct MPContext *mpctx)
     if (!vo_is_ready_for_frame(vo, mpctx->display_sync_active ? -1 : pts)) {
         if (video_feed_async_filter(mpctx) < 0)
             goto error;
+        if (video_render_ahead(mpctx, time_frame) < 0)
+            goto error;
         return;
     }
 
@@ -1483,6 +1681,14 @@ void write_video(struct MPContext *mpctx)
     mpctx->video_pts = mpctx->next_frames[0]->pts;
     mpctx->last_vo_pts = mpctx->video_pts;
 
+    add_to_frame_cache(mpctx, mpctx->next_frames[0]);
+
+    struct mp_perf_stats *perf = &mpctx->perf;
+    perf->queue_wait = mp_time_us() - mpctx->next_frames_time[0];
+    perf->max_queue_wait = MPMAX(perf->max_queue_wait, perf->queue_wait);
+    perf->total_queue_wait += perf->queue_wait;
+    perf->queued_vframes += 1;
+
     shift_frames(mpctx);
 
     schedule_frame(mpctx, frame);
@@ -1502,6 +1708,7 @@ void write_video(struct MPContext *mpctx)
         // After a seek, make sure to wait until the first frame is visible.
         vo_wait_frame(vo);
         MP_VERBOSE(mpctx, "first video frame after restart shown\n");
+        add_startup_phase(mpctx, "first-frame", mp_time_us());
     }
     screenshot_flip(mpctx);
 
@@ -53,6 +53,7 @@
 #include "osdep/threads.h"
 
 #include "common/msg.h"
+#include "common/mem_budget.h"
 #include "common/tags.h"
 #include "options/options.h"
 
@@ -82,6 +83,10 @@ struct priv {
 
     // Owned by the cache thread
     stream_t *stream;       // "real" stream, used to read from the source media
+    struct mp_mem_client *mem;
+    int64_t mem_limit;      // budget limit the current buffer size is based on
+    int64_t wanted_size;    // readahead size as requested by the user
+    int64_t wanted_back;    // backbuffer size as requested by the user
 
     // All the following members are shared between the threads.
     // You must lock the mutex to access them.
@@ -99,6 +104,7 @@ struct priv {
     int64_t speed_start;    // start time (us) for calculating download speed
     int64_t speed_amount;   // bytes read since speed_start
     double speed;
+    struct stream_read_stats read_stats; // of the underlying stream
 
     bool enable_readahead;  // actively read beyond read() position
     int64_t read_filepos;   // client read position (mirrors cache->pos)
@@ -284,8 +290,12 @@ static void cache_fill(struct priv *s)
     // The read call might take a long time and block, so drop the lock.
     pthread_mutex_unlock(&s->mutex);
     len = stream_read_partial(s->stream, &s->buffer[pos], space);
+    struct stream_read_stats read_stats = {0};
+    stream_control(s->stream, STREAM_CTRL_GET_READ_STATS, &read_stats);
     pthread_mutex_lock(&s->mutex);
 
+    s->read_stats = read_stats;
+
     // Do this after reading a block, because at least libdvdnav updates the
     // stream position only after actually reading something after a seek.
     if (s->start_pts == MP_NOPTS_VALUE) {
@@ -390,6 +400,39 @@ static int resize_cache(struct priv *s, int64_t size)
     return STREAM_OK;
 }
 
+// Compute the readahead size and s->back_size from the user-requested sizes,
+// scaled down proportionally if the memory budget is lower.
+static int64_t apply_mem_limit(struct priv *s)
+{
+    int64_t wanted = s->wanted_size + s->wanted_back;
+    s->mem_limit = mp_mem_client_get_limit(s->mem);
+    if (wanted <= s->mem_limit || wanted <= 0) {
+        s->back_size = s->wanted_back;
+        return s->wanted_size;
+    }
+    double f = s->mem_limit / (double)wanted;
+    s->back_size = s->wanted_back * f;
+    return s->wanted_size * f;
+}
+
+// Shrink or grow the buffer if the memory budget changed considerably.
+static void update_mem_limit(struct priv *s)
+{
+    mp_mem_client_report(s->mem, s->buffer_size);
+    int64_t limit = mp_mem_client_get_limit(s->mem);
+    int64_t wanted = s->wanted_size + s->wanted_back;
+    int64_t cur = MPMIN(s->mem_limit, wanted);
+    int64_t new = MPMIN(limit, wanted);
+    if (llabs(new - cur) <= cur / 10)
+        return;
+    int64_t old_back = s->back_size;
+    if (resize_cache(s, apply_mem_limit(s)) != STREAM_OK) {
+        s->back_size = old_back;
+        s->mem_limit = limit;
+    }
+    mp_mem_client_report(s->mem, s->buffer_size);
+}
+
 static void update_cached_controls(struct priv *s)
 {
     int64_t i64;
@@ -442,6 +485,9 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     }
     case STREAM_CTRL_HAS_AVSEEK:
         return s->has_avseek ? STREAM_OK : STREAM_UNSUPPORTED;
+    case STREAM_CTRL_GET_READ_STATS:
+        *(struct stream_read_stats *)arg = s->read_stats;
+        return STREAM_OK;
     case STREAM_CTRL_GET_METADATA: {
         if (s->stream_metadata) {
             ta_set_parent(s->stream_metadata, NULL);
@@ -483,7 +529,10 @@ static void cache_execute_control(struct priv *s)
 
     switch (s->control) {
     case STREAM_CTRL_SET_CACHE_SIZE:
-        s->control_res = resize_cache(s, *(int64_t *)s->control_arg);
+        s->wanted_size = *(int64_t *)s->control_arg;
+        mp_mem_client_set_wanted(s->mem, s->wanted_size + s->wanted_back);
+        s->control_res = resize_cache(s, apply_mem_limit(s));
+        mp_mem_client_report(s->mem, s->buffer_size);
         break;
     default:
         s->control_res = stream_control(s->stream, s->control, s->control_arg);
@@ -517,6 +566,7 @@ static void *cache_thread(void *arg)
     while (s->control != CACHE_CTRL_QUIT) {
         if (mp_time_sec() - last > CACHE_UPDATE_CONTROLS_TIME) {
             update_cached_controls(s);
+            update_mem_limit(s);
             last = mp_time_sec();
         }
         if (s->control > 0) {
@@ -685,15 +735,19 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
     s->speed_start = mp_time_us();
 
     s->seek_limit = opts->seek_min * 1024ULL;
-    s->back_size = opts->back_buffer * 1024ULL;
+    s->wanted_size = opts->size * 1024ULL;
+    s->wanted_back = opts->back_buffer * 1024ULL;
+    s->mem = mp_mem_client_new(s, cache->global, "cache",
+                               s->wanted_size + s->wanted_back);
 
     s->stream_size = stream_get_size(stream);
 
-    if (resize_cache(s, opts->size * 1024ULL) != STREAM_OK) {
+    if (resize_cache(s, apply_mem_limit(s)) != STREAM_OK) {
         MP_ERR(s, "Failed to allocate cache buffer.\n");
         talloc_free(s);
         return -1;
     }
+    mp_mem_client_report(s->mem, s->buffer_size);
 
     pthread_mutex_init(&s->mutex, NULL);
     pthread_cond_init(&s->wakeup, NULL);
@@ -252,6 +252,7 @@ static int open_internal(const stream_info_t *sinfo, const char *url, int flags,
 
     if (!s->read_chunk)
         s->read_chunk = 4 * (s->sector_size ? s->sector_size : STREAM_BUFFER_SIZE);
+    s->fill_size = STREAM_BUFFER_SIZE;
 
     if (!s->fill_buffer)
         s->allow_caching = false;
@@ -396,6 +397,8 @@ static int stream_read_unbuffered(stream_t *s, void *buf, int len)
     len = s->fill_buffer ? s->fill_buffer(s, buf, len) : -1;
     if (len < 0)
         len = 0;
+    s->read_calls++;
+    s->read_bytes += len;
     if (len == 0) {
         // just in case this is an error e.g. due to network
         // timeout reset and retry
@@ -428,9 +431,17 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
     return s->buf_len;
 }
 
+// Refill the (fully consumed) buffer for small reads. Since the previous
+// buffer contents were read completely, access is sequential, so read more
+// data at once next time, up to the stream's read_chunk. Backward seeks and
+// long forward seeks shrink it again (see stream_seek()).
 int stream_fill_buffer(stream_t *s)
 {
-    return stream_fill_buffer_by(s, STREAM_BUFFER_SIZE);
+    int len = stream_fill_buffer_by(s, s->fill_size);
+    int max = MPMIN(s->read_chunk, STREAM_MAX_BUFFER_SIZE);
+    if (len > 0 && s->fill_size < max)
+        s->fill_size = MPMIN(s->fill_size * 2, max);
+    return len;
 }
 
 // Read between 1..buf_size bytes of data, return how much data has been read.
@@ -591,6 +602,13 @@ bool stream_seek(stream_t *s, int64_t pos)
     if (s->mode == STREAM_WRITE)
         return s->seekable && s->seek(s, pos);
 
+    // Seeky access pattern: avoid reading data that will be thrown away. Short
+    // forward skips (such as skipping unneeded elements while parsing) are
+    // still sequential access.
+    int max_fill = MPMIN(s->read_chunk, STREAM_MAX_BUFFER_SIZE);
+    if (pos < s->pos || pos - s->pos > max_fill)
+        s->fill_size = MPMAX(s->fill_size / 2, STREAM_BUFFER_SIZE);
+
     int64_t newpos = pos;
     if (s->sector_size)
         newpos = (pos / s->sector_size) * s->sector_size;
@@ -630,7 +648,16 @@ bool stream_skip(stream_t *s, int64_t len)
 
 int stream_control(stream_t *s, int cmd, void *arg)
 {
-    return s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    int r = s->control ? s->control(s, cmd, arg) : STREAM_UNSUPPORTED;
+    if (cmd == STREAM_CTRL_GET_READ_STATS && r != STREAM_OK) {
+        *(struct stream_read_stats *)arg = (struct stream_read_stats){
+            .calls = s->read_calls,
+            .bytes = s->read_bytes,
+            .buffer_size = s->fill_size,
+        };
+        r = STREAM_OK;
+    }
+    return r;
 }
 
 // Return the current size of the stream, or a negative value if unknown.
@@ -675,6 +702,7 @@ static stream_t *open_cache(stream_t *orig, const char *name)
     cache->seekable = true;
     cache->mode = STREAM_READ;
     cache->read_chunk = 4 * STREAM_BUFFER_SIZE;
+    cache->fill_size = STREAM_BUFFER_SIZE;
 
     cache->url = talloc_strdup(cache, orig->url);
     cache->mime_type = talloc_strdup(cache, orig->mime_type);
@@ -71,6 +71,9 @@ enum stream_ctrl {
     STREAM_CTRL_SET_CACHE_SIZE,
     STREAM_CTRL_SET_READAHEAD,
 
+    // Generic
+    STREAM_CTRL_GET_READ_STATS,
+
     // stream_memory.c
     STREAM_CTRL_SET_CONTENTS,
 
@@ -127,6 +130,13 @@ struct stream_cache_info {
     int64_t speed;
 };
 
+// for STREAM_CTRL_GET_READ_STATS
+struct stream_read_stats {
+    int64_t calls;      // number of reads from the lowest stream layer
+    int64_t bytes;      // total bytes returned by these reads
+    int buffer_size;    // current adaptive fill size of the stream buffer
+};
+
 struct stream_lang_req {
     int type;     // STREAM_AUDIO, STREAM_SUB
     int id;
@@ -183,6 +193,8 @@ typedef struct stream {
     int sector_size; // sector size (seek will be aligned on this size if non 0)
     int read_chunk; // maximum amount of data to read at once to limit latency
     unsigned int buf_pos, buf_len;
+    int fill_size; // adaptive amount to read when refilling the buffer
+    int64_t read_calls, read_bytes; // fill_buffer statistics
     int64_t pos;
     int eof;
     int mode; //STREAM_READ or STREAM_WRITE
@@ -25,6 +25,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
@@ -33,8 +35,12 @@
 #include "osdep/io.h"
 
 #include "common/common.h"
+#include "common/global.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
+#include "osdep/timer.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -57,10 +63,70 @@
 #endif
 #endif
 
+#define OPT_BASE_STRUCT struct stream_file_opts
+struct stream_file_opts {
+    int async;
+    int async_depth;
+    int async_block_size;
+    int direct_io;
+};
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_FLAG("file-async", async, 0),
+        OPT_INTRANGE("file-async-depth", async_depth, 0, 1, 32),
+        OPT_INTRANGE("file-async-block-size", async_block_size, 0, 4, 65536),
+        OPT_FLAG("file-direct-io", direct_io, 0),
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+    .defaults = &(const struct stream_file_opts){
+        .async_depth = 8,
+        .async_block_size = 1024,
+    },
+};
+
+// Amount of data (in seconds of observed consumption) the async reader tries
+// to keep in flight.
+#define ASYNC_READAHEAD_SECS 0.5
+
+// Required alignment of offsets, sizes, and memory for O_DIRECT.
+#define DIRECT_IO_ALIGN 4096
+
+struct file_block {
+    struct file_async *a;
+    int64_t pos;            // file offset of the block (aligned to block_size)
+    unsigned char *data;
+    int len;                // valid bytes after completion, <0 on error
+    bool valid;             // pos is set (request queued or done)
+    bool busy;              // pread() in progress on a worker thread
+};
+
+// Readahead with several large reads in flight, done by a thread pool.
+struct file_async {
+    int fd;
+    int block_size;
+    int max_depth;
+    struct mp_thread_pool *pool;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- the following fields are protected by lock
+    struct file_block *blocks;  // max_depth entries
+
+    // --- owned by the reader
+    int depth;                  // current readahead depth (in blocks)
+    int64_t size;               // known file size, or -1
+    int64_t rate_start;         // start time (us) for rate estimation
+    int64_t rate_bytes;         // bytes consumed since rate_start
+};
+
 struct priv {
     int fd;
     bool close;
     bool use_poll;
+    struct file_async *async;
 };
 
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
@@ -82,6 +148,194 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
     return (r <= 0) ? -1 : r;
 }
 
+#ifndef __MINGW32__
+// Runs on a worker thread.
+static void async_read_block(void *ctx)
+{
+    struct file_block *b = ctx;
+    struct file_async *a = b->a;
+
+    int64_t got = 0;
+    int r = 0;
+    while (got < a->block_size) {
+        r = pread(a->fd, b->data + got, a->block_size - got, b->pos + got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        got += r;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    b->len = (r < 0 && !got) ? -1 : got;
+    b->busy = false;
+    pthread_cond_broadcast(&a->wakeup);
+    pthread_mutex_unlock(&a->lock);
+}
+
+// Must be called with a->lock held.
+static struct file_block *async_find_block(struct file_async *a, int64_t pos)
+{
+    for (int n = 0; n < a->max_depth; n++) {
+        struct file_block *b = &a->blocks[n];
+        if (b->valid && pos >= b->pos && pos < b->pos + a->block_size)
+            return b;
+    }
+    return NULL;
+}
+
+// Make sure the block containing pos, and a->depth-1 blocks after it, are
+// requested. Blocks outside of this range are recycled. Busy blocks can't be
+// reused until their read completes (e.g. after a seek).
+// Must be called with a->lock held.
+static void async_queue_blocks(struct file_async *a, int64_t pos)
+{
+    int64_t start = pos - pos % a->block_size;
+    int64_t end = start + a->depth * (int64_t)a->block_size;
+    for (int64_t bpos = start; bpos < end; bpos += a->block_size) {
+        if (bpos != start && a->size >= 0 && bpos >= a->size)
+            break;
+        if (async_find_block(a, bpos))
+            continue;
+        struct file_block *b = NULL;
+        for (int n = 0; n < a->max_depth; n++) {
+            struct file_block *cur = &a->blocks[n];
+            if (!cur->busy && (!cur->valid || cur->pos < start || cur->pos >= end)) {
+                b = cur;
+                break;
+            }
+        }
+        if (!b)
+            break;
+        b->pos = bpos;
+        b->len = 0;
+        b->valid = true;
+        b->busy = true;
+        mp_thread_pool_queue(a->pool, async_read_block, b);
+    }
+}
+
+// Adjust the readahead depth to the observed consumption rate, so that about
+// ASYNC_READAHEAD_SECS worth of data is in flight. Reader stalls increase the
+// depth directly (see async_fill_buffer()); this lowers it by at most one
+// block per update, so that a stall-adjusted depth isn't discarded at once.
+static void async_update_depth(struct file_async *a, int64_t bytes)
+{
+    a->rate_bytes += bytes;
+    int64_t now = mp_time_us();
+    if (now - a->rate_start >= 1000000) {
+        double rate = a->rate_bytes * 1e6 / (now - a->rate_start);
+        int depth = ceil(rate * ASYNC_READAHEAD_SECS / a->block_size) + 1;
+        depth = MPMAX(depth, a->depth - 1);
+        a->depth = MPCLAMP(depth, 2, a->max_depth);
+        a->rate_bytes = 0;
+        a->rate_start = now;
+    }
+}
+
+static int async_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    struct file_async *a = p->async;
+    int64_t pos = s->pos;
+
+    pthread_mutex_lock(&a->lock);
+    struct file_block *b;
+    bool stalled = false;
+    while (1) {
+        async_queue_blocks(a, pos);
+        b = async_find_block(a, pos);
+        if (b && !b->busy)
+            break;
+        if (mp_cancel_test(s->cancel)) {
+            pthread_mutex_unlock(&a->lock);
+            return -1;
+        }
+        stalled = true;
+        // mp_cancel has no way to signal the condition, so poll it.
+        struct timespec ts = mp_rel_time_to_timespec(0.1);
+        pthread_cond_timedwait(&a->wakeup, &a->lock, &ts);
+    }
+    // The reader had to wait for I/O: readahead is not deep enough.
+    if (stalled && a->depth < a->max_depth)
+        a->depth++;
+    pthread_mutex_unlock(&a->lock);
+
+    // b can't be recycled or written to while we're reading from it, because
+    // only this thread queues new requests.
+    int64_t offset = pos - b->pos;
+    int len = -1;
+    if (b->len > offset) {
+        len = MPMIN(max_len, b->len - offset);
+        memcpy(buffer, b->data + offset, len);
+        async_update_depth(a, len);
+    } else {
+        // Short block: EOF or error. Drop it, so that data appended to the
+        // file later can be read on the next attempt.
+        pthread_mutex_lock(&a->lock);
+        b->valid = false;
+        pthread_mutex_unlock(&a->lock);
+        struct stat st;
+        if (fstat(a->fd, &st) == 0)
+            a->size = st.st_size;
+    }
+    return len;
+}
+
+static void async_destroy(void *ptr)
+{
+    struct file_async *a = ptr;
+    // Frees the pool first, which waits until all pending reads are done.
+    talloc_free(a->pool);
+    for (int n = 0; n < a->max_depth; n++)
+        free(a->blocks[n].data);
+    pthread_cond_destroy(&a->wakeup);
+    pthread_mutex_destroy(&a->lock);
+}
+
+static struct file_async *async_create(stream_t *s, int fd,
+                                       struct stream_file_opts *opts)
+{
+    struct file_async *a = talloc_zero(s, struct file_async);
+    a->fd = fd;
+    a->block_size = MP_ALIGN_UP(opts->async_block_size * 1024, DIRECT_IO_ALIGN);
+    a->max_depth = opts->async_depth;
+    a->depth = MPMIN(2, a->max_depth);
+    a->size = -1;
+    a->rate_start = mp_time_us();
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->wakeup, NULL);
+    a->blocks = talloc_zero_array(a, struct file_block, a->max_depth);
+    talloc_set_destructor(a, async_destroy);
+
+    for (int n = 0; n < a->max_depth; n++) {
+        struct file_block *b = &a->blocks[n];
+        b->a = a;
+        if (posix_memalign((void **)&b->data, DIRECT_IO_ALIGN, a->block_size)) {
+            b->data = NULL;
+            goto error;
+        }
+    }
+
+    a->pool = mp_thread_pool_create(a, a->max_depth);
+    if (!a->pool)
+        goto error;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+        a->size = st.st_size;
+
+    MP_VERBOSE(s, "Using async reads: %d KiB blocks, up to %d in flight.\n",
+               a->block_size / 1024, a->max_depth);
+    return a;
+
+error:
+    MP_WARN(s, "Could not set up async reads.\n");
+    talloc_free(a);
+    return NULL;
+}
+#endif
+
 static int write_buffer(stream_t *s, char *buffer, int len)
 {
     struct priv *p = s->priv;
@@ -103,6 +357,14 @@ static int seek(stream_t *s, int64_t newpos)
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
+#ifndef __MINGW32__
+static int async_seek(stream_t *s, int64_t newpos)
+{
+    // Reads are positioned with pread(), so just let s->pos change.
+    return newpos >= 0;
+}
+#endif
+
 static int control(stream_t *s, int cmd, void *arg)
 {
     struct priv *p = s->priv;
@@ -123,6 +385,8 @@ static int control(stream_t *s, int cmd, void *arg)
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    talloc_free(p->async);
+    p->async = NULL;
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
@@ -236,6 +500,10 @@ static int open_f(stream_t *stream)
     stream->priv = p;
     stream->type = STREAMTYPE_FILE;
 
+    struct stream_file_opts *opts = NULL;
+    if (stream->global->config)
+        opts = mp_get_config_group(stream, stream->global, &stream_file_conf);
+
     bool write = stream->mode == STREAM_WRITE;
     int m = O_CLOEXEC | (write ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY);
 
@@ -271,7 +539,15 @@ static int open_f(stream_t *stream)
             m |= O_NONBLOCK;
         p->use_poll = true;
 #endif
-        p->fd = open(filename, m | O_BINARY, openmode);
+#ifdef O_DIRECT
+        if (!write && opts && opts->async && opts->direct_io) {
+            p->fd = open(filename, m | O_DIRECT, openmode);
+            if (p->fd < 0 && errno == EINVAL)
+                MP_WARN(stream, "O_DIRECT not supported, disabling it.\n");
+        }
+        if (p->fd < 0)
+#endif
+            p->fd = open(filename, m | O_BINARY, openmode);
         if (p->fd < 0) {
             MP_ERR(stream, "Cannot open file '%s': %s\n",
                    filename, mp_strerror(errno));
@@ -291,9 +567,16 @@ static int open_f(stream_t *stream)
                 // O_NONBLOCK has weird semantics on file locks; remove it.
                 int val = fcntl(p->fd, F_GETFL) & ~(unsigned)O_NONBLOCK;
                 fcntl(p->fd, F_SETFL, val);
+                if (!write && opts && opts->async)
+                    p->async = async_create(stream, p->fd, opts);
             }
 #endif
         }
+#ifdef O_DIRECT
+        // Normal read() calls can't deal with the alignment requirements.
+        if (!p->async)
+            fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) & ~(unsigned)O_DIRECT);
+#endif
         p->close = true;
     }
 
@@ -315,6 +598,14 @@ static int open_f(stream_t *stream)
     stream->read_chunk = 64 * 1024;
     stream->close = s_close;
 
+#ifndef __MINGW32__
+    if (p->async) {
+        stream->fill_buffer = async_fill_buffer;
+        stream->seek = async_seek;
+        stream->read_chunk = MPMIN(p->async->block_size, STREAM_MAX_BUFFER_SIZE);
+    }
+#endif
+
     if (check_stream_network(p->fd))
         stream->streaming = true;
 
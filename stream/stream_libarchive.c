@@ -15,11 +15,19 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include <archive.h>
 #include <archive_entry.h>
 
+#include "osdep/io.h"
+
 #include "misc/bstr.h"
 #include "common/common.h"
+#include "common/global.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
 #include "stream.h"
 
 #include "stream_libarchive.h"
@@ -303,17 +311,200 @@ bool mp_archive_next_entry(struct mp_archive *mpa)
     return false;
 }
 
+#define OPT_BASE_STRUCT struct stream_libarchive_opts
+struct stream_libarchive_opts {
+    int seek_cache_size;
+};
+
+const struct m_sub_options stream_libarchive_conf = {
+    .opts = (const m_option_t[]) {
+        OPT_INTRANGE("archive-seek-cache-size", seek_cache_size, 0, 0,
+                     0x7fffffff),
+        {0}
+    },
+    .size = sizeof(struct stream_libarchive_opts),
+    .defaults = &(const struct stream_libarchive_opts){
+        .seek_cache_size = 256 * 1024,
+    },
+};
+
+// Most formats can't seek, so reaching data before the current decompressor
+// position means decompressing the entry from the start. To avoid this, the
+// decompressed data is kept in blocks in an anonymous temporary file, and
+// reads are served from there if possible.
+#define SEEK_BLOCK_SIZE (256 * 1024)
+
+struct seek_block {
+    int64_t index;      // entry offset / SEEK_BLOCK_SIZE (-1 if unused)
+    int size;           // valid bytes (less than SEEK_BLOCK_SIZE at the end)
+    int64_t last_use;   // for LRU eviction
+};
+
+struct seek_cache {
+    FILE *file;
+    struct seek_block *blocks;  // blocks[n] is at n * SEEK_BLOCK_SIZE in file
+    int num_blocks, max_blocks;
+    int64_t use_count;
+    int last_hit;
+    // Block being collected from the decompressor output.
+    char *pending;
+    int64_t pending_pos;        // entry offset of pending[0] (-1 if none)
+    int pending_size;
+};
+
 struct priv {
     struct mp_archive *mpa;
     struct stream *src;
     int64_t entry_size;
     char *entry_name;
+    int64_t arch_pos;           // entry offset of the decompressor
+    int64_t cache_size;         // seek cache size limit (0 if disabled)
+    struct seek_cache *cache;   // NULL if disabled or not needed yet
+    char *skip_buf;             // for move_archive(), allocated on first use
 };
 
+#define SKIP_BUF_SIZE (64 * 1024)
+
+static struct seek_cache *seek_cache_create(stream_t *s, int64_t size,
+                                            int64_t entry_size)
+{
+    // Never hold more than the whole entry.
+    if (entry_size >= 0)
+        size = MPMIN(size, entry_size + SEEK_BLOCK_SIZE - 1);
+    int max_blocks = size / SEEK_BLOCK_SIZE;
+    if (max_blocks < 2)
+        return NULL;
+
+    FILE *file = tmpfile();
+    if (!file) {
+        MP_WARN(s, "can't create temporary file for the seek cache\n");
+        return NULL;
+    }
+
+    struct seek_cache *c = talloc_zero(NULL, struct seek_cache);
+    c->file = file;
+    c->max_blocks = max_blocks;
+    c->last_hit = -1;
+    c->pending = talloc_size(c, SEEK_BLOCK_SIZE);
+    c->pending_pos = -1;
+    return c;
+}
+
+static void seek_cache_destroy(struct seek_cache *c)
+{
+    if (!c)
+        return;
+    fclose(c->file);
+    talloc_free(c);
+}
+
+static int seek_cache_find(struct seek_cache *c, int64_t pos)
+{
+    int64_t index = pos / SEEK_BLOCK_SIZE;
+    if (c->last_hit >= 0 && c->blocks[c->last_hit].index == index)
+        return c->last_hit;
+    for (int n = 0; n < c->num_blocks; n++) {
+        if (c->blocks[n].index == index) {
+            c->last_hit = n;
+            return n;
+        }
+    }
+    return -1;
+}
+
+// Read cached data at the entry offset pos. Returns the number of bytes read,
+// or 0 if the data is not cached.
+static int seek_cache_read(stream_t *s, struct seek_cache *c, int64_t pos,
+                           char *buffer, int len)
+{
+    int n = seek_cache_find(c, pos);
+    if (n < 0)
+        return 0;
+    struct seek_block *b = &c->blocks[n];
+    int offset = pos % SEEK_BLOCK_SIZE;
+    len = MPMIN(len, b->size - offset);
+    if (len <= 0)
+        return 0;
+    if (fseeko(c->file, n * (int64_t)SEEK_BLOCK_SIZE + offset, SEEK_SET) ||
+        fread(buffer, len, 1, c->file) != 1)
+    {
+        MP_WARN(s, "can't read from the seek cache\n");
+        b->index = -1;
+        return 0;
+    }
+    b->last_use = ++c->use_count;
+    return len;
+}
+
+static void seek_cache_store(stream_t *s, struct seek_cache *c)
+{
+    int n = seek_cache_find(c, c->pending_pos);
+    if (n >= 0 && c->blocks[n].size >= c->pending_size)
+        return; // was decompressed again after reopening the archive
+    if (n < 0 && c->num_blocks < c->max_blocks) {
+        MP_TARRAY_GROW(c, c->blocks, c->num_blocks);
+        n = c->num_blocks++;
+    } else if (n < 0) {
+        n = 0;
+        for (int i = 1; i < c->num_blocks; i++) {
+            if (c->blocks[i].last_use < c->blocks[n].last_use)
+                n = i;
+        }
+    }
+    c->blocks[n] = (struct seek_block){ .index = -1 };
+    if (fseeko(c->file, n * (int64_t)SEEK_BLOCK_SIZE, SEEK_SET) ||
+        fwrite(c->pending, c->pending_size, 1, c->file) != 1)
+    {
+        MP_WARN(s, "can't write to the seek cache\n");
+        return;
+    }
+    c->blocks[n] = (struct seek_block){
+        .index = c->pending_pos / SEEK_BLOCK_SIZE,
+        .size = c->pending_size,
+        .last_use = ++c->use_count,
+    };
+}
+
+// Add decompressed data at the entry offset pos. Only whole blocks are stored
+// (or the partial block at the end of the entry, see seek_cache_end()).
+static void seek_cache_add(stream_t *s, struct seek_cache *c, int64_t pos,
+                           const char *data, int len)
+{
+    while (len > 0) {
+        int offset = pos % SEEK_BLOCK_SIZE;
+        if (offset == 0) {
+            c->pending_pos = pos;
+            c->pending_size = 0;
+        } else if (c->pending_pos + c->pending_size != pos) {
+            c->pending_pos = -1; // not contiguous (after a libarchive seek)
+        }
+        int copy = MPMIN(len, SEEK_BLOCK_SIZE - offset);
+        if (c->pending_pos >= 0) {
+            memcpy(c->pending + c->pending_size, data, copy);
+            c->pending_size += copy;
+            if (c->pending_size == SEEK_BLOCK_SIZE) {
+                seek_cache_store(s, c);
+                c->pending_pos = -1;
+            }
+        }
+        pos += copy;
+        data += copy;
+        len -= copy;
+    }
+}
+
+static void seek_cache_end(stream_t *s, struct seek_cache *c)
+{
+    if (c->pending_pos >= 0 && c->pending_size > 0)
+        seek_cache_store(s, c);
+    c->pending_pos = -1;
+}
+
 static int reopen_archive(stream_t *s)
 {
     struct priv *p = s->priv;
     mp_archive_free(p->mpa);
+    p->arch_pos = 0;
     p->mpa = mp_archive_new(s->log, p->src, MP_ARCHIVE_FLAG_UNSAFE);
     if (!p->mpa)
         return STREAM_ERROR;
@@ -335,56 +526,99 @@ static int reopen_archive(stream_t *s)
     return STREAM_ERROR;
 }
 
-static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
+// Read from the decompressor, and add the data to the seek cache.
+static int read_archive(stream_t *s, char *buffer, int len)
 {
     struct priv *p = s->priv;
-    if (!p->mpa)
-        return 0;
-    int r = archive_read_data(p->mpa->arch, buffer, max_len);
-    if (r < 0)
+    int r = archive_read_data(p->mpa->arch, buffer, len);
+    if (r < 0) {
         MP_ERR(s, "%s\n", archive_error_string(p->mpa->arch));
+        return -1;
+    }
+    if (p->cache) {
+        if (r > 0) {
+            seek_cache_add(s, p->cache, p->arch_pos, buffer, r);
+        } else {
+            seek_cache_end(s, p->cache);
+        }
+    }
+    p->arch_pos += r;
     return r;
 }
 
-static int archive_entry_seek(stream_t *s, int64_t newpos)
+// Move the decompressor to the given entry offset.
+static int move_archive(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
-    if (!p->mpa)
-        return -1;
-    if (archive_seek_data(p->mpa->arch, newpos, SEEK_SET) >= 0)
+    if (newpos == p->arch_pos)
+        return 1;
+    if (archive_seek_data(p->mpa->arch, newpos, SEEK_SET) >= 0) {
+        p->arch_pos = newpos;
         return 1;
+    }
     // libarchive can't seek in most formats.
-    if (newpos < s->pos) {
+    if (newpos < p->arch_pos) {
         // Hack seeking backwards into working by reopening the archive and
-        // starting over.
+        // starting over. Only now the format is known to need the seek
+        // cache, which is filled while decompressing again from the start.
+        if (!p->cache && p->cache_size > 0) {
+            p->cache = seek_cache_create(s, p->cache_size, p->entry_size);
+            p->cache_size = 0; // don't try again
+        }
         MP_VERBOSE(s, "trying to reopen archive for performing seek\n");
         if (reopen_archive(s) < STREAM_OK)
             return -1;
-        s->pos = 0;
     }
-    if (newpos > s->pos) {
-        // For seeking forwards, just keep reading data (there's no libarchive
-        // skip function either).
-        char buffer[4096];
-        while (newpos > s->pos) {
-            if (mp_cancel_test(s->cancel))
-                return -1;
-
-            int size = MPMIN(newpos - s->pos, sizeof(buffer));
-            int r = archive_read_data(p->mpa->arch, buffer, size);
-            if (r < 0) {
-                MP_ERR(s, "%s\n", archive_error_string(p->mpa->arch));
-                return -1;
-            }
-            s->pos += r;
-        }
+    // For seeking forwards, just keep reading data (there's no libarchive
+    // skip function either). This runs on the cache thread, so keep the
+    // buffer off the stack.
+    if (newpos > p->arch_pos && !p->skip_buf)
+        p->skip_buf = talloc_size(p, SKIP_BUF_SIZE);
+    while (newpos > p->arch_pos) {
+        if (mp_cancel_test(s->cancel))
+            return -1;
+
+        int size = MPMIN(newpos - p->arch_pos, SKIP_BUF_SIZE);
+        int r = read_archive(s, p->skip_buf, size);
+        if (r < 0)
+            return -1;
+        if (r == 0)
+            break; // EOF
     }
     return 1;
 }
 
+static int archive_entry_fill_buffer(stream_t *s, char *buffer, int max_len)
+{
+    struct priv *p = s->priv;
+    if (!p->mpa)
+        return 0;
+    if (p->cache) {
+        int r = seek_cache_read(s, p->cache, s->pos, buffer, max_len);
+        if (r > 0)
+            return r;
+    }
+    if (move_archive(s, s->pos) < 0)
+        return -1;
+    return read_archive(s, buffer, max_len);
+}
+
+static int archive_entry_seek(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    if (!p->mpa)
+        return -1;
+    // Cached data is read without moving the decompressor; the remaining
+    // part is reached in archive_entry_fill_buffer().
+    if (p->cache && seek_cache_find(p->cache, newpos) >= 0)
+        return 1;
+    return move_archive(s, newpos);
+}
+
 static void archive_entry_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    seek_cache_destroy(p->cache);
     mp_archive_free(p->mpa);
     free_stream(p->src);
 }
@@ -436,6 +670,14 @@ static int archive_entry_open(stream_t *stream)
     if (p->src->seekable) {
         stream->seek = archive_entry_seek;
         stream->seekable = true;
+
+        struct stream_libarchive_opts *opts = NULL;
+        if (stream->global->config) {
+            opts = mp_get_config_group(stream, stream->global,
+                                       &stream_libarchive_conf);
+        }
+        if (opts)
+            p->cache_size = opts->seek_cache_size * 1024LL;
     }
     stream->close = archive_entry_close;
     stream->control = archive_entry_control;
@@ -28,6 +28,7 @@
 
 #include "options/options.h"
 #include "common/common.h"
+#include "common/mem_budget.h"
 #include "common/msg.h"
 #include "demux/demux.h"
 #include "video/csputils.h"
@@ -53,8 +54,13 @@ struct sd_ass_priv {
     int64_t *seen_packets;
     int num_seen_packets;
     bool duration_unknown;
+    struct mp_mem_client *mem;
+    int cache_limit_mb;     // bitmap cache limit passed to libass (0=default)
 };
 
+// libass' default bitmap cache size.
+#define ASS_BITMAP_CACHE_MB 128
+
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
 
@@ -137,6 +143,7 @@ static void enable_output(struct sd *sd, bool enable)
         ctx->ass_renderer = NULL;
     } else {
         ctx->ass_renderer = ass_renderer_init(ctx->ass_library);
+        ctx->cache_limit_mb = 0;
 
         mp_ass_configure_fonts(ctx->ass_renderer, sd->opts->sub_style,
                                sd->global, sd->log);
@@ -215,6 +222,10 @@ static int init(struct sd *sd)
 
     ctx->packer = mp_ass_packer_alloc(ctx);
 
+    ctx->mem = mp_mem_client_new(ctx, sd->global, "libass",
+                                 ASS_BITMAP_CACHE_MB * 1024LL * 1024);
+    mp_mem_client_report(ctx->mem, ASS_BITMAP_CACHE_MB * 1024LL * 1024);
+
     return 0;
 }
 
@@ -449,6 +460,16 @@ static void get_bitmaps(struct sd *sd, struct mp_osd_res dim, int format,
     }
     configure_ass(sd, &dim, converted, track);
     ass_set_pixel_aspect(renderer, scale);
+    int64_t limit = mp_mem_client_get_limit(ctx->mem) / (1024 * 1024);
+    int cache_limit_mb = limit < ASS_BITMAP_CACHE_MB ? MPMAX(limit, 1) : 0;
+    if (cache_limit_mb != ctx->cache_limit_mb) {
+        ass_set_cache_limits(renderer, 0, cache_limit_mb);
+        ctx->cache_limit_mb = cache_limit_mb;
+        // libass doesn't expose its actual cache usage, so report the
+        // limit it may fill up to.
+        int used_mb = cache_limit_mb ? cache_limit_mb : ASS_BITMAP_CACHE_MB;
+        mp_mem_client_report(ctx->mem, used_mb * 1024LL * 1024);
+    }
     if (!converted && (!opts->ass_style_override ||
                        opts->ass_vsfilter_blur_compat))
     {
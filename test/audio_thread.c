@@ -0,0 +1,101 @@
+#include "test_helpers.h"
+#include "libmpv/client.h"
+
+// Play synthetic A/V input with the audio thread writing to the AO, and check
+// that audio and video stay in sync across pausing and seeking.
+
+static void wait_event(mpv_handle *h, mpv_event_id id)
+{
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, 10);
+        assert_int_not_equal(ev->event_id, MPV_EVENT_NONE); // timeout
+        assert_int_not_equal(ev->event_id, MPV_EVENT_END_FILE);
+        if (ev->event_id == id)
+            return;
+    }
+}
+
+// Let playback run for the given time.
+static void run_for(mpv_handle *h, double secs)
+{
+    double start = mpv_get_time_us(h) / 1e6;
+    while (mpv_get_time_us(h) / 1e6 - start < secs) {
+        mpv_event *ev = mpv_wait_event(h, 0.05);
+        assert_int_not_equal(ev->event_id, MPV_EVENT_END_FILE);
+    }
+}
+
+static void check_avsync(mpv_handle *h)
+{
+    double avsync = 1e9;
+    assert_int_equal(mpv_get_property(h, "avsync", MPV_FORMAT_DOUBLE, &avsync), 0);
+    assert_true(fabs(avsync) < 0.1);
+}
+
+static void check_time_pos(mpv_handle *h, double min, double max)
+{
+    double pos = -1;
+    assert_int_equal(mpv_get_property(h, "time-pos", MPV_FORMAT_DOUBLE, &pos), 0);
+    assert_true(pos >= min && pos <= max);
+}
+
+static void set_pause(mpv_handle *h, int pause)
+{
+    assert_int_equal(mpv_set_property(h, "pause", MPV_FORMAT_FLAG, &pause), 0);
+}
+
+static void test_seek_pause_avsync(void **state) {
+    mpv_handle *h = mpv_create();
+    assert_non_null(h);
+    mpv_set_option_string(h, "ao", "null");
+    mpv_set_option_string(h, "vo", "null");
+    mpv_set_option_string(h, "audio-thread-buffer", "0.2");
+    mpv_set_option_string(h, "audio-file", "av://lavfi:sine=duration=60");
+    assert_int_equal(mpv_initialize(h), 0);
+
+    const char *cmd[] = {"loadfile", "av://lavfi:testsrc=rate=25:duration=60",
+                         NULL};
+    assert_int_equal(mpv_command(h, cmd), 0);
+    wait_event(h, MPV_EVENT_PLAYBACK_RESTART);
+    run_for(h, 1.0);
+    check_avsync(h);
+
+    // Pausing must not let the audio thread keep writing to the paused AO.
+    set_pause(h, 1);
+    double paused_pos = -1;
+    mpv_get_property(h, "time-pos", MPV_FORMAT_DOUBLE, &paused_pos);
+    run_for(h, 0.5);
+    check_time_pos(h, paused_pos - 0.05, paused_pos + 0.05);
+    set_pause(h, 0);
+    run_for(h, 1.0);
+    check_avsync(h);
+
+    // No audio from before the seek may be played after it.
+    for (int n = 0; n < 3; n++) {
+        const char *seek[] = {"seek", n % 2 ? "-5" : "20", NULL};
+        assert_int_equal(mpv_command(h, seek), 0);
+        wait_event(h, MPV_EVENT_PLAYBACK_RESTART);
+        run_for(h, 1.0);
+        check_avsync(h);
+    }
+    check_time_pos(h, 30, 50);
+
+    // Seeking while paused.
+    set_pause(h, 1);
+    const char *seek[] = {"seek", "10", "absolute", NULL};
+    assert_int_equal(mpv_command(h, seek), 0);
+    wait_event(h, MPV_EVENT_PLAYBACK_RESTART);
+    set_pause(h, 0);
+    run_for(h, 1.0);
+    check_avsync(h);
+    check_time_pos(h, 10.5, 12.5);
+
+    mpv_terminate_destroy(h);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_seek_pause_avsync),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
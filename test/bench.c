@@ -0,0 +1,641 @@
+/*
+ * Micro-benchmarks for hot CPU paths, run on synthetic input.
+ *
+ * Usage: test/bench [name-prefix...]
+ *
+ * Runs all benchmarks (or only those whose name starts with one of the given
+ * prefixes), and writes the results as JSON to stdout, so that they can be
+ * compared between builds.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "common/msg_control.h"
+#include "mpv_talloc.h"
+
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+#include "audio/filter/af.h"
+#include "demux/demux.h"
+#include "demux/ebml.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "options/m_config.h"
+#include "options/m_property.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "sub/draw_bmp.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+
+// Each benchmark runs for at least this long, and at least MIN_ITERATIONS.
+#define MIN_TIME_US 300000
+#define MIN_ITERATIONS 5
+
+struct bench_ctx {
+    void *ta;                   // freed after the benchmark has finished
+    struct mpv_global *global;
+    void *priv;
+};
+
+struct bench {
+    const char *name;
+    // Set up the synthetic input in b->priv.
+    void (*init)(struct bench_ctx *b);
+    // Process the input once. Returns the number of bytes processed (used to
+    // compute the throughput), or 0 if this makes no sense.
+    int64_t (*run)(struct bench_ctx *b);
+};
+
+static uint32_t rand_state = 1;
+
+// Deterministic, so that all runs process the same data.
+static uint32_t bench_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+/* demux_mkv: EBML element reads and SimpleBlock parsing */
+
+#define MKV_BLOCK_SIZE 4000
+#define MKV_NUM_BLOCKS 2000
+
+struct mkv_priv {
+    stream_t *s;
+    int64_t size;
+};
+
+static void mkv_destroy(void *ptr)
+{
+    struct mkv_priv *p = ptr;
+    free_stream(p->s);
+}
+
+static int put_ebml_id(uint8_t *p, uint32_t id)
+{
+    int len = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+    for (int n = 0; n < len; n++)
+        p[n] = id >> ((len - n - 1) * 8);
+    return len;
+}
+
+// Always uses 8 bytes, like muxers that don't know the size in advance.
+static int put_ebml_length(uint8_t *p, uint64_t len)
+{
+    p[0] = 0x01;
+    for (int n = 1; n < 8; n++)
+        p[n] = len >> ((7 - n) * 8);
+    return 8;
+}
+
+// Write the ID and a placeholder length of a master element, and return the
+// position of the length, which mkv_end_master() fills in.
+static uint8_t *mkv_begin_master(uint8_t **ptr, uint32_t id)
+{
+    *ptr += put_ebml_id(*ptr, id);
+    uint8_t *len = *ptr;
+    *ptr += 8;
+    return len;
+}
+
+static void mkv_end_master(uint8_t *ptr, uint8_t *len)
+{
+    put_ebml_length(len, ptr - (len + 8));
+}
+
+static void mkv_put_uint(uint8_t **ptr, uint32_t id, uint32_t val)
+{
+    *ptr += put_ebml_id(*ptr, id);
+    *ptr += put_ebml_length(*ptr, 4);
+    for (int n = 0; n < 4; n++)
+        (*ptr)[n] = val >> ((3 - n) * 8);
+    *ptr += 4;
+}
+
+static void mkv_put_float(uint8_t **ptr, uint32_t id, double val)
+{
+    union { double d; uint64_t i; } u = {.d = val};
+    *ptr += put_ebml_id(*ptr, id);
+    *ptr += put_ebml_length(*ptr, 8);
+    for (int n = 0; n < 8; n++)
+        (*ptr)[n] = u.i >> ((7 - n) * 8);
+    *ptr += 8;
+}
+
+static void mkv_put_string(uint8_t **ptr, uint32_t id, const char *str)
+{
+    *ptr += put_ebml_id(*ptr, id);
+    *ptr += put_ebml_length(*ptr, strlen(str));
+    memcpy(*ptr, str, strlen(str));
+    *ptr += strlen(str);
+}
+
+// A file with a single PCM audio track and one cluster of SimpleBlocks.
+static void mkv_init(struct bench_ctx *b)
+{
+    struct mkv_priv *p = b->priv = talloc_zero(b->ta, struct mkv_priv);
+    talloc_set_destructor(p, mkv_destroy);
+    uint8_t *data = talloc_size(b->ta, 4096 + MKV_NUM_BLOCKS *
+                                       (MKV_BLOCK_SIZE + 4 + 1 + 8));
+    uint8_t *ptr = data, *len, *seg_len, *tracks_len, *track_len, *audio_len;
+
+    len = mkv_begin_master(&ptr, EBML_ID_EBML);
+    mkv_put_string(&ptr, EBML_ID_DOCTYPE, "matroska");
+    mkv_end_master(ptr, len);
+
+    seg_len = mkv_begin_master(&ptr, MATROSKA_ID_SEGMENT);
+
+    len = mkv_begin_master(&ptr, MATROSKA_ID_INFO);
+    mkv_put_uint(&ptr, MATROSKA_ID_TIMECODESCALE, 1000000);
+    mkv_end_master(ptr, len);
+
+    tracks_len = mkv_begin_master(&ptr, MATROSKA_ID_TRACKS);
+    track_len = mkv_begin_master(&ptr, MATROSKA_ID_TRACKENTRY);
+    mkv_put_uint(&ptr, MATROSKA_ID_TRACKNUMBER, 1);
+    mkv_put_uint(&ptr, MATROSKA_ID_TRACKUID, 1);
+    mkv_put_uint(&ptr, MATROSKA_ID_TRACKTYPE, 2); // audio
+    mkv_put_string(&ptr, MATROSKA_ID_CODECID, "A_PCM/INT/LIT");
+    audio_len = mkv_begin_master(&ptr, MATROSKA_ID_AUDIO);
+    mkv_put_float(&ptr, MATROSKA_ID_SAMPLINGFREQUENCY, 48000);
+    mkv_put_uint(&ptr, MATROSKA_ID_CHANNELS, 2);
+    mkv_put_uint(&ptr, MATROSKA_ID_BITDEPTH, 16);
+    mkv_end_master(ptr, audio_len);
+    mkv_end_master(ptr, track_len);
+    mkv_end_master(ptr, tracks_len);
+
+    len = mkv_begin_master(&ptr, MATROSKA_ID_CLUSTER);
+    mkv_put_uint(&ptr, MATROSKA_ID_TIMECODE, 0);
+    for (int n = 0; n < MKV_NUM_BLOCKS; n++) {
+        ptr += put_ebml_id(ptr, MATROSKA_ID_SIMPLEBLOCK);
+        ptr += put_ebml_length(ptr, MKV_BLOCK_SIZE + 4);
+        ptr[0] = 0x81;              // track number 1
+        ptr[1] = (n >> 8) & 0x7F;   // timecode
+        ptr[2] = n & 0xFF;
+        ptr[3] = 0x80;              // keyframe, no lacing
+        ptr += 4;
+        for (int i = 0; i < MKV_BLOCK_SIZE; i++)
+            ptr[i] = bench_rand();
+        ptr += MKV_BLOCK_SIZE;
+    }
+    mkv_end_master(ptr, len);
+    mkv_end_master(ptr, seg_len);
+
+    p->size = ptr - data;
+    p->s = open_memory_stream(data, p->size);
+}
+
+// Open the file with demux_mkv, and read all packets.
+static int64_t mkv_run(struct bench_ctx *b)
+{
+    struct mkv_priv *p = b->priv;
+    stream_seek(p->s, 0);
+    struct demuxer_params params = {
+        .force_format = "mkv",
+        .disable_timeline = true,
+    };
+    struct demuxer *demuxer = demux_open(p->s, &params, b->global);
+    if (!demuxer || demux_get_num_stream(demuxer) != 1)
+        abort();
+    struct sh_stream *sh = demux_get_stream(demuxer, 0);
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+    int num = 0;
+    struct demux_packet *pkt;
+    while ((pkt = demux_read_packet(sh))) {
+        if (pkt->len != MKV_BLOCK_SIZE)
+            abort();
+        talloc_free(pkt);
+        num++;
+    }
+    if (num != MKV_NUM_BLOCKS)
+        abort();
+    free_demuxer(demuxer);
+    return p->size;
+}
+
+/* mp_audio_buffer */
+
+#define AUDIO_RATE 48000
+#define AUDIO_FRAME_SAMPLES 1024
+#define AUDIO_FRAMES 200
+
+struct audio_priv {
+    struct mp_audio_pool *pool;
+    struct mp_audio *frame;
+    struct mp_audio_buffer *buffer;
+    struct af_stream *af;
+};
+
+static void audio_init_frame(struct bench_ctx *b)
+{
+    struct audio_priv *p = b->priv = talloc_zero(b->ta, struct audio_priv);
+    struct mp_audio fmt = {0};
+    mp_audio_set_format(&fmt, AF_FORMAT_FLOAT);
+    mp_audio_set_num_channels(&fmt, 2);
+    fmt.rate = AUDIO_RATE;
+    p->pool = mp_audio_pool_create(b->ta);
+    p->frame = mp_audio_pool_get(p->pool, &fmt, AUDIO_FRAME_SAMPLES);
+    talloc_steal(b->ta, p->frame);
+    float *data = p->frame->planes[0];
+    for (int n = 0; n < AUDIO_FRAME_SAMPLES; n++) {
+        data[n * 2 + 0] = sin(n * 2 * M_PI * 440 / AUDIO_RATE);
+        data[n * 2 + 1] = sin(n * 2 * M_PI * 660 / AUDIO_RATE);
+    }
+}
+
+static void audio_buffer_init(struct bench_ctx *b)
+{
+    audio_init_frame(b);
+    struct audio_priv *p = b->priv;
+    p->buffer = mp_audio_buffer_create(b->ta);
+    mp_audio_buffer_reinit(p->buffer, p->frame);
+}
+
+static int64_t audio_buffer_run(struct bench_ctx *b)
+{
+    struct audio_priv *p = b->priv;
+    for (int n = 0; n < AUDIO_FRAMES; n++) {
+        mp_audio_buffer_append(p->buffer, p->frame);
+        if (mp_audio_buffer_samples(p->buffer) >= AUDIO_FRAME_SAMPLES * 4) {
+            struct mp_audio data;
+            mp_audio_buffer_peek(p->buffer, &data);
+            mp_audio_buffer_skip(p->buffer, AUDIO_FRAME_SAMPLES * 3);
+        }
+    }
+    mp_audio_buffer_clear(p->buffer);
+    return (int64_t)AUDIO_FRAMES * AUDIO_FRAME_SAMPLES * p->frame->sstride;
+}
+
+/* Audio filters */
+
+static void af_bench_init(struct bench_ctx *b, char *name, char **args)
+{
+    audio_init_frame(b);
+    struct audio_priv *p = b->priv;
+    p->af = af_new(b->global);
+    talloc_steal(b->ta, p->af);
+    mp_audio_copy_config(&p->af->input, p->frame);
+    mp_audio_copy_config(&p->af->output, p->frame);
+    if (!af_add(p->af, name, "bench", args) || af_init(p->af) < 0) {
+        fprintf(stderr, "could not create audio filter %s\n", name);
+        abort();
+    }
+}
+
+static void af_volume_init(struct bench_ctx *b)
+{
+    af_bench_init(b, "volume", (char *[]){"volumedb", "-6", NULL});
+}
+
+static void af_scaletempo_init(struct bench_ctx *b)
+{
+    af_bench_init(b, "scaletempo", (char *[]){"scale", "1.5", NULL});
+}
+
+static int64_t af_run(struct bench_ctx *b)
+{
+    struct audio_priv *p = b->priv;
+    for (int n = 0; n < AUDIO_FRAMES; n++) {
+        struct mp_audio *frame = mp_audio_pool_new_copy(p->pool, p->frame);
+        if (!frame || af_filter_frame(p->af, frame) < 0)
+            abort();
+        while (af_output_frame(p->af, false) > 0)
+            talloc_free(af_read_output_frame(p->af));
+    }
+    return (int64_t)AUDIO_FRAMES * AUDIO_FRAME_SAMPLES * p->frame->sstride;
+}
+
+/* Subtitle blending */
+
+#define SUB_W 1920
+#define SUB_H 1080
+#define SUB_PARTS 20
+
+struct draw_bmp_priv {
+    struct mp_image *dst;
+    struct sub_bitmaps sbs;
+    struct mp_draw_sub_cache *cache;
+};
+
+static void draw_bmp_destroy(void *ptr)
+{
+    struct draw_bmp_priv *p = ptr;
+    talloc_free(p->cache);
+    talloc_free(p->dst);
+}
+
+static void draw_bmp_init(struct bench_ctx *b)
+{
+    struct draw_bmp_priv *p = b->priv = talloc_zero(b->ta, struct draw_bmp_priv);
+    talloc_set_destructor(p, draw_bmp_destroy);
+    p->dst = mp_image_alloc(IMGFMT_420P, SUB_W, SUB_H);
+    mp_image_clear(p->dst, 0, 0, SUB_W, SUB_H);
+    p->sbs = (struct sub_bitmaps){
+        .format = SUBBITMAP_LIBASS,
+        .parts = talloc_zero_array(p, struct sub_bitmap, SUB_PARTS),
+        .num_parts = SUB_PARTS,
+        .change_id = 1,
+    };
+    for (int n = 0; n < SUB_PARTS; n++) {
+        int w = 600, h = 48;
+        uint8_t *bitmap = talloc_size(p, w * h);
+        for (int i = 0; i < w * h; i++)
+            bitmap[i] = bench_rand() & 0xFF;
+        p->sbs.parts[n] = (struct sub_bitmap){
+            .bitmap = bitmap,
+            .stride = w,
+            .w = w, .h = h,
+            .x = 100 + (n % 2) * 700, .y = 100 + (n / 2) * 90,
+            .dw = w, .dh = h,
+            .libass.color = 0xFFFF0000 | n,
+        };
+    }
+}
+
+static int64_t draw_bmp_run(struct bench_ctx *b)
+{
+    struct draw_bmp_priv *p = b->priv;
+    mp_draw_sub_bitmaps(&p->cache, p->dst, &p->sbs);
+    int64_t bytes = 0;
+    for (int n = 0; n < p->sbs.num_parts; n++)
+        bytes += p->sbs.parts[n].w * p->sbs.parts[n].h;
+    return bytes;
+}
+
+/* Image copies */
+
+struct image_priv {
+    struct mp_image *src, *dst;
+};
+
+static void image_destroy(void *ptr)
+{
+    struct image_priv *p = ptr;
+    talloc_free(p->src);
+    talloc_free(p->dst);
+}
+
+static void image_copy_init(struct bench_ctx *b)
+{
+    struct image_priv *p = b->priv = talloc_zero(b->ta, struct image_priv);
+    talloc_set_destructor(p, image_destroy);
+    p->src = mp_image_alloc(IMGFMT_420P, SUB_W, SUB_H);
+    p->dst = mp_image_alloc(IMGFMT_420P, SUB_W, SUB_H);
+    mp_image_clear(p->src, 0, 0, SUB_W, SUB_H);
+}
+
+static int64_t image_copy_run(struct bench_ctx *b)
+{
+    struct image_priv *p = b->priv;
+    mp_image_copy(p->dst, p->src);
+    return SUB_W * SUB_H * 3 / 2;
+}
+
+// Copy with a stride that differs from the line size, so that memcpy_pic()
+// can't use a single memcpy() call.
+static int64_t memcpy_pic_run(struct bench_ctx *b)
+{
+    struct image_priv *p = b->priv;
+    memcpy_pic(p->dst->planes[0], p->src->planes[0], SUB_W - 64, SUB_H,
+               p->dst->stride[0], p->src->stride[0]);
+    return (SUB_W - 64) * SUB_H;
+}
+
+/* Image pool */
+
+static void image_pool_destroy(void *ptr)
+{
+    struct mp_image_pool **pool = ptr;
+    talloc_free(*pool);
+}
+
+static void image_pool_init(struct bench_ctx *b)
+{
+    struct mp_image_pool **pool = b->priv = talloc_ptrtype(b->ta, pool);
+    *pool = mp_image_pool_new(16);
+    talloc_set_destructor(pool, image_pool_destroy);
+}
+
+// A decoder-like pattern: several frames of different sizes in flight.
+static int64_t image_pool_run(struct bench_ctx *b)
+{
+    struct mp_image_pool *pool = *(struct mp_image_pool **)b->priv;
+    struct mp_image *imgs[8] = {0};
+    for (int n = 0; n < 1000; n++) {
+        int i = n % MP_ARRAY_SIZE(imgs);
+        talloc_free(imgs[i]);
+        imgs[i] = mp_image_pool_get(pool, IMGFMT_420P, 64 + (i % 2) * 16, 64);
+    }
+    for (int i = 0; i < MP_ARRAY_SIZE(imgs); i++)
+        talloc_free(imgs[i]);
+    return 0;
+}
+
+/* JSON */
+
+struct json_priv {
+    char *text;
+    struct mpv_node node;
+};
+
+static void json_init(struct bench_ctx *b)
+{
+    struct json_priv *p = b->priv = talloc_zero(b->ta, struct json_priv);
+    // Roughly what a track-list or playlist reply looks like.
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(p, root.u.list);
+    for (int n = 0; n < 500; n++) {
+        struct mpv_node *e = node_array_add(&root, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", n);
+        node_map_add_string(e, "type", n % 2 ? "audio" : "video");
+        node_map_add_string(e, "title", "Some track title with \"quotes\"");
+        node_map_add_double(e, "demux-fps", 23.976);
+        node_map_add(e, "selected", MPV_FORMAT_FLAG)->u.flag = n == 1;
+    }
+    p->node = root;
+    p->text = talloc_strdup(p, "");
+    if (json_write(&p->text, &p->node) < 0)
+        abort();
+}
+
+static int64_t json_parse_run(struct bench_ctx *b)
+{
+    struct json_priv *p = b->priv;
+    void *tmp = talloc_new(NULL);
+    char *text = talloc_strdup(tmp, p->text);
+    struct mpv_node node;
+    if (json_parse(tmp, &node, &text, 4) < 0)
+        abort();
+    talloc_free(tmp);
+    return strlen(p->text);
+}
+
+static int64_t json_write_run(struct bench_ctx *b)
+{
+    struct json_priv *p = b->priv;
+    char *text = talloc_strdup(NULL, "");
+    if (json_write(&text, &p->node) < 0)
+        abort();
+    int64_t len = strlen(text);
+    talloc_free(text);
+    return len;
+}
+
+/* Property lookups */
+
+#define NUM_PROPERTIES 300
+
+static int property_get(void *ctx, struct m_property *prop, int action,
+                        void *arg)
+{
+    return m_property_int_ro(action, arg, 42);
+}
+
+struct property_priv {
+    struct m_property *list;
+};
+
+static void property_init(struct bench_ctx *b)
+{
+    struct property_priv *p = b->priv = talloc_zero(b->ta, struct property_priv);
+    p->list = talloc_zero_array(p, struct m_property, NUM_PROPERTIES + 1);
+    for (int n = 0; n < NUM_PROPERTIES; n++) {
+        p->list[n] = (struct m_property){
+            .name = talloc_asprintf(p, "property-%d", n),
+            .call = property_get,
+        };
+    }
+}
+
+static int64_t property_run(struct bench_ctx *b)
+{
+    struct property_priv *p = b->priv;
+    for (int n = 0; n < NUM_PROPERTIES; n++) {
+        int val = 0;
+        if (m_property_do(NULL, p->list, p->list[n].name, M_PROPERTY_GET,
+                          &val, NULL) != M_PROPERTY_OK || val != 42)
+            abort();
+    }
+    return 0;
+}
+
+/* talloc */
+
+static int64_t ta_run(struct bench_ctx *b)
+{
+    void *parent = talloc_new(NULL);
+    void *last = parent;
+    for (int n = 0; n < 10000; n++) {
+        void *p = talloc_size(n % 4 ? parent : last, 16 + (n % 64));
+        if (n % 8 == 0)
+            talloc_free(p);
+        else
+            last = p;
+    }
+    talloc_free(parent);
+    return 0;
+}
+
+static const struct bench benchmarks[] = {
+    {"demux-mkv",       mkv_init,           mkv_run},
+    {"audio-buffer",    audio_buffer_init,  audio_buffer_run},
+    {"af-volume",       af_volume_init,     af_run},
+    {"af-scaletempo",   af_scaletempo_init, af_run},
+    {"draw-bmp-ass",    draw_bmp_init,      draw_bmp_run},
+    {"image-copy",      image_copy_init,    image_copy_run},
+    {"memcpy-pic",      image_copy_init,    memcpy_pic_run},
+    {"image-pool",      image_pool_init,    image_pool_run},
+    {"json-parse",      json_init,          json_parse_run},
+    {"json-write",      json_init,          json_write_run},
+    {"property-lookup", property_init,      property_run},
+    {"ta-alloc",        NULL,               ta_run},
+};
+
+static void run_bench(struct mpv_global *global, const struct bench *bench,
+                      struct mpv_node *res)
+{
+    struct bench_ctx b = {
+        .ta = talloc_new(NULL),
+        .global = global,
+    };
+    if (bench->init)
+        bench->init(&b);
+
+    bench->run(&b); // warm up caches and lazily allocated state
+
+    int64_t iterations = 0, bytes = 0, total = 0;
+    int64_t best = INT64_MAX;
+    while (total < MIN_TIME_US || iterations < MIN_ITERATIONS) {
+        int64_t start = mp_time_us();
+        bytes += bench->run(&b);
+        int64_t t = mp_time_us() - start;
+        best = MPMIN(best, t);
+        total += t;
+        iterations++;
+    }
+
+    talloc_free(b.ta);
+
+    struct mpv_node *e = node_array_add(res, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(e, "name", bench->name);
+    node_map_add_int64(e, "iterations", iterations);
+    node_map_add_int64(e, "total-us", total);
+    node_map_add_double(e, "us-per-iteration", total / (double)iterations);
+    node_map_add_int64(e, "best-us", best);
+    if (bytes)
+        node_map_add_double(e, "mb-per-sec", bytes / (double)MPMAX(total, 1));
+
+    fprintf(stderr, "%-16s %12.2f us/iteration\n", bench->name,
+            total / (double)iterations);
+}
+
+static bool matches(const char *name, int argc, char **argv)
+{
+    for (int n = 1; n < argc; n++) {
+        if (strncmp(name, argv[n], strlen(argv[n])) == 0)
+            return true;
+    }
+    return argc < 2;
+}
+
+int main(int argc, char **argv)
+{
+    mp_time_init();
+
+    void *ta = talloc_new(NULL);
+    struct mpv_global *global = talloc_zero(ta, struct mpv_global);
+    mp_msg_init(global);
+    struct m_config *config = m_config_new(ta, global->log, sizeof(struct MPOpts),
+                                           &mp_default_opts, mp_opts);
+    config->global = global;
+    m_config_create_shadow(config);
+    global->opts = config->optstruct;
+
+    struct mpv_node root, *res;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(ta, root.u.list);
+    node_map_add_string(&root, "version", mpv_version);
+    res = node_map_add(&root, "benchmarks", MPV_FORMAT_NODE_ARRAY);
+
+    for (int n = 0; n < MP_ARRAY_SIZE(benchmarks); n++) {
+        if (matches(benchmarks[n].name, argc, argv))
+            run_bench(global, &benchmarks[n], res);
+    }
+
+    char *out = talloc_strdup(ta, "");
+    json_write(&out, &root);
+    printf("%s\n", out);
+
+    talloc_free(config);
+    mp_msg_uninit(global);
+    talloc_free(ta);
+    return 0;
+}
@@ -45,6 +45,9 @@ typedef struct lavc_ctx {
 
     bool hwdec_request_reinit;
     int hwdec_fail_count;
+
+    // Set if intra-only packets are decoded on multiple contexts in parallel.
+    struct lavc_parallel *parallel;
 } vd_ffmpeg_ctx;
 
 struct vd_lavc_hwdec {
@@ -100,4 +103,11 @@ int hwdec_get_max_refs(struct lavc_ctx *ctx);
 
 const char *hwdec_find_decoder(const char *codec, const char *suffix);
 
+struct lavc_parallel *lavc_parallel_create(void *ta_parent,
+                                           AVCodecContext **avctxs, int num);
+int lavc_parallel_decode(struct lavc_parallel *p, AVPacket *pkt,
+                         enum AVDiscard skip_frame, bool drop, AVFrame *out,
+                         AVCodecContext **out_avctx);
+void lavc_parallel_flush(struct lavc_parallel *p);
+
 #endif
@@ -0,0 +1,216 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <assert.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "misc/thread_pool.h"
+
+#include "lavc.h"
+
+// A decoder context, and the packet it's working on. There's at most 1 packet
+// per slot in flight, so a context is never used by 2 threads at once.
+struct slot {
+    struct lavc_parallel *p;
+    AVCodecContext *avctx;
+    AVPacket *pkt;
+    AVFrame *frame;
+    bool drop;                  // discard the frame when it's returned
+    // Protected by p->lock.
+    bool busy;
+    int ret;                    // 1: frame decoded, 0: no frame, <0: error
+};
+
+struct lavc_parallel {
+    struct mp_thread_pool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    struct slot *slots;
+    int num_slots;
+    int next;                   // slot the next packet goes to
+    int num_pending;            // slots whose result wasn't returned yet
+};
+
+static void decode_job(void *arg)
+{
+    struct slot *s = arg;
+    struct lavc_parallel *p = s->p;
+
+    // Intra-only codecs return the frame for a packet immediately, so there
+    // is never anything left in the decoder after this.
+    int ret = avcodec_send_packet(s->avctx, s->pkt);
+    if (ret >= 0) {
+        ret = avcodec_receive_frame(s->avctx, s->frame);
+        if (ret >= 0) {
+            ret = 1;
+        } else if (ret == AVERROR(EAGAIN)) {
+            ret = 0; // skipped frame
+        }
+    }
+    av_packet_unref(s->pkt);
+
+    pthread_mutex_lock(&p->lock);
+    s->ret = ret;
+    s->busy = false;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void wait_slot(struct lavc_parallel *p, struct slot *s)
+{
+    pthread_mutex_lock(&p->lock);
+    while (s->busy)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Wait for the oldest packet in flight, and return its result.
+static int receive_oldest(struct lavc_parallel *p, AVFrame *out,
+                          AVCodecContext **out_avctx)
+{
+    assert(p->num_pending > 0);
+    int idx = (p->next - p->num_pending + p->num_slots) % p->num_slots;
+    struct slot *s = &p->slots[idx];
+    wait_slot(p, s);
+    p->num_pending -= 1;
+    // The decoder might ignore skip_frame, so drop the frame here. This also
+    // applies the decision made for the packet the frame was decoded from,
+    // not for the packet that was passed in the call that returns it.
+    if (s->ret > 0 && s->drop) {
+        av_frame_unref(s->frame);
+        return 0;
+    }
+    if (s->ret > 0) {
+        av_frame_move_ref(out, s->frame);
+        *out_avctx = s->avctx;
+    }
+    return s->ret;
+}
+
+// Decode pkt on the next free context. If all other contexts are busy, wait
+// for the oldest packet in flight, and return its result:
+//  1: a frame was written to out, and *out_avctx is set to the context that
+//     decoded it (it stays untouched until the next call)
+//  0: no frame (still filling the pipeline, or the frame was skipped)
+//  <0: decoding error
+// If drop is set, the frame decoded from pkt is never returned.
+// If pkt is NULL, return the next pending frame, if there's any. Skipped
+// frames and errors are passed over, so once 0 is returned for a NULL packet,
+// everything has been returned.
+int lavc_parallel_decode(struct lavc_parallel *p, AVPacket *pkt,
+                         enum AVDiscard skip_frame, bool drop, AVFrame *out,
+                         AVCodecContext **out_avctx)
+{
+    if (!pkt) {
+        while (p->num_pending) {
+            if (receive_oldest(p, out, out_avctx) > 0)
+                return 1;
+        }
+        return 0;
+    }
+
+    // The slot that returned the last frame is always free here.
+    assert(p->num_pending < p->num_slots);
+    struct slot *s = &p->slots[p->next];
+    if (av_packet_ref(s->pkt, pkt) < 0)
+        return -1;
+    s->avctx->skip_frame = skip_frame;
+    s->drop = drop;
+
+    pthread_mutex_lock(&p->lock);
+    s->busy = true;
+    pthread_mutex_unlock(&p->lock);
+    mp_thread_pool_queue(p->pool, decode_job, s);
+    p->next = (p->next + 1) % p->num_slots;
+    p->num_pending += 1;
+
+    if (p->num_pending < p->num_slots)
+        return 0;
+    return receive_oldest(p, out, out_avctx);
+}
+
+// Wait for all packets in flight, and discard the results.
+void lavc_parallel_flush(struct lavc_parallel *p)
+{
+    for (int n = 0; n < p->num_slots; n++) {
+        struct slot *s = &p->slots[n];
+        wait_slot(p, s);
+        av_frame_unref(s->frame);
+        avcodec_flush_buffers(s->avctx);
+    }
+    p->next = 0;
+    p->num_pending = 0;
+}
+
+static void destroy_parallel(void *ptr)
+{
+    struct lavc_parallel *p = ptr;
+
+    lavc_parallel_flush(p);
+    talloc_free(p->pool);
+
+    for (int n = 0; n < p->num_slots; n++) {
+        struct slot *s = &p->slots[n];
+        av_packet_free(&s->pkt);
+        av_frame_free(&s->frame);
+        avcodec_close(s->avctx);
+        av_freep(&s->avctx->extradata);
+        av_freep(&s->avctx);
+    }
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+}
+
+// Decode packets on the given (opened) contexts in parallel. Up to num-1
+// packets are decoded at once, and frames are returned in the order the
+// packets were passed to lavc_parallel_decode(), which for intra-only codecs
+// is also presentation order. Takes ownership of the contexts, even on
+// failure. Free with talloc_free().
+struct lavc_parallel *lavc_parallel_create(void *ta_parent,
+                                           AVCodecContext **avctxs, int num)
+{
+    assert(num >= 2);
+
+    struct lavc_parallel *p = talloc_zero(ta_parent, struct lavc_parallel);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    talloc_set_destructor(p, destroy_parallel);
+
+    p->slots = talloc_zero_array(p, struct slot, num);
+    p->num_slots = num;
+    bool ok = true;
+    for (int n = 0; n < num; n++) {
+        struct slot *s = &p->slots[n];
+        s->p = p;
+        s->avctx = avctxs[n];
+        s->pkt = av_packet_alloc();
+        s->frame = av_frame_alloc();
+        ok &= s->pkt && s->frame;
+    }
+
+    p->pool = ok ? mp_thread_pool_create(p, num - 1) : NULL;
+    if (!p->pool) {
+        talloc_free(p);
+        return NULL;
+    }
+    return p;
+}
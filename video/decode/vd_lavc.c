@@ -62,6 +62,11 @@
 static void init_avctx(struct dec_video *vd, const char *decoder,
                        struct vd_lavc_hwdec *hwdec);
 static void uninit_avctx(struct dec_video *vd);
+static void configure_avctx(struct dec_video *vd, AVCodecContext *avctx,
+                            bool mp_rawvideo);
+static void init_parallel(struct dec_video *vd, AVCodec *lavc_codec);
+static void handle_frame(struct dec_video *vd, AVCodecContext *avctx,
+                         struct mp_image **out_image);
 
 static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
@@ -77,6 +82,7 @@ struct vd_lavc_params {
     int skip_frame;
     int framedrop;
     int threads;
+    int frame_parallel;
     int bitexact;
     int check_hw_profile;
     int software_fallback;
@@ -105,6 +111,7 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_DISCARD("skipframe", skip_frame, 0),
         OPT_DISCARD("framedrop", framedrop, 0),
         OPT_INT("threads", threads, M_OPT_MIN, .min = 0),
+        OPT_FLAG("frame-parallel", frame_parallel, 0),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
         OPT_CHOICE_OR_INT("software-fallback", software_fallback, 0, 1, INT_MAX,
@@ -116,6 +123,7 @@ const struct m_sub_options vd_lavc_conf = {
     .defaults = &(const struct vd_lavc_params){
         .show_all = 0,
         .check_hw_profile = 1,
+        .frame_parallel = 1,
         .software_fallback = 3,
         .skip_loop_filter = AVDISCARD_DEFAULT,
         .skip_idct = AVDISCARD_DEFAULT,
@@ -467,7 +475,6 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     vd_ffmpeg_ctx *ctx = vd->priv;
     struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
     bool mp_rawvideo = false;
-    struct mp_codec_params *c = vd->codec;
 
     assert(!ctx->avctx);
 
@@ -519,6 +526,38 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
     }
 
+    configure_avctx(vd, avctx, mp_rawvideo);
+
+    // Do this after the avopt handling in case it changes values
+    ctx->skip_frame = avctx->skip_frame;
+
+    // Not worth it if there is only 1 frame to decode.
+    bool single_frame = vd->header->attached_picture || vd->codec->still_image;
+    if (!ctx->hwdec && !mp_rawvideo && !single_frame &&
+        lavc_param->frame_parallel)
+        init_parallel(vd, lavc_codec);
+    // All parallelism comes from the extra contexts.
+    if (ctx->parallel)
+        avctx->thread_count = 1;
+
+    /* open it */
+    if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
+        goto error;
+
+    return;
+
+error:
+    MP_ERR(vd, "Could not open codec.\n");
+    uninit_avctx(vd);
+}
+
+// Apply the user options and codec parameters to avctx.
+static void configure_avctx(struct dec_video *vd, AVCodecContext *avctx,
+                            bool mp_rawvideo)
+{
+    struct vd_lavc_params *lavc_param = vd->opts->vd_lavc_params;
+    struct mp_codec_params *c = vd->codec;
+
     avctx->flags |= lavc_param->bitexact ? CODEC_FLAG_BITEXACT : 0;
     avctx->flags2 |= lavc_param->fast ? CODEC_FLAG2_FAST : 0;
 
@@ -531,9 +570,6 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 
     mp_set_avopts(vd->log, avctx, lavc_param->avopts);
 
-    // Do this after the above avopt handling in case it changes values
-    ctx->skip_frame = avctx->skip_frame;
-
     avctx->codec_tag = c->codec_tag;
     avctx->coded_width  = c->disp_w;
     avctx->coded_height = c->disp_h;
@@ -550,16 +586,62 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
     }
 
     mp_set_lav_codec_headers(avctx, c);
+}
 
-    /* open it */
-    if (avcodec_open2(avctx, lavc_codec, NULL) < 0)
-        goto error;
+// Intra-only codecs (like MJPEG, ProRes, or image formats) often have no or
+// only limited threading support in libavcodec. Since every packet can be
+// decoded independently, decode them on separate contexts instead, one per
+// thread (plus one, so the context of the returned frame stays untouched).
+static void init_parallel(struct dec_video *vd, AVCodec *lavc_codec)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
 
-    return;
+    const AVCodecDescriptor *desc = avcodec_descriptor_get(lavc_codec->id);
+    if (!desc || !(desc->props & AV_CODEC_PROP_INTRA_ONLY) ||
+        lavc_codec->id == AV_CODEC_ID_RAWVIDEO)
+        return;
 
-error:
-    MP_ERR(vd, "Could not open codec.\n");
-    uninit_avctx(vd);
+    int threads = ctx->avctx->thread_count;
+    if (threads < 2)
+        return;
+
+    AVCodecContext **avctxs = talloc_zero_array(NULL, AVCodecContext *,
+                                                threads + 1);
+    int num = 0;
+    for (num = 0; num < threads + 1; num++) {
+        AVCodecContext *avctx = avcodec_alloc_context3(lavc_codec);
+        if (!avctx)
+            break;
+        avctxs[num] = avctx;
+        avctx->codec_type = AVMEDIA_TYPE_VIDEO;
+        avctx->codec_id = lavc_codec->id;
+#if LIBAVCODEC_VERSION_MICRO >= 100
+        avctx->pkt_timebase = ctx->codec_timebase;
+#endif
+        avctx->refcounted_frames = 1;
+        avctx->thread_count = 1;
+        configure_avctx(vd, avctx, false);
+        if (avcodec_open2(avctx, lavc_codec, NULL) < 0) {
+            av_freep(&avctx->extradata);
+            av_freep(&avctxs[num]);
+            break;
+        }
+    }
+
+    if (num == threads + 1) {
+        ctx->parallel = lavc_parallel_create(ctx, avctxs, num);
+        if (ctx->parallel)
+            MP_VERBOSE(vd, "Decoding up to %d frames in parallel.\n", threads);
+    } else {
+        for (int n = 0; n < num; n++) {
+            avcodec_close(avctxs[n]);
+            av_freep(&avctxs[n]->extradata);
+            av_freep(&avctxs[n]);
+        }
+    }
+    if (!ctx->parallel)
+        MP_WARN(vd, "Could not set up parallel decoding.\n");
+    talloc_free(avctxs);
 }
 
 static void reset_avctx(struct dec_video *vd)
@@ -568,6 +650,8 @@ static void reset_avctx(struct dec_video *vd)
 
     if (ctx->avctx && avcodec_is_open(ctx->avctx))
         avcodec_flush_buffers(ctx->avctx);
+    if (ctx->parallel)
+        lavc_parallel_flush(ctx->parallel);
     ctx->flushing = false;
 }
 
@@ -589,6 +673,9 @@ static void uninit_avctx(struct dec_video *vd)
     flush_all(vd);
     av_frame_free(&ctx->pic);
 
+    talloc_free(ctx->parallel);
+    ctx->parallel = NULL;
+
     if (ctx->avctx) {
         if (avcodec_close(ctx->avctx) < 0)
             MP_ERR(vd, "Could not close codec.\n");
@@ -607,7 +694,8 @@ static void uninit_avctx(struct dec_video *vd)
     ctx->max_delay_queue = 0;
 }
 
-static void update_image_params(struct dec_video *vd, AVFrame *frame,
+static void update_image_params(struct dec_video *vd, AVCodecContext *avctx,
+                                AVFrame *frame,
                                 struct mp_image_params *out_params)
 {
     vd_ffmpeg_ctx *ctx = vd->priv;
@@ -639,14 +727,14 @@ static void update_image_params(struct dec_video *vd, AVFrame *frame,
         .p_w = frame->sample_aspect_ratio.num,
         .p_h = frame->sample_aspect_ratio.den,
         .color = {
-            .space = avcol_spc_to_mp_csp(ctx->avctx->colorspace),
-            .levels = avcol_range_to_mp_csp_levels(ctx->avctx->color_range),
-            .primaries = avcol_pri_to_mp_csp_prim(ctx->avctx->color_primaries),
-            .gamma = avcol_trc_to_mp_csp_trc(ctx->avctx->color_trc),
+            .space = avcol_spc_to_mp_csp(avctx->colorspace),
+            .levels = avcol_range_to_mp_csp_levels(avctx->color_range),
+            .primaries = avcol_pri_to_mp_csp_prim(avctx->color_primaries),
+            .gamma = avcol_trc_to_mp_csp_trc(avctx->color_trc),
             .sig_peak = ctx->cached_hdr_peak,
         },
         .chroma_location =
-            avchroma_location_to_mp(ctx->avctx->chroma_sample_location),
+            avchroma_location_to_mp(avctx->chroma_sample_location),
         .rotate = vd->codec->rotate,
         .stereo_in = vd->codec->stereo_mode,
     };
@@ -785,6 +873,21 @@ static void decode(struct dec_video *vd, struct demux_packet *packet,
     }
 
     mp_set_av_packet(&pkt, packet, &ctx->codec_timebase);
+
+    if (ctx->parallel) {
+        AVCodecContext *frame_avctx = NULL;
+        ret = lavc_parallel_decode(ctx->parallel, packet ? &pkt : NULL,
+                                   avctx->skip_frame, flags != 0, ctx->pic,
+                                   &frame_avctx);
+        if (packet)
+            packet->len = 0;
+        if (ret < 0)
+            MP_WARN(vd, "Error while decoding frame!\n");
+        if (ret > 0)
+            handle_frame(vd, frame_avctx, out_image);
+        return;
+    }
+
     ctx->flushing |= !pkt.data;
 
     // Reset decoder if hw state got reset, or new data comes during flushing.
@@ -842,6 +945,15 @@ static void decode(struct dec_video *vd, struct demux_packet *packet,
 
     ctx->hwdec_fail_count = 0;
 
+    handle_frame(vd, avctx, out_image);
+}
+
+// Turn the frame decoded into ctx->pic by avctx into an output image.
+static void handle_frame(struct dec_video *vd, AVCodecContext *avctx,
+                         struct mp_image **out_image)
+{
+    vd_ffmpeg_ctx *ctx = vd->priv;
+
     AVFrameSideData *sd = NULL;
     sd = av_frame_get_side_data(ctx->pic, AV_FRAME_DATA_A53_CC);
     if (sd) {
@@ -861,7 +973,7 @@ static void decode(struct dec_video *vd, struct demux_packet *packet,
     mpi->dts = mp_pts_from_av(ctx->pic->pkt_dts, &ctx->codec_timebase);
 
     struct mp_image_params params;
-    update_image_params(vd, ctx->pic, &params);
+    update_image_params(vd, avctx, ctx->pic, &params);
     mp_image_set_params(mpi, &params);
 
     av_frame_unref(ctx->pic);
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -32,6 +33,7 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "osdep/threads.h"
 
 #include "video/img_format.h"
 #include "video/mp_image.h"
@@ -105,6 +107,9 @@ static const vf_info_t *const filter_list[] = {
 };
 
 static void vf_uninit_filter(vf_instance_t *vf);
+static void pipeline_pause(struct vf_chain *c);
+static void pipeline_resume(struct vf_chain *c);
+static void pipeline_stop(struct vf_chain *c);
 
 static bool get_desc(struct m_obj_desc *dst, int index)
 {
@@ -133,14 +138,17 @@ const struct m_obj_list vf_obj_list = {
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
+    int r = CONTROL_UNKNOWN;
+    pipeline_pause(c);
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
+            r = cur->control(cur, cmd, arg);
             if (r != CONTROL_UNKNOWN)
-                return r;
+                break;
         }
     }
-    return CONTROL_UNKNOWN;
+    pipeline_resume(c);
+    return r;
 }
 
 int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
@@ -149,7 +157,12 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        if (!cur->control)
+            return CONTROL_NA;
+        pipeline_pause(c);
+        int r = cur->control(cur, cmd, arg);
+        pipeline_resume(c);
+        return r;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -157,10 +170,12 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
 
 static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
 {
+    pipeline_pause(c);
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         if (cur->control)
             cur->control(cur, cmd, arg);
     }
+    pipeline_resume(c);
 }
 
 int vf_send_command(struct vf_chain *c, char *label, char *cmd, char *arg)
@@ -296,6 +311,7 @@ void vf_remove_filter(struct vf_chain *c, struct vf_instance *vf)
     while (prev && prev->next != vf)
         prev = prev->next;
     assert(prev); // not inserted
+    pipeline_stop(c);
     prev->next = vf->next;
     vf_uninit_filter(vf);
     c->initialized = 0;
@@ -306,6 +322,7 @@ struct vf_instance *vf_append_filter(struct vf_chain *c, const char *name,
 {
     struct vf_instance *vf = vf_open_filter(c, name, args);
     if (vf) {
+        pipeline_stop(c);
         // Insert it before the last filter, which is the "out" pseudo-filter
         // (But after the "in" pseudo-filter)
         struct vf_instance **pprev = &c->first->next;
@@ -392,6 +409,257 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+// Pipeline mode: each filter runs on its own thread, and passes its output to
+// the next filter with vf_instance.pipe_queued. The "in" and "out" pseudo
+// filters stay on the caller's thread. The queues are protected by the lock;
+// the filters themselves are touched by their worker only, unless the
+// pipeline is paused or stopped.
+struct vf_pipeline {
+    struct vf_chain *chain;
+    int queue_frames;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool exit;          // workers should terminate
+    bool pause;         // workers must not start new work
+    int busy;           // number of workers filtering with the lock released
+    int paused;         // pipeline_pause() nesting (caller thread only)
+
+    struct vf_worker **workers;
+    int num_workers;
+};
+
+struct vf_worker {
+    struct vf_pipeline *p;
+    struct vf_instance *vf, *prev;
+    pthread_t thread;
+    // Used only by the worker: output produced with the lock released.
+    struct mp_image **out;
+    int num_out;
+};
+
+static void vf_forget_frames(struct vf_instance *vf);
+
+static void worker_collect_output(struct vf_worker *w)
+{
+    while (vf_has_output_frame(w->vf))
+        MP_TARRAY_APPEND(w, w->out, w->num_out, vf_dequeue_output_frame(w->vf));
+}
+
+static void *worker_thread(void *ptr)
+{
+    struct vf_worker *w = ptr;
+    struct vf_pipeline *p = w->p;
+    struct vf_chain *c = p->chain;
+    struct vf_instance *vf = w->vf, *prev = w->prev;
+
+    mpthread_set_name("vf");
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->exit) {
+        struct mp_image *img = NULL;
+        bool flush = false;
+        if (!p->pause && vf->num_pipe_queued < p->queue_frames) {
+            if (prev->num_pipe_queued) {
+                img = prev->pipe_queued[0];
+                MP_TARRAY_REMOVE_AT(prev->pipe_queued, prev->num_pipe_queued, 0);
+            } else {
+                flush = prev->pipe_eof && !vf->pipe_eof;
+            }
+        }
+        if (!img && !flush) {
+            pthread_cond_wait(&p->wakeup, &p->lock);
+            continue;
+        }
+
+        p->busy++;
+        pthread_mutex_unlock(&p->lock);
+
+        if (img) {
+            vf_do_filter(vf, img);
+            worker_collect_output(w);
+        } else {
+            // Same as vf_output_frame(c, true): flush until nothing is left.
+            while (1) {
+                int num = w->num_out;
+                if (vf_do_filter(vf, NULL) < 0)
+                    break;
+                worker_collect_output(w);
+                if (w->num_out == num)
+                    break;
+            }
+        }
+
+        pthread_mutex_lock(&p->lock);
+        p->busy--;
+        for (int n = 0; n < w->num_out; n++)
+            MP_TARRAY_APPEND(vf, vf->pipe_queued, vf->num_pipe_queued, w->out[n]);
+        w->num_out = 0;
+        vf->pipe_eof |= flush;
+        pthread_cond_broadcast(&p->wakeup);
+
+        // The caller is interested in new output, and free input space.
+        if ((vf->next == c->last || prev == c->first) && c->wakeup_callback) {
+            pthread_mutex_unlock(&p->lock);
+            c->wakeup_callback(c->wakeup_callback_ctx);
+            pthread_mutex_lock(&p->lock);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void pipeline_forget_frames(struct vf_chain *c)
+{
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
+        for (int n = 0; n < cur->num_pipe_queued; n++)
+            talloc_free(cur->pipe_queued[n]);
+        cur->num_pipe_queued = 0;
+        cur->pipe_eof = false;
+    }
+}
+
+static void pipeline_stop(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->exit = true;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int n = 0; n < p->num_workers; n++)
+        pthread_join(p->workers[n]->thread, NULL);
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+    pipeline_forget_frames(c);
+    talloc_free(p);
+    c->pipeline = NULL;
+}
+
+// Start a worker thread for each filter, if enabled and possible. Filters
+// with their own threading (needs_input), and hardware frames are excluded.
+static void pipeline_start(struct vf_chain *c)
+{
+    assert(!c->pipeline);
+
+    int queue_frames = c->opts->vf_pipeline;
+    if (queue_frames < 1 || c->initialized < 1 || c->first->next == c->last)
+        return;
+    if (IMGFMT_IS_HWACCEL(c->input_params.imgfmt) ||
+        IMGFMT_IS_HWACCEL(c->output_params.imgfmt))
+        return;
+    for (struct vf_instance *cur = c->first->next; cur != c->last; cur = cur->next) {
+        if (cur->needs_input)
+            return;
+    }
+
+    struct vf_pipeline *p = talloc_ptrtype(NULL, p);
+    *p = (struct vf_pipeline){
+        .chain = c,
+        .queue_frames = queue_frames,
+    };
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    c->pipeline = p;
+
+    for (struct vf_instance *cur = c->first; cur->next != c->last; cur = cur->next) {
+        struct vf_worker *w = talloc_ptrtype(p, w);
+        *w = (struct vf_worker){ .p = p, .vf = cur->next, .prev = cur };
+        if (pthread_create(&w->thread, NULL, worker_thread, w)) {
+            MP_ERR(c, "Could not create filter threads.\n");
+            talloc_free(w);
+            pipeline_stop(c);
+            return;
+        }
+        MP_TARRAY_APPEND(p, p->workers, p->num_workers, w);
+    }
+    MP_VERBOSE(c, "Using %d filter threads.\n", p->num_workers);
+}
+
+// Wait until no worker accesses a filter. The caller can then use all filter
+// and queue state freely until pipeline_resume().
+static void pipeline_pause(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p || p->paused++)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->pause = true;
+    while (p->busy)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void pipeline_resume(struct vf_chain *c)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p || --p->paused)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->pause = false;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Last filter before the "out" pseudo filter.
+static struct vf_instance *pipeline_last(struct vf_chain *c)
+{
+    struct vf_instance *vf = c->first;
+    while (vf->next != c->last)
+        vf = vf->next;
+    return vf;
+}
+
+static int pipeline_output_frame(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *p = c->pipeline;
+    struct vf_instance *last = pipeline_last(c);
+
+    pthread_mutex_lock(&p->lock);
+    if (eof && !c->first->pipe_eof) {
+        c->first->pipe_eof = true;
+        pthread_cond_broadcast(&p->wakeup);
+    }
+    bool more = false;
+    if (last->num_pipe_queued) {
+        vf_do_filter(c->last, last->pipe_queued[0]);
+        MP_TARRAY_REMOVE_AT(last->pipe_queued, last->num_pipe_queued, 0);
+        pthread_cond_broadcast(&p->wakeup);
+        more = last->num_pipe_queued > 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // The workers signal new output only once.
+    if (more && c->wakeup_callback)
+        c->wakeup_callback(c->wakeup_callback_ctx);
+
+    return c->last->num_out_queued ? 1 : 0;
+}
+
+// In pipeline mode, vf_output_frame() can return 0 while frames are still
+// being filtered. Return true if the caller should wait for the wakeup
+// callback instead of adding input (or, with eof set, before treating the
+// chain as drained). Always false if pipelining is not active.
+bool vf_pipeline_busy(struct vf_chain *c, bool eof)
+{
+    struct vf_pipeline *p = c->pipeline;
+    if (!p || c->initialized < 1)
+        return false;
+
+    struct vf_instance *last = pipeline_last(c);
+    pthread_mutex_lock(&p->lock);
+    bool busy = eof ? !last->pipe_eof || last->num_pipe_queued
+                    : c->first->num_pipe_queued >= p->queue_frames;
+    pthread_mutex_unlock(&p->lock);
+    return busy;
+}
+
 // Input a frame into the filter chain. Ownership of img is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
@@ -402,6 +670,16 @@ int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
         return -1;
     }
     assert(mp_image_params_equal(&img->params, &c->input_params));
+    struct vf_pipeline *p = c->pipeline;
+    if (p) {
+        vf_fix_img_params(img, &c->first->fmt_out);
+        pthread_mutex_lock(&p->lock);
+        MP_TARRAY_APPEND(c->first, c->first->pipe_queued,
+                         c->first->num_pipe_queued, img);
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+        return 0;
+    }
     return vf_do_filter(c->first, img);
 }
 
@@ -446,6 +724,8 @@ static int vf_output_frame_until(struct vf_chain *c, struct vf_instance *until,
 //  returns: -1: error, 0: no output, 1: output available
 int vf_output_frame(struct vf_chain *c, bool eof)
 {
+    if (c->pipeline && c->initialized > 0 && !c->last->num_out_queued)
+        return pipeline_output_frame(c, eof);
     return vf_output_frame_until(c, c->last, eof);
 }
 
@@ -474,6 +754,16 @@ void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img)
 // returns -1: error, 0: nothing needed, 1: add new frame with vf_filter_frame()
 int vf_needs_input(struct vf_chain *c)
 {
+    struct vf_pipeline *p = c->pipeline;
+    if (p) {
+        // Keep the filter threads busy by reading ahead.
+        pthread_mutex_lock(&p->lock);
+        bool r = !c->first->pipe_eof &&
+                 c->first->num_pipe_queued < p->queue_frames;
+        pthread_mutex_unlock(&p->lock);
+        return r;
+    }
+
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
         while (cur->needs_input && cur->needs_input(cur)) {
@@ -506,8 +796,11 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    pipeline_pause(c);
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
+    pipeline_forget_frames(c);
+    pipeline_resume(c);
 }
 
 int vf_next_query_format(struct vf_instance *vf, unsigned int fmt)
@@ -631,6 +924,7 @@ static int vf_reconfig_wrapper(struct vf_instance *vf,
 int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
 {
     int r = 0;
+    pipeline_stop(c);
     vf_seek_reset(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -662,6 +956,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params)
     vf_print_filter_chain(c, loglevel, failing);
     if (r < 0)
         c->output_params = (struct mp_image_params){0};
+    pipeline_start(c);
     return r;
 }
 
@@ -729,6 +1024,7 @@ void vf_destroy(struct vf_chain *c)
 {
     if (!c)
         return;
+    pipeline_stop(c);
     while (c->first) {
         vf_instance_t *vf = c->first;
         c->first = vf->next;
@@ -98,6 +98,12 @@ typedef struct vf_instance {
     struct mp_image **out_queued;
     int num_out_queued;
 
+    // Pipeline mode: output passed to the next filter's thread. Protected by
+    // the pipeline lock.
+    struct mp_image **pipe_queued;
+    int num_pipe_queued;
+    bool pipe_eof;
+
     // Caches valid output formats.
     uint8_t last_outfmts[IMGFMT_END - IMGFMT_START];
 
@@ -128,6 +134,9 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    // Set if filters run on separate threads (--vf-pipeline).
+    struct vf_pipeline *pipeline;
 };
 
 typedef struct vf_seteq {
@@ -156,6 +165,7 @@ int vf_control_by_label(struct vf_chain *c, int cmd, void *arg, bstr label);
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img);
 int vf_output_frame(struct vf_chain *c, bool eof);
 int vf_needs_input(struct vf_chain *c);
+bool vf_pipeline_busy(struct vf_chain *c, bool eof);
 struct mp_image *vf_read_output_frame(struct vf_chain *c);
 void vf_unread_output_frame(struct vf_chain *c, struct mp_image *img);
 void vf_seek_reset(struct vf_chain *c);
@@ -0,0 +1,179 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/buffer.h>
+
+#include "mpv_talloc.h"
+#include "common/common.h"
+#include "video/mp_image.h"
+
+#include "frame_cache.h"
+
+// The cache contains the most recently displayed frames, in display order and
+// without gaps. Frames are only referenced, so for decoders using a buffer
+// pool, this effectively makes the pool larger.
+struct mp_frame_cache {
+    struct mp_image **frames;   // sorted by pts, oldest first
+    int num_frames;
+    int64_t bytes;
+    int64_t max_bytes;
+    bool seek_reset;
+};
+
+static void destroy_cache(void *ptr)
+{
+    mp_frame_cache_clear(ptr);
+}
+
+struct mp_frame_cache *mp_frame_cache_create(void *ta_parent)
+{
+    struct mp_frame_cache *c = talloc_zero(ta_parent, struct mp_frame_cache);
+    talloc_set_destructor(c, destroy_cache);
+    return c;
+}
+
+static int64_t image_bytes(struct mp_image *img)
+{
+    int64_t size = 0;
+    for (int n = 0; n < MP_MAX_PLANES && img->bufs[n]; n++)
+        size += img->bufs[n]->size;
+    if (!size) {
+        for (int n = 0; n < img->num_planes; n++)
+            size += (int64_t)abs(img->stride[n]) * mp_image_plane_h(img, n);
+    }
+    return size;
+}
+
+// Remove the frames with index >= start.
+static void drop_frames_from(struct mp_frame_cache *c, int start)
+{
+    for (int n = start; n < c->num_frames; n++) {
+        c->bytes -= image_bytes(c->frames[n]);
+        talloc_free(c->frames[n]);
+    }
+    c->num_frames = MPMIN(c->num_frames, start);
+}
+
+// Remove the oldest frames until the size limit is respected. The newest frame
+// (the one currently displayed) is always kept.
+static void trim(struct mp_frame_cache *c)
+{
+    int num = 0;
+    while (num < c->num_frames - 1 && c->bytes > c->max_bytes) {
+        c->bytes -= image_bytes(c->frames[num]);
+        talloc_free(c->frames[num]);
+        num++;
+    }
+    c->num_frames -= num;
+    memmove(c->frames, c->frames + num, c->num_frames * sizeof(c->frames[0]));
+}
+
+void mp_frame_cache_set_max_bytes(struct mp_frame_cache *c, int64_t max_bytes)
+{
+    c->max_bytes = max_bytes;
+    if (max_bytes <= 0) {
+        mp_frame_cache_clear(c);
+    } else {
+        trim(c);
+    }
+}
+
+int64_t mp_frame_cache_get_bytes(struct mp_frame_cache *c)
+{
+    return c->bytes;
+}
+
+// Add the frame that is displayed next. It must follow the previously added
+// frame, unless mp_frame_cache_seek_reset() was called in between.
+void mp_frame_cache_add(struct mp_frame_cache *c, struct mp_image *img)
+{
+    if (c->max_bytes <= 0)
+        return;
+
+    bool seek_reset = c->seek_reset;
+    c->seek_reset = false;
+
+    if (img->pts == MP_NOPTS_VALUE) {
+        mp_frame_cache_clear(c);
+        return;
+    }
+
+    if (seek_reset) {
+        // Seeking to a frame that is in the cache: the frames before it are
+        // still valid, and the ones after it are decoded again.
+        int keep = 0;
+        for (int n = 0; n < c->num_frames; n++) {
+            if (c->frames[n]->pts == img->pts) {
+                keep = n;
+                break;
+            }
+        }
+        drop_frames_from(c, keep);
+    } else if (c->num_frames && img->pts <= c->frames[c->num_frames - 1]->pts) {
+        // Timestamp discontinuity.
+        mp_frame_cache_clear(c);
+    }
+
+    struct mp_image *ref = mp_image_new_ref(img);
+    if (!ref)
+        return;
+    MP_TARRAY_APPEND(c, c->frames, c->num_frames, ref);
+    c->bytes += image_bytes(ref);
+    trim(c);
+}
+
+// The next frame added may not follow the frames in the cache (e.g. because
+// the player seeked).
+void mp_frame_cache_seek_reset(struct mp_frame_cache *c)
+{
+    c->seek_reset = true;
+}
+
+void mp_frame_cache_clear(struct mp_frame_cache *c)
+{
+    drop_frames_from(c, 0);
+    c->seek_reset = false;
+}
+
+// dir<0: return the frame displayed before the frame with the given pts
+// dir>0: return the first frame displayed after the given pts
+// Returns NULL if the cache doesn't cover the given pts. The returned image is
+// owned by the cache, and valid until the next call that changes the cache.
+struct mp_image *mp_frame_cache_get(struct mp_frame_cache *c, double pts,
+                                    int dir)
+{
+    if (pts == MP_NOPTS_VALUE || !c->num_frames)
+        return NULL;
+    if (dir < 0) {
+        for (int n = c->num_frames - 1; n >= 1; n--) {
+            if (c->frames[n - 1]->pts < pts && c->frames[n]->pts >= pts)
+                return c->frames[n - 1];
+        }
+    } else {
+        if (c->frames[0]->pts > pts)
+            return NULL;
+        for (int n = 0; n < c->num_frames; n++) {
+            if (c->frames[n]->pts > pts)
+                return c->frames[n];
+        }
+    }
+    return NULL;
+}
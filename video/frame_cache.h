@@ -0,0 +1,19 @@
+#ifndef MPV_FRAME_CACHE_H
+#define MPV_FRAME_CACHE_H
+
+#include <stdint.h>
+
+struct mp_image;
+struct mp_frame_cache;
+
+struct mp_frame_cache *mp_frame_cache_create(void *ta_parent);
+void mp_frame_cache_set_max_bytes(struct mp_frame_cache *c, int64_t max_bytes);
+int64_t mp_frame_cache_get_bytes(struct mp_frame_cache *c);
+// a new reference to img is added (img is not changed)
+void mp_frame_cache_add(struct mp_frame_cache *c, struct mp_image *img);
+void mp_frame_cache_seek_reset(struct mp_frame_cache *c);
+void mp_frame_cache_clear(struct mp_frame_cache *c);
+struct mp_image *mp_frame_cache_get(struct mp_frame_cache *c, double pts,
+                                    int dir);
+
+#endif
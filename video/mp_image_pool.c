@@ -31,40 +31,78 @@
 
 #include "mp_image_pool.h"
 
-static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define pool_lock() pthread_mutex_lock(&pool_mutex)
-#define pool_unlock() pthread_mutex_unlock(&pool_mutex)
-
 // Thread-safety: the pool itself is not thread-safe, but pool-allocated images
 // can be referenced and unreferenced from other threads. (As long as the image
 // destructors are thread-safe.)
 
+// Free images with the same format and size.
+struct pool_bucket {
+    int fmt, w, h;
+    struct mp_image **images;   // most recently returned image last
+    int num_images;
+    int num_total;              // free and referenced images of this size
+};
+
+// State shared between the pool and its images. Images can outlive the pool,
+// so this is refcounted: the pool holds a reference, and every image added to
+// the pool holds one until it is freed.
+struct pool_shared {
+    pthread_mutex_t lock;
+    // --- the following fields are protected by lock
+    int refcount;
+    struct pool_bucket *buckets;
+    int num_buckets;
+};
+
 struct mp_image_pool {
     int max_count;
 
     struct mp_image **images;
     int num_images;
 
+    struct pool_shared *shared;
+
     mp_image_allocator allocator;
     void *allocator_ctx;
 
     bool use_lru;
-    unsigned int lru_counter;
+
+    struct mp_image_pool_stats stats;
 };
 
 // Used to gracefully handle the case when the pool is freed while image
 // references allocated from the image pool are still held by someone.
 struct image_flags {
-    // If both of these are false, the image must be freed.
+    struct pool_shared *shared;
+    int bucket;                 // index into shared->buckets
+    // Protected by shared->lock. If both of these are false, the image must be
+    // freed.
     bool referenced;            // outside mp_image reference exists
     bool pool_alive;            // the mp_image_pool references this
-    unsigned int order;         // for LRU allocation (basically a timestamp)
 };
 
+static void shared_unref(struct pool_shared *shared)
+{
+    pthread_mutex_lock(&shared->lock);
+    bool last = --shared->refcount == 0;
+    pthread_mutex_unlock(&shared->lock);
+    if (last) {
+        pthread_mutex_destroy(&shared->lock);
+        talloc_free(shared);
+    }
+}
+
+static void image_flags_destructor(void *ptr)
+{
+    struct image_flags *it = ptr;
+    shared_unref(it->shared);
+}
+
 static void image_pool_destructor(void *ptr)
 {
     struct mp_image_pool *pool = ptr;
     mp_image_pool_clear(pool);
+    shared_unref(pool->shared);
 }
 
 struct mp_image_pool *mp_image_pool_new(int max_count)
@@ -73,24 +111,37 @@ struct mp_image_pool *mp_image_pool_new(int max_count)
     talloc_set_destructor(pool, image_pool_destructor);
     *pool = (struct mp_image_pool) {
         .max_count = max_count,
+        .shared = talloc_zero(NULL, struct pool_shared),
     };
+    pthread_mutex_init(&pool->shared->lock, NULL);
+    pool->shared->refcount = 1;
     return pool;
 }
 
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
+    struct pool_shared *shared = pool->shared;
+
+    pthread_mutex_lock(&shared->lock);
+    int num_free = 0;
     for (int n = 0; n < pool->num_images; n++) {
         struct mp_image *img = pool->images[n];
         struct image_flags *it = img->priv;
-        bool referenced;
-        pool_lock();
         assert(it->pool_alive);
         it->pool_alive = false;
-        referenced = it->referenced;
-        pool_unlock();
-        if (!referenced)
-            talloc_free(img);
+        // Compact unreferenced images to the start for freeing them below.
+        if (!it->referenced)
+            pool->images[num_free++] = img;
     }
+    for (int n = 0; n < shared->num_buckets; n++)
+        talloc_free(shared->buckets[n].images);
+    TA_FREEP(&shared->buckets);
+    shared->num_buckets = 0;
+    pthread_mutex_unlock(&shared->lock);
+
+    // Freeing drops the image's reference to shared, which takes the lock.
+    for (int n = 0; n < num_free; n++)
+        talloc_free(pool->images[n]);
     pool->num_images = 0;
 }
 
@@ -100,47 +151,53 @@ static void unref_image(void *opaque, uint8_t *data)
 {
     struct mp_image *img = opaque;
     struct image_flags *it = img->priv;
-    bool alive;
-    pool_lock();
+    struct pool_shared *shared = it->shared;
+    pthread_mutex_lock(&shared->lock);
     assert(it->referenced);
     it->referenced = false;
-    alive = it->pool_alive;
-    pool_unlock();
+    bool alive = it->pool_alive;
+    if (alive) {
+        struct pool_bucket *b = &shared->buckets[it->bucket];
+        MP_TARRAY_APPEND(shared, b->images, b->num_images, img);
+    }
+    pthread_mutex_unlock(&shared->lock);
     if (!alive)
         talloc_free(img);
 }
 
-// Return a new image of given format/size. Unlike mp_image_pool_get(), this
-// returns NULL if there is no free image of this format/size.
-struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
-                                            int w, int h)
+// Must be called with shared->lock held.
+static int find_bucket(struct pool_shared *shared, int fmt, int w, int h)
+{
+    for (int n = 0; n < shared->num_buckets; n++) {
+        struct pool_bucket *b = &shared->buckets[n];
+        if (b->fmt == fmt && b->w == w && b->h == h)
+            return n;
+    }
+    return -1;
+}
+
+static struct mp_image *get_free_image(struct mp_image_pool *pool, int fmt,
+                                       int w, int h)
 {
+    struct pool_shared *shared = pool->shared;
     struct mp_image *new = NULL;
-    pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *img_it = img->priv;
-        assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
-                    new = img;
-                    break;
-                }
-            }
+    pthread_mutex_lock(&shared->lock);
+    int n = find_bucket(shared, fmt, w, h);
+    if (n >= 0 && shared->buckets[n].num_images) {
+        struct pool_bucket *b = &shared->buckets[n];
+        if (pool->use_lru) {
+            new = b->images[0];
+            MP_TARRAY_REMOVE_AT(b->images, b->num_images, 0);
+        } else {
+            new = b->images[--b->num_images];
         }
     }
-    pool_unlock();
+    pthread_mutex_unlock(&shared->lock);
     if (!new)
         return NULL;
 
-    // Reference the new image. Since mp_image_pool is not declared thread-safe,
-    // and unreffing images from other threads does not allocate new images,
-    // no synchronization is required here.
+    // Reference the new image. It was removed from the free list above, so
+    // nobody else can access it anymore.
     for (int p = 0; p < MP_MAX_PLANES; p++)
         assert(!!new->bufs[p] == !p); // only 1 AVBufferRef
 
@@ -152,24 +209,66 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
     int flags = av_buffer_is_writable(new->bufs[0]) ? 0 : AV_BUFFER_FLAG_READONLY;
     ref->bufs[0] = av_buffer_create(new->bufs[0]->data, new->bufs[0]->size,
                                     unref_image, new, flags);
+
+    struct image_flags *it = new->priv;
+    pthread_mutex_lock(&shared->lock);
+    assert(!it->referenced && it->pool_alive);
+    if (ref->bufs[0]) {
+        it->referenced = true;
+    } else {
+        // Put it back.
+        struct pool_bucket *b = &shared->buckets[it->bucket];
+        MP_TARRAY_APPEND(shared, b->images, b->num_images, new);
+    }
+    pthread_mutex_unlock(&shared->lock);
     if (!ref->bufs[0]) {
         talloc_free(ref);
         return NULL;
     }
-
-    struct image_flags *it = new->priv;
-    assert(!it->referenced && it->pool_alive);
-    it->referenced = true;
-    it->order = ++pool->lru_counter;
     return ref;
 }
 
+// Return a new image of given format/size. Unlike mp_image_pool_get(), this
+// returns NULL if there is no free image of this format/size.
+struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
+                                            int w, int h)
+{
+    struct mp_image *new = get_free_image(pool, fmt, w, h);
+    if (new) {
+        pool->stats.hits++;
+    } else {
+        pool->stats.misses++;
+    }
+    return new;
+}
+
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 {
+    struct pool_shared *shared = pool->shared;
     struct image_flags *it = talloc_ptrtype(new, it);
-    *it = (struct image_flags) { .pool_alive = true };
+    *it = (struct image_flags) {
+        .shared = shared,
+        .pool_alive = true,
+    };
     new->priv = it;
     MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+
+    pthread_mutex_lock(&shared->lock);
+    shared->refcount++;
+    int n = find_bucket(shared, new->imgfmt, new->w, new->h);
+    if (n < 0) {
+        n = shared->num_buckets;
+        MP_TARRAY_APPEND(shared, shared->buckets, shared->num_buckets,
+                         (struct pool_bucket){new->imgfmt, new->w, new->h});
+    }
+    it->bucket = n;
+    struct pool_bucket *b = &shared->buckets[n];
+    // Make sure unref_image() never needs to reallocate the free list.
+    MP_TARRAY_GROW(shared, b->images, b->num_total);
+    b->num_total++;
+    MP_TARRAY_APPEND(shared, b->images, b->num_images, new);
+    pthread_mutex_unlock(&shared->lock);
+    talloc_set_destructor(it, image_flags_destructor);
 }
 
 // Return a new image of given format/size. The only difference to
@@ -194,8 +293,9 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
         }
         if (!new)
             return NULL;
+        pool->stats.allocs++;
         mp_image_pool_add(pool, new);
-        new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
+        new = get_free_image(pool, fmt, w, h);
     }
     return new;
 }
@@ -247,3 +347,11 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 {
     pool->use_lru = true;
 }
+
+// Return the usage counters of the pool.
+struct mp_image_pool_stats mp_image_pool_get_stats(struct mp_image_pool *pool)
+{
+    struct mp_image_pool_stats stats = pool->stats;
+    stats.num_images = pool->num_images;
+    return stats;
+}
@@ -2,6 +2,7 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
@@ -14,6 +15,15 @@ void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
 
+struct mp_image_pool_stats {
+    int64_t hits;           // image requests served from the free list
+    int64_t misses;         // image requests with no free image of that size
+    int64_t allocs;         // images allocated by mp_image_pool_get()
+    int num_images;         // images currently owned by the pool
+};
+
+struct mp_image_pool_stats mp_image_pool_get_stats(struct mp_image_pool *pool);
+
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
 
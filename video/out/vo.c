@@ -147,6 +147,8 @@ struct vo_internal {
 
     int64_t delayed_count;
     int64_t drop_count;
+    int64_t render_count;       // frames drawn with draw_frame/draw_image
+    int64_t render_time;        // time spent drawing and flipping them (us)
     bool dropped_frame;             // the previous frame was dropped
 
     struct vo_frame *current_frame; // last frame queued to the VO
@@ -810,20 +812,26 @@ static bool render_frame(struct vo *vo)
 
         MP_STATS(vo, "start video");
 
+        int64_t render_start = mp_time_us();
         if (vo->driver->draw_frame) {
             vo->driver->draw_frame(vo, frame);
         } else {
             vo->driver->draw_image(vo, mp_image_new_ref(frame->current));
         }
+        int64_t render_time = mp_time_us() - render_start;
 
         wait_until(vo, target);
 
+        int64_t flip_start = mp_time_us();
         vo->driver->flip_page(vo);
+        render_time += mp_time_us() - flip_start;
 
         MP_STATS(vo, "end video");
         MP_STATS(vo, "video_end");
 
         pthread_mutex_lock(&in->lock);
+        in->render_count += 1;
+        in->render_time += render_time;
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
         in->rendering = false;
 
@@ -968,6 +976,17 @@ int64_t vo_get_drop_count(struct vo *vo)
     return r;
 }
 
+// Return the number of frames rendered so far, and the total time (in
+// microseconds) the VO spent rendering them, excluding waiting for the target
+// display time.
+void vo_get_render_stats(struct vo *vo, int64_t *frames, int64_t *time_us)
+{
+    pthread_mutex_lock(&vo->in->lock);
+    *frames = vo->in->render_count;
+    *time_us = vo->in->render_time;
+    pthread_mutex_unlock(&vo->in->lock);
+}
+
 void vo_increment_drop_count(struct vo *vo, int64_t n)
 {
     pthread_mutex_lock(&vo->in->lock);
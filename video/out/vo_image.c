@@ -19,13 +19,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/m_config.h"
 #include "options/path.h"
@@ -50,6 +56,9 @@ static const struct m_sub_options image_writer_conf = {
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
+    int queue;
+    int fsync;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -58,9 +67,16 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         OPT_SUBSTRUCT("vo-image", opts, image_writer_conf, 0),
         OPT_STRING("vo-image-outdir", outdir, 0),
+        OPT_CHOICE_OR_INT("vo-image-threads", threads, 0, 1, 64,
+                          ({"auto", 0})),
+        OPT_INTRANGE("vo-image-queue", queue, 0, 0, 256),
+        OPT_INTRANGE("vo-image-fsync", fsync, 0, 0, INT_MAX),
         {0},
     },
     .size = sizeof(struct vo_image_opts),
+    .defaults = &(const struct vo_image_opts){
+        .threads = 1,
+    },
 };
 
 struct priv {
@@ -68,6 +84,23 @@ struct priv {
 
     struct mp_image *current;
     int frame;
+
+    // Encoder threads (NULL if frames are written on the VO thread).
+    struct mp_thread_pool *pool;
+    int max_queue;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- the following fields are protected by lock
+    int queued;                 // frames submitted, but not written yet
+    char **unsynced;            // written files not fsync'ed yet
+    int num_unsynced;
+};
+
+struct write_job {
+    struct vo *vo;
+    struct mp_image *image;
+    char *filename;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -104,6 +137,80 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
     osd_draw_on_image(vo->osd, dim, mpi->pts, OSD_DRAW_SUB_ONLY, p->current);
 }
 
+// Flush the given files to disk. Since fsync() is expensive and blocks the
+// caller, this is done in batches of --vo-image-fsync files.
+static void sync_files(struct vo *vo, char **files, int num_files)
+{
+#if HAVE_POSIX
+    struct priv *p = vo->priv;
+    for (int n = 0; n < num_files; n++) {
+        int fd = open(files[n], O_RDONLY);
+        if (fd < 0 || fsync(fd) < 0)
+            MP_WARN(vo, "Could not sync '%s' to disk.\n", files[n]);
+        if (fd >= 0)
+            close(fd);
+    }
+    // Make the new directory entries persistent too.
+    const char *dir = p->opts->outdir && p->opts->outdir[0] ? p->opts->outdir
+                                                             : ".";
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+
+// Called with the file name of each written frame. Syncs the pending files
+// if a batch is complete, or if flush is set.
+static void add_unsynced(struct vo *vo, char *filename, bool flush)
+{
+    struct priv *p = vo->priv;
+    if (!p->opts->fsync)
+        return;
+
+    char **files = NULL;
+    int num_files = 0;
+    pthread_mutex_lock(&p->lock);
+    if (filename) {
+        MP_TARRAY_APPEND(p, p->unsynced, p->num_unsynced,
+                         talloc_strdup(p, filename));
+    }
+    if (p->num_unsynced >= p->opts->fsync || (flush && p->num_unsynced)) {
+        files = talloc_steal(NULL, p->unsynced);
+        num_files = p->num_unsynced;
+        for (int n = 0; n < num_files; n++)
+            talloc_steal(files, files[n]);
+        p->unsynced = NULL;
+        p->num_unsynced = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (files)
+        sync_files(vo, files, num_files);
+    talloc_free(files);
+}
+
+static void write_frame(void *ptr)
+{
+    struct write_job *job = ptr;
+    struct vo *vo = job->vo;
+    struct priv *p = vo->priv;
+
+    MP_INFO(vo, "Saving %s\n", job->filename);
+    if (write_image(job->image, p->opts->opts, job->filename, vo->log))
+        add_unsynced(vo, job->filename, false);
+
+    talloc_free(job);
+
+    if (p->pool) {
+        pthread_mutex_lock(&p->lock);
+        p->queued--;
+        pthread_cond_broadcast(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
@@ -112,18 +219,34 @@ static void flip_page(struct vo *vo)
 
     (p->frame)++;
 
-    void *t = talloc_new(NULL);
-    char *filename = talloc_asprintf(t, "%08d.%s", p->frame,
-                                     image_writer_file_ext(p->opts->opts));
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){
+        .vo = vo,
+        .image = talloc_steal(job, p->current),
+    };
+    p->current = NULL;
+
+    // The file name is determined here, so frames are numbered in order even
+    // if they are finished out of order.
+    job->filename = talloc_asprintf(job, "%08d.%s", p->frame,
+                                    image_writer_file_ext(p->opts->opts));
 
     if (p->opts->outdir && strlen(p->opts->outdir))
-        filename = mp_path_join(t, p->opts->outdir, filename);
+        job->filename = mp_path_join(job, p->opts->outdir, job->filename);
 
-    MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->log);
+    if (!p->pool) {
+        write_frame(job);
+        return;
+    }
 
-    talloc_free(t);
-    mp_image_unrefp(&p->current);
+    // Block the VO (and with it, decoding) while the encoders are busy.
+    pthread_mutex_lock(&p->lock);
+    while (p->queued >= p->max_queue)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    p->queued++;
+    pthread_mutex_unlock(&p->lock);
+
+    mp_thread_pool_queue(p->pool, write_frame, job);
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -138,6 +261,14 @@ static void uninit(struct vo *vo)
     struct priv *p = vo->priv;
 
     mp_image_unrefp(&p->current);
+
+    // Waits until all queued frames are written.
+    talloc_free(p->pool);
+    p->pool = NULL;
+    add_unsynced(vo, NULL, true);
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
 }
 
 static int preinit(struct vo *vo)
@@ -146,6 +277,20 @@ static int preinit(struct vo *vo)
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+
+    int threads = p->opts->threads ? p->opts->threads : av_cpu_count();
+    if (threads > 1) {
+        p->pool = mp_thread_pool_create(p, threads);
+        if (!p->pool) {
+            MP_WARN(vo, "Could not create encoder threads.\n");
+        } else {
+            p->max_queue = p->opts->queue ? p->opts->queue : threads * 2;
+            MP_VERBOSE(vo, "Using %d encoder threads.\n", threads);
+        }
+    }
     return 0;
 }
 
@@ -41,10 +41,6 @@
 #define ESC_CLEAR_SCREEN "\e[2J"
 #define ESC_CLEAR_COLORS "\e[0m"
 #define ESC_GOTOXY "\e[%d;%df"
-#define ESC_COLOR_BG "\e[48;2;%d;%d;%dm"
-#define ESC_COLOR_FG "\e[38;2;%d;%d;%dm"
-#define ESC_COLOR256_BG "\e[48;5;%dm"
-#define ESC_COLOR256_FG "\e[38;5;%dm"
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 
@@ -72,6 +68,26 @@ static const struct m_sub_options vo_tct_conf = {
     .size = sizeof(struct vo_tct_opts),
 };
 
+// Force a full repaint every this many frames. Other terminal output (like the
+// status line) can overwrite cells we assume to be unchanged.
+#define FULL_REDRAW_FRAMES 120
+
+// Worst case size of the output for a single cell: 2 true-color escapes, a
+// cursor move, and the UTF-8 half block.
+#define MAX_CELL_BYTES 64
+
+struct cell {
+    uint32_t bg, fg;    // 0xRRGGBB, or xterm-256 index if term256 is set
+};
+
+// Lookup tables for rgb_to_x256().
+struct x256_lut {
+    uint8_t color_index[256];   // nearest 0..5 level of the 6x6x6 cube
+    int color_err[256];         // squared distance to that level
+    int square[256];
+    uint8_t gray_index[3 * 255 + 1]; // indexed by r + g + b
+};
+
 struct priv {
     struct vo_tct_opts *opts;
     size_t buffer_size;
@@ -82,97 +98,175 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
+
+    struct cell *cells, *prev_cells;
+    int frames_since_full_redraw;
+    struct x256_lut lut;
 };
 
+static const int x256_level[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+
+static void init_x256_lut(struct x256_lut *lut)
+{
+    for (int v = 0; v < 256; v++) {
+        int ci = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+        lut->color_index[v] = ci;
+        lut->color_err[v] = (x256_level[ci] - v) * (x256_level[ci] - v);
+        lut->square[v] = v * v;
+    }
+    for (int sum = 0; sum < MP_ARRAY_SIZE(lut->gray_index); sum++) {
+        int average = sum / 3;
+        lut->gray_index[sum] = average > 238 ? 23 : (average - 3) / 10;
+    }
+}
+
 // Convert RGB24 to xterm-256 8-bit value
 // For simplicity, assume RGB space is perceptually uniform.
 // There are 5 places where one of two outputs needs to be chosen when the
 // input is the exact middle:
 // - The r/g/b channels and the gray value: the higher value output is chosen.
 // - If the gray and color have same distance from the input - color is chosen.
-static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
+// The squared distances are computed from the lookup tables; the gray error
+// is expanded to 3*gv^2 - 2*gv*(r+g+b) + r^2+g^2+b^2.
+static int rgb_to_x256(const struct x256_lut *lut, uint8_t r, uint8_t g,
+                       uint8_t b)
 {
-    // Calculate the nearest 0-based color index at 16 .. 231
-#   define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
-    int ir = v2ci(r), ig = v2ci(g), ib = v2ci(b);   // 0..5 each
-#   define color_index() (36 * ir + 6 * ig + ib)  /* 0..215, lazy evaluation */
-
-    // Calculate the nearest 0-based gray index at 232 .. 255
-    int average = (r + g + b) / 3;
-    int gray_index = average > 238 ? 23 : (average - 3) / 10;  // 0..23
-
-    // Calculate the represented colors back from the index
-    static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
-    int cr = i2cv[ir], cg = i2cv[ig], cb = i2cv[ib];  // r/g/b, 0..255 each
-    int gv = 8 + 10 * gray_index;  // same value for r/g/b, 0..255
-
-    // Return the one which is nearer to the original input rgb value
-#   define dist_square(A,B,C, a,b,c) ((A-a)*(A-a) + (B-b)*(B-b) + (C-c)*(C-c))
-    int color_err = dist_square(cr, cg, cb, r, g, b);
-    int gray_err  = dist_square(gv, gv, gv, r, g, b);
-    return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
+    int sum = r + g + b;
+    int gray_index = lut->gray_index[sum];  // 0..23
+    int gv = 8 + 10 * gray_index;           // same value for r/g/b
+    int color_err = lut->color_err[r] + lut->color_err[g] + lut->color_err[b];
+    int gray_err = 3 * gv * gv - 2 * gv * sum +
+                   lut->square[r] + lut->square[g] + lut->square[b];
+    if (color_err <= gray_err) {
+        return 16 + 36 * lut->color_index[r] + 6 * lut->color_index[g] +
+               lut->color_index[b];
+    }
+    return 232 + gray_index;
 }
 
-static void write_plain(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256)
+static char *append_str(char *dst, const char *s)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        printf(ESC_GOTOXY, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                printf(ESC_COLOR_BG, r, g, b);
-            }
-            printf(" ");
+    while (*s)
+        *dst++ = *s++;
+    return dst;
+}
+
+static char *append_uint(char *dst, unsigned v)
+{
+    char tmp[12];
+    int len = 0;
+    do {
+        tmp[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (len)
+        *dst++ = tmp[--len];
+    return dst;
+}
+
+// Same as printf(ESC_GOTOXY, y, x).
+static char *append_gotoxy(char *dst, int y, int x)
+{
+    dst = append_str(dst, "\e[");
+    dst = append_uint(dst, y);
+    *dst++ = ';';
+    dst = append_uint(dst, x);
+    *dst++ = 'f';
+    return dst;
+}
+
+// Append "\e[48;2;R;G;Bm" (or 38 for the foreground), or "\e[48;5;Im" with
+// term256.
+static char *append_color(char *dst, bool fg, bool term256, uint32_t c)
+{
+    dst = append_str(dst, fg ? "\e[38;" : "\e[48;");
+    if (term256) {
+        dst = append_str(dst, "5;");
+        dst = append_uint(dst, c);
+    } else {
+        dst = append_str(dst, "2;");
+        dst = append_uint(dst, (c >> 16) & 0xFF);
+        *dst++ = ';';
+        dst = append_uint(dst, (c >> 8) & 0xFF);
+        *dst++ = ';';
+        dst = append_uint(dst, c & 0xFF);
+    }
+    *dst++ = 'm';
+    return dst;
+}
+
+static uint32_t get_color(struct priv *p, const unsigned char *bgr)
+{
+    if (p->opts->term256)
+        return rgb_to_x256(&p->lut, bgr[2], bgr[1], bgr[0]);
+    return (bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
+}
+
+// Convert the scaled frame to the cell grid.
+static void update_cells(struct priv *p)
+{
+    bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    for (int y = 0; y < p->sheight; y++) {
+        int sy = half_blocks ? y * 2 : y;
+        const unsigned char *row_up = p->frame->planes[0] +
+                                      sy * p->frame->stride[0];
+        struct cell *cells = &p->cells[y * p->swidth];
+        for (int x = 0; x < p->swidth; x++)
+            cells[x].bg = get_color(p, row_up + x * 3);
+        if (half_blocks) {
+            const unsigned char *row_down = row_up + p->frame->stride[0];
+            for (int x = 0; x < p->swidth; x++)
+                cells[x].fg = get_color(p, row_down + x * 3);
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
 }
 
-static void write_half_blocks(
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256)
+// Write all cells which changed since the last frame. Colors are emitted only
+// when they change, and the cursor is moved only if the next changed cell is
+// not the one right after the previous one. The whole frame is written with
+// a single fwrite().
+static void write_frame(struct vo *vo)
 {
-    assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        printf(ESC_GOTOXY, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                printf(ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                printf(ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                printf(ESC_COLOR_BG, r_up, g_up, b_up);
-                printf(ESC_COLOR_FG, r_down, g_down, b_down);
-            }
-            printf("\xe2\x96\x84");  // UTF8 bytes of U+2584 (lower half block)
+    struct priv *p = vo->priv;
+    bool half_blocks = p->opts->algo == ALGO_HALF_BLOCKS;
+    bool term256 = p->opts->term256;
+    const int tx = (vo->dwidth - p->swidth) / 2;
+    const int ty = (vo->dheight - p->sheight) / 2;
+
+    bool full = p->frames_since_full_redraw >= FULL_REDRAW_FRAMES;
+    p->frames_since_full_redraw = full ? 0 : p->frames_since_full_redraw + 1;
+
+    char *out = p->buffer;
+    bool have_color = false;
+    struct cell cur = {0};
+    int cursor_x = -1, cursor_y = -1;
+    for (int y = 0; y < p->sheight; y++) {
+        struct cell *cells = &p->cells[y * p->swidth];
+        struct cell *prev = &p->prev_cells[y * p->swidth];
+        for (int x = 0; x < p->swidth; x++) {
+            struct cell c = cells[x];
+            if (!full && c.bg == prev[x].bg && c.fg == prev[x].fg)
+                continue;
+            prev[x] = c;
+            if (cursor_x != x || cursor_y != y)
+                out = append_gotoxy(out, ty + y, tx + x);
+            if (!have_color || c.bg != cur.bg)
+                out = append_color(out, false, term256, c.bg);
+            if (half_blocks && (!have_color || c.fg != cur.fg))
+                out = append_color(out, true, term256, c.fg);
+            have_color = true;
+            cur = c;
+            // UTF8 bytes of U+2584 (lower half block)
+            out = append_str(out, half_blocks ? "\xe2\x96\x84" : " ");
+            cursor_x = x + 1;
+            cursor_y = y;
         }
-        printf(ESC_CLEAR_COLORS);
     }
-    printf("\n");
+    if (!have_color)
+        return;
+    out = append_str(out, ESC_CLEAR_COLORS "\n");
+    assert(out - p->buffer <= p->buffer_size);
+    fwrite(p->buffer, out - p->buffer, 1, stdout);
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -204,8 +298,15 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     p->swidth = p->dst.x1 - p->dst.x0;
     p->sheight = p->dst.y1 - p->dst.y0;
 
-    if (p->buffer)
-        free(p->buffer);
+    talloc_free(p->buffer);
+    talloc_free(p->cells);
+    talloc_free(p->prev_cells);
+    int num_cells = p->swidth * p->sheight;
+    p->cells = talloc_zero_array(NULL, struct cell, num_cells);
+    p->prev_cells = talloc_zero_array(NULL, struct cell, num_cells);
+    p->buffer_size = (size_t)num_cells * MAX_CELL_BYTES + 64;
+    p->buffer = talloc_size(NULL, p->buffer_size);
+    p->frames_since_full_redraw = FULL_REDRAW_FRAMES;
 
     mp_sws_set_from_cmdline(p->sws, vo->opts->sws_opts);
     p->sws->src = *params;
@@ -218,6 +319,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     };
 
     const int mul = (p->opts->algo == ALGO_PLAIN ? 1 : 2);
+    talloc_free(p->frame);
     p->frame = mp_image_alloc(IMGFMT, p->swidth, p->sheight * mul);
     if (!p->frame)
         return -1;
@@ -243,17 +345,10 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->opts->algo == ALGO_PLAIN) {
-        write_plain(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    } else {
-        write_half_blocks(
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts->term256);
-    }
+    if (!p->frame)
+        return;
+    update_cells(p);
+    write_frame(vo);
     fflush(stdout);
 }
 
@@ -263,8 +358,10 @@ static void uninit(struct vo *vo)
     printf(ESC_CLEAR_SCREEN);
     printf(ESC_GOTOXY, 0, 0);
     struct priv *p = vo->priv;
-    if (p->buffer)
-        talloc_free(p->buffer);
+    talloc_free(p->buffer);
+    talloc_free(p->cells);
+    talloc_free(p->prev_cells);
+    talloc_free(p->frame);
     if (p->sws)
         talloc_free(p->sws);
 }
@@ -278,6 +375,7 @@ static int preinit(struct vo *vo)
     struct priv *p = vo->priv;
     p->opts = mp_get_config_group(vo, vo->global, &vo_tct_conf);
     p->sws = mp_sws_alloc(vo);
+    init_x256_lut(&p->lut);
     return 0;
 }
 
@@ -16,10 +16,12 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
 #include <libavutil/opt.h>
 
 #include "config.h"
@@ -34,6 +36,7 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "video/filter/vf.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 //global sws_flags from the command line
@@ -45,6 +48,7 @@ struct sws_opts {
     int chr_hshift;
     float chr_sharpen;
     float lum_sharpen;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -68,11 +72,13 @@ const struct m_sub_options sws_conf = {
         OPT_INT("chs", chr_hshift, 0),
         OPT_FLOATRANGE("ls", lum_sharpen, 0, -100.0, 100.0),
         OPT_FLOATRANGE("cs", chr_sharpen, 0, -100.0, 100.0),
+        OPT_CHOICE_OR_INT("threads", threads, 0, 1, 64, ({"auto", 0})),
         {0}
     },
     .size = sizeof(struct sws_opts),
     .defaults = &(const struct sws_opts){
         .scaler = SWS_BICUBIC,
+        .threads = 1,
     },
 };
 
@@ -95,6 +101,8 @@ void mp_sws_set_from_cmdline(struct mp_sws_context *ctx, struct sws_opts *opts)
 
     ctx->flags = SWS_PRINT_INFO;
     ctx->flags |= opts->scaler;
+
+    ctx->threads = opts->threads > 0 ? opts->threads : av_cpu_count();
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -120,14 +128,240 @@ static bool cache_valid(struct mp_sws_context *ctx)
     return mp_image_params_equal(&ctx->src, &old->src) &&
            mp_image_params_equal(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
+           ctx->threads == old->threads &&
            ctx->brightness == old->brightness &&
            ctx->contrast == old->contrast &&
            ctx->saturation == old->saturation;
 }
 
+// Minimum number of destination rows per slice; smaller slices are not worth
+// the synchronization overhead.
+#define MIN_SLICE_ROWS 16
+
+struct sws_slice {
+    struct sws_slices *owner;
+    struct mp_sws_context *sws;
+    struct mp_image *tmp;   // converted rows, including the margin
+    int src_y0, src_y1;     // source rows read (including the filter margin)
+    int dst_y0, dst_y1;     // destination rows owned by this slice
+    int tmp_y0;             // position of dst_y0 within tmp
+};
+
+struct sws_slices {
+    struct mp_thread_pool *pool;
+
+    struct sws_slice **list;
+    int num;
+
+    // Current frame; only valid during mp_sws_scale().
+    struct mp_image *src, *dst;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int pending;            // protected by lock
+};
+
+static void free_slice_list(struct sws_slices *s)
+{
+    for (int n = 0; n < s->num; n++) {
+        struct sws_slice *slice = s->list[n];
+        // The filters are owned by the parent context.
+        slice->sws->src_filter = slice->sws->dst_filter = NULL;
+        talloc_free(slice);
+    }
+    TA_FREEP(&s->list);
+    s->num = 0;
+}
+
+static void free_slices(void *p)
+{
+    struct sws_slices *s = p;
+    talloc_free(s->pool); // waits for pending work
+    free_slice_list(s);
+    pthread_cond_destroy(&s->wakeup);
+    pthread_mutex_destroy(&s->lock);
+}
+
+static int gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Approximate number of source rows the vertical filter reads per output row.
+static int filter_rows(struct mp_sws_context *ctx)
+{
+    int taps = 4;
+    if (ctx->flags & (SWS_SINC | SWS_SPLINE)) {
+        taps = 20;
+    } else if (ctx->flags & SWS_GAUSS) {
+        taps = 8;
+    } else if (ctx->flags & SWS_LANCZOS) {
+        double p = ctx->params[0];
+        taps = p != SWS_PARAM_DEFAULT ? MPMAX(2, (int)(p * 2 + 1)) : 6;
+    }
+    if (ctx->src_filter && ctx->src_filter->lumV)
+        taps += ctx->src_filter->lumV->length;
+    if (ctx->src_filter && ctx->src_filter->chrV)
+        taps += ctx->src_filter->chrV->length * 2;
+    int scale = (ctx->src.h + ctx->dst.h - 1) / ctx->dst.h;
+    return taps * MPMAX(scale, 1);
+}
+
+// Split the conversion into horizontal bands, each converted by a separate
+// libswscale context. Band borders are put on rows where source and
+// destination positions coincide exactly (and which are aligned for chroma
+// subsampling), so every slice uses the same scale factor as the full image.
+// To avoid seams, each slice also converts some rows of its neighbours, and
+// only copies its own rows to the destination.
+static void setup_slices(struct mp_sws_context *ctx)
+{
+    struct sws_slices *s = ctx->slices;
+    if (s)
+        free_slice_list(s);
+
+    struct mp_image_params *src = &ctx->src;
+    struct mp_image_params *dst = &ctx->dst;
+    struct mp_imgfmt_desc src_fmt = mp_imgfmt_get_desc(src->imgfmt);
+    struct mp_imgfmt_desc dst_fmt = mp_imgfmt_get_desc(dst->imgfmt);
+
+    if (ctx->threads < 2 || src->h < 1 || dst->h < 1)
+        goto disable;
+
+    int g = gcd(src->h, dst->h);
+    int unit_src = src->h / g, unit_dst = dst->h / g;
+    int k = 1;
+    while ((k * unit_src) % src_fmt.align_y || (k * unit_dst) % dst_fmt.align_y)
+        k++;
+    unit_src *= k;
+    unit_dst *= k;
+
+    int units = dst->h / unit_dst;
+    int num = MPMIN(ctx->threads, units);
+    num = MPMIN(num, dst->h / MIN_SLICE_ROWS);
+    if (num < 2)
+        goto disable;
+
+    int margin = (filter_rows(ctx) / 2 + unit_src) / unit_src;
+
+    if (!s) {
+        s = ctx->slices = talloc_zero(ctx, struct sws_slices);
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->wakeup, NULL);
+        talloc_set_destructor(s, free_slices);
+    }
+
+    // The calling thread converts one of the slices itself.
+    if (!s->pool || mp_thread_pool_get_num_threads(s->pool) != num - 1) {
+        talloc_free(s->pool);
+        s->pool = mp_thread_pool_create(s, num - 1);
+        if (!s->pool)
+            goto disable;
+    }
+
+    for (int n = 0; n < num; n++) {
+        int u0 = units * n / num;
+        int u1 = n == num - 1 ? -1 : units * (n + 1) / num;
+        int m0 = MPMAX(u0 - margin, 0);
+        int m1 = u1 < 0 || u1 + margin >= units ? -1 : u1 + margin;
+
+        struct sws_slice *slice = talloc_zero(NULL, struct sws_slice);
+        MP_TARRAY_APPEND(s, s->list, s->num, slice);
+        *slice = (struct sws_slice){
+            .owner = s,
+            .src_y0 = m0 * unit_src,
+            .src_y1 = m1 < 0 ? src->h : m1 * unit_src,
+            .dst_y0 = u0 * unit_dst,
+            .dst_y1 = u1 < 0 ? dst->h : u1 * unit_dst,
+            .tmp_y0 = (u0 - m0) * unit_dst,
+        };
+
+        struct mp_sws_context *sws = mp_sws_alloc(slice);
+        slice->sws = sws;
+        sws->log = ctx->log;
+        sws->flags = ctx->flags & ~SWS_PRINT_INFO;
+        sws->brightness = ctx->brightness;
+        sws->contrast = ctx->contrast;
+        sws->saturation = ctx->saturation;
+        sws->src_filter = ctx->src_filter;
+        sws->dst_filter = ctx->dst_filter;
+        sws->params[0] = ctx->params[0];
+        sws->params[1] = ctx->params[1];
+        sws->src = *src;
+        sws->src.h = slice->src_y1 - slice->src_y0;
+        sws->dst = *dst;
+        sws->dst.h = (m1 < 0 ? dst->h : m1 * unit_dst) - m0 * unit_dst;
+
+        slice->tmp = mp_image_alloc(dst->imgfmt, sws->dst.w, sws->dst.h);
+        if (!slice->tmp)
+            goto disable;
+        talloc_steal(slice, slice->tmp);
+        mp_image_set_params(slice->tmp, &sws->dst);
+
+        if (mp_sws_reinit(sws) < 0)
+            goto disable;
+    }
+
+    MP_VERBOSE(ctx, "Using %d slices.\n", num);
+    return;
+
+disable:
+    if (s)
+        free_slice_list(s);
+}
+
+static void scale_slice(void *p)
+{
+    struct sws_slice *slice = p;
+    struct sws_slices *s = slice->owner;
+
+    struct mp_image src = *s->src;
+    mp_image_crop(&src, 0, slice->src_y0, src.w, slice->src_y1);
+
+    struct mp_image *tmp = slice->tmp;
+    sws_scale(slice->sws->sws, (const uint8_t *const *) src.planes, src.stride,
+              0, src.h, tmp->planes, tmp->stride);
+
+    struct mp_image part = *tmp;
+    mp_image_crop(&part, 0, slice->tmp_y0, part.w,
+                  slice->tmp_y0 + slice->dst_y1 - slice->dst_y0);
+    struct mp_image dst = *s->dst;
+    mp_image_crop(&dst, 0, slice->dst_y0, dst.w, slice->dst_y1);
+    mp_image_copy(&dst, &part);
+
+    pthread_mutex_lock(&s->lock);
+    s->pending -= 1;
+    pthread_cond_broadcast(&s->wakeup);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void scale_slices(struct sws_slices *s, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    s->src = src;
+    s->dst = dst;
+    s->pending = s->num;
+
+    for (int n = 1; n < s->num; n++)
+        mp_thread_pool_queue(s->pool, scale_slice, s->list[n]);
+    scale_slice(s->list[0]);
+
+    pthread_mutex_lock(&s->lock);
+    while (s->pending)
+        pthread_cond_wait(&s->wakeup, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    s->src = s->dst = NULL;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    talloc_free(ctx->slices);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -144,6 +378,7 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
         .contrast = 1 << 16,    // 1.0 in 16.16 fixed point
         .saturation = 1 << 16,
         .force_reload = true,
+        .threads = 1,
         .params = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT},
         .cached = talloc_zero(ctx, struct mp_sws_context),
     };
@@ -242,6 +477,8 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
         return -1;
 
+    setup_slices(ctx);
+
     ctx->force_reload = false;
     *ctx->cached = *ctx;
     return 1;
@@ -262,6 +499,11 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    if (ctx->slices && ctx->slices->num) {
+        scale_slices(ctx->slices, dst, src);
+        return 0;
+    }
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
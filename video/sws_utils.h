@@ -7,6 +7,7 @@
 
 struct mp_image;
 struct sws_opts;
+struct sws_slices;
 
 // libswscale currently requires 16 bytes alignment for row pointers and
 // strides. Otherwise, it will print warnings and use slow codepaths.
@@ -32,6 +33,10 @@ struct mp_sws_context {
     int flags;
     int brightness, contrast, saturation;
     bool force_reload;
+    // Number of threads to scale with (1 disables slice threading). If >1,
+    // the image is split into horizontal slices, each converted with its own
+    // libswscale context on a worker thread.
+    int threads;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
     struct mp_image_params src, dst;
@@ -46,6 +51,9 @@ struct mp_sws_context {
     struct SwsContext *sws;
     bool supports_csp;
 
+    // Slice threading state (NULL if unused)
+    struct sws_slices *slices;
+
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
 };
@@ -158,6 +158,7 @@ def build(ctx):
         ( "common/av_log.c" ),
         ( "common/codecs.c" ),
         ( "common/encode_lavc.c",                "encoding" ),
+        ( "common/mem_budget.c" ),
         ( "common/common.c" ),
         ( "common/tags.c" ),
         ( "common/msg.c" ),
@@ -205,6 +206,7 @@ def build(ctx):
         ( "misc/node.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/thread_pool.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -217,6 +219,7 @@ def build(ctx):
 
         ## Player
         ( "player/audio.c" ),
+        ( "player/benchmark.c" ),
         ( "player/client.c" ),
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
@@ -282,6 +285,7 @@ def build(ctx):
         ## Video
         ( "video/csputils.c" ),
         ( "video/fmt-conversion.c" ),
+        ( "video/frame_cache.c" ),
         ( "video/gpu_memcpy.c",                  "sse4-intrinsics" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
@@ -297,6 +301,7 @@ def build(ctx):
         ( "video/decode/dxva2.c",                "d3d-hwaccel" ),
         ( "video/decode/d3d11va.c",              "d3d-hwaccel" ),
         ( "video/decode/d3d.c",                  "win32" ),
+        ( "video/decode/lavc_parallel.c" ),
         ( "video/decode/vaapi.c",                "vaapi-hwaccel" ),
         ( "video/decode/vd_lavc.c" ),
         ( "video/decode/videotoolbox.c",         "videotoolbox-hwaccel" ),